@@ -26,26 +26,51 @@
 
 #include <stdio.h>
 
+#include "mem.h"
 #include "cond.h"
 #include "break.h"
 
-#define MAX_BREAKPOINTS 20
+#define MAX_BREAKPOINTS 64
 #define MAX_CONDITIONS   5
 
+/*  One bit per address for the hit test.  The list holds the breakpoints in
+ *  the order they were added and any bank qualifier, which is the bank mapped
+ *  at the address when the breakpoint was added, unless anyBank is set.  The
+ *  flag is separate as memBank returns -1 for device and unmapped pages.
+ */
+uint64_t breakPointMap[0x10000 / 64];
+
 struct
 {
     uint16_t    addr[MAX_BREAKPOINTS];
+    intptr_t    bank[MAX_BREAKPOINTS];
+    bool        anyBank[MAX_BREAKPOINTS];
     int     count;
 }
 bp;
 
-void breakPointAdd (uint16_t addr)
+static void breakPointMapUpdate (uint16_t addr)
 {
     int         i;
 
+    breakPointMap[addr >> 6] &= ~(1ULL << (addr & 63));
+
     for (i = 0; i < bp.count; i++)
     {
         if (bp.addr[i] == addr)
+            breakPointMap[addr >> 6] |= 1ULL << (addr & 63);
+    }
+}
+
+void breakPointAdd (uint16_t addr, bool bankOnly)
+{
+    int         i;
+    intptr_t    bank = bankOnly ? memBank (addr) : 0;
+
+    for (i = 0; i < bp.count; i++)
+    {
+        if (bp.addr[i] == addr && bp.anyBank[i] == !bankOnly &&
+            bp.bank[i] == bank)
         {
             printf ("*** Duplicate '%04X'\n", addr);
             return;
@@ -58,7 +83,10 @@ void breakPointAdd (uint16_t addr)
         return;
     }
 
-    bp.addr[bp.count++] = addr;
+    bp.addr[bp.count] = addr;
+    bp.anyBank[bp.count] = !bankOnly;
+    bp.bank[bp.count++] = bank;
+    breakPointMapUpdate (addr);
 }
 
 void breakPointList (void)
@@ -70,43 +98,56 @@ void breakPointList (void)
 
     for (i = 0; i < bp.count; i++)
     {
-        printf ("#%2d (PC = %04X)\n", i, bp.addr[i]);
+        if (bp.anyBank[i])
+            printf ("#%2d (PC = %04X)\n", i, bp.addr[i]);
+        else if (bp.bank[i] == -1)
+            printf ("#%2d (PC = %04X) bank device%s\n", i, bp.addr[i],
+                    memBank (bp.addr[i]) == -1 ? " (mapped)" : "");
+        else
+            printf ("#%2d (PC = %04X) bank %p%s\n", i, bp.addr[i], (void*) bp.bank[i],
+                    memBank (bp.addr[i]) == bp.bank[i] ? " (mapped)" : "");
     }
 }
 
+/*  Removes all breakpoints at the address whatever their bank */
 void breakPointRemove (uint16_t addr)
 {
-    int         i;
+    int         i, j;
 
-    for (i = 0; i < bp.count; i++)
+    for (i = 0, j = 0; i < bp.count; i++)
     {
-        if (bp.addr[i] == addr)
+        if (bp.addr[i] != addr)
         {
-            break;
+            bp.addr[j] = bp.addr[i];
+            bp.anyBank[j] = bp.anyBank[i];
+            bp.bank[j++] = bp.bank[i];
         }
     }
 
-    if (i == bp.count)
+    if (j == bp.count)
     {
         printf ("*** Not found '%04X'\n", addr);
         return;
     }
 
-    for (; i < bp.count - 1; i++)
-    {
-        bp.addr[i] = bp.addr[i+1];
-    }
+    bp.count = j;
+    breakPointMapUpdate (addr);
+}
 
-    bp.count--;
+int breakPointCount (void)
+{
+    return bp.count;
 }
 
-int breakPointHit (uint16_t addr)
+/*  Called when the bit for an address is set to check any bank qualifiers */
+int breakPointBankHit (uint16_t addr)
 {
     int         i;
 
     for (i = 0; i < bp.count; i++)
     {
-        if (bp.addr[i] == addr)
+        if (bp.addr[i] == addr &&
+            (bp.anyBank[i] || bp.bank[i] == memBank (addr)))
         {
             return 1;
         }
@@ -114,4 +155,3 @@ int breakPointHit (uint16_t addr)
 
     return 0;
 }
-
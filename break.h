@@ -25,11 +25,23 @@
 
 #include "cpu.h"
 
-void breakPointAdd (uint16_t addr);
+extern uint64_t breakPointMap[];
+
+void breakPointAdd (uint16_t addr, bool bankOnly);
 void breakPointList (void);
 void breakPointRemove (uint16_t addr);
 void breakPointCondition (uint16_t addr);
-int breakPointHit (uint16_t addr);
+int breakPointBankHit (uint16_t addr);
+int breakPointCount (void);
+
+/*  Most addresses have no breakpoint so only a bit test is needed */
+static inline int breakPointHit (uint16_t addr)
+{
+    if (!(breakPointMap[addr >> 6] & (1ULL << (addr & 63))))
+        return 0;
+
+    return breakPointBankHit (addr);
+}
 
 #endif
 
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ *  Cartridge ROM bank switching.  The ROM image is mapped into the cartridge
+ *  area at >6000 in 4k halves and a bank switch just changes the host pointers
+ *  for a half.  Supported schemes are:
+ *
+ *  write    - write to >6000+2n selects 8k bank n (74LS378)
+ *  inverted - write to >6000+2n selects 8k bank n counting from the end of the
+ *             image (74LS379)
+ *  paged7   - >6000 is the first 4k of the image, write to >7000+2n selects 4k
+ *             page n at >7000
+ *  mbx      - >6000 is the first 3k of the image with 1k RAM at >6C00, a byte
+ *             written to >6FFE selects 4k page n at >7000
+ *  minimem  - >6000 is the first 4k of the image with 4k RAM at >7000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "trace.h"
+#include "mem.h"
+#include "cartridge.h"
+
+static void writeReset (void);
+static void writeSelect (uint16_t addr, uint16_t value, int size);
+static void invertedReset (void);
+static void invertedSelect (uint16_t addr, uint16_t value, int size);
+static void paged7Reset (void);
+static void paged7Select (uint16_t addr, uint16_t value, int size);
+static void mbxReset (void);
+static void mbxWrite (uint16_t addr, uint16_t value, int size);
+static void minimemReset (void);
+static void minimemWrite (uint16_t addr, uint16_t value, int size);
+
+static cartMapper mappers[] =
+{
+    { "write", writeReset, writeSelect },
+    { "inverted", invertedReset, invertedSelect },
+    { "paged7", paged7Reset, paged7Select },
+    { "mbx", mbxReset, mbxWrite },
+    { "minimem", minimemReset, minimemWrite }
+};
+
+static cartMapper *mapperSelected (void)
+{
+    return &mappers[machine->cart.mapper];
+}
+
+/*  Map 4k page n of the image at addr, wrapping if the image is smaller */
+static void pageMap (uint16_t addr, int page)
+{
+    page %= machine->cart.len / 0x1000;
+    memCartridgeMap (addr, machine->cart.image + page * 0x1000, false);
+}
+
+static void bankMap (int bank)
+{
+    bank %= machine->cart.len / 0x2000;
+    pageMap (0x6000, bank * 2);
+    pageMap (0x7000, bank * 2 + 1);
+
+    mprintf (LVL_CONSOLE, "Cartridge bank %d\n", bank);
+}
+
+static void writeReset (void)
+{
+    bankMap (0);
+}
+
+static void writeSelect (uint16_t addr, uint16_t value, int size)
+{
+    bankMap (addr >> 1);
+}
+
+static void invertedSelect (uint16_t addr, uint16_t value, int size)
+{
+    int banks = machine->cart.len / 0x2000;
+
+    bankMap (banks - 1 - (addr >> 1) % banks);
+}
+
+/*  The bank at power up is the last in the image */
+static void invertedReset (void)
+{
+    invertedSelect (0, 0, 2);
+}
+
+static void paged7Reset (void)
+{
+    pageMap (0x6000, 0);
+    pageMap (0x7000, 0);
+}
+
+static void paged7Select (uint16_t addr, uint16_t value, int size)
+{
+    if (addr >= 0x1000)
+        pageMap (0x7000, (addr & 0xFFF) >> 1);
+}
+
+static void mbxReset (void)
+{
+    memcpy (machine->cart.low, machine->cart.image, 0xC00);
+    memset (&machine->cart.low[0xC00], 0, 0x400);
+    memCartridgeMap (0x6000, machine->cart.low, false);
+    pageMap (0x7000, 0);
+}
+
+static void mbxWrite (uint16_t addr, uint16_t value, int size)
+{
+    if (addr < 0xC00 || addr >= 0x1000)
+        return;
+
+    if (size == 2)
+    {
+        addr &= ~1;
+        machine->cart.low[addr] = value >> 8;
+        machine->cart.low[addr+1] = value & 0xFF;
+    }
+    else
+        machine->cart.low[addr] = value;
+
+    /*  The bank register is the byte at >6FFE */
+    if (addr == 0xFFE)
+        pageMap (0x7000, machine->cart.low[0xFFE]);
+}
+
+static void minimemReset (void)
+{
+    pageMap (0x6000, 0);
+    memCartridgeMap (0x7000, machine->cart.minimemRam, true);
+}
+
+static void minimemWrite (uint16_t addr, uint16_t value, int size)
+{
+    mprintf (LVL_CONSOLE, "Cartridge ROM write %04X to %04X\n", value, addr + 0x6000);
+}
+
+/*  Called for writes to cartridge ROM.  Addr is relative to >6000 */
+void cartridgeWrite (uint16_t addr, uint16_t value, int size)
+{
+    if (machine->cart.image)
+        mapperSelected ()->write (addr, value, size);
+}
+
+/*  Release the image if it was mapped or allocated by cartridgeLoad */
+static void cartridgeImageFree (void)
+{
+    CartState *c = &machine->cart;
+
+    if (c->imageAlloc == CART_IMAGE_MMAP)
+        munmap (c->image, c->len);
+    else if (c->imageAlloc == CART_IMAGE_MALLOC)
+        free (c->image);
+
+    c->image = NULL;
+    c->imageAlloc = CART_IMAGE_STATIC;
+}
+
+/*  Set the ROM image to map into the cartridge area, replacing any previous
+ *  image.  The length must be a multiple of 8k.  alloc says how the image
+ *  must be released when it is replaced.
+ */
+void cartridgeImageSet (uint8_t *data, int len, int alloc)
+{
+    if (machine->cart.image != data)
+        cartridgeImageFree ();
+
+    machine->cart.image = data;
+    machine->cart.len = len;
+    machine->cart.imageAlloc = alloc;
+
+    mapperSelected ()->reset ();
+}
+
+bool cartridgeMapperSelect (const char *name)
+{
+    for (unsigned i = 0; i < sizeof (mappers) / sizeof (mappers[0]); i++)
+    {
+        if (!strcmp (name, mappers[i].name))
+        {
+            machine->cart.mapper = i;
+
+            if (machine->cart.image)
+                mapperSelected ()->reset ();
+
+            return true;
+        }
+    }
+
+    printf ("Unknown cartridge mapper '%s'\n", name);
+    return false;
+}
+
+/*  Use a file mapped into memory as the RAM at >7000 and switch to the minimem
+ *  mapper */
+void cartridgeMinimemSet (uint8_t *ram)
+{
+    machine->cart.minimemRam = ram;
+    cartridgeMapperSelect ("minimem");
+
+    if (!machine->cart.image)
+        memCartridgeMap (0x7000, machine->cart.minimemRam, true);
+}
+
+/*  Map a cartridge ROM image read-only into host memory so that it isn't
+ *  copied and banks are shared with anything else that maps the file.  Images
+ *  that aren't a multiple of 8k are read into a zero padded buffer instead as
+ *  touching a mapping past the end of the file faults.
+ */
+void cartridgeLoad (const char *file)
+{
+    int fd = open (file, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat (fd, &st) < 0 || st.st_size == 0)
+    {
+        printf ("can't open cartridge file '%s'\n", file);
+        halt ("cartridge load");
+    }
+
+    int len = (st.st_size + 0x1FFF) & ~0x1FFF;
+    int alloc = (len == st.st_size) ? CART_IMAGE_MMAP : CART_IMAGE_MALLOC;
+    uint8_t *data;
+
+    if (alloc == CART_IMAGE_MMAP)
+    {
+        data = (uint8_t*) mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            printf ("mmap failed to map %s len %d\n", file, len);
+            halt ("cartridge load");
+        }
+    }
+    else
+    {
+        data = (uint8_t*) calloc (len, 1);
+
+        if (!data || read (fd, data, st.st_size) != st.st_size)
+        {
+            printf ("%s read failed\n", file);
+            halt ("cartridge load");
+        }
+    }
+
+    close (fd);
+
+    printf ("%s %s len %x using %s mapper\n", __func__, file, (int) st.st_size, mapperSelected ()->name);
+    cartridgeImageSet (data, len, alloc);
+}
+
+/*  Release the image when the machine is destroyed */
+void cartridgeClose (void)
+{
+    cartridgeImageFree ();
+}
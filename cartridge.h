@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __CARTRIDGE_H
+#define __CARTRIDGE_H
+
+#include "types.h"
+
+/*  Where a cartridge image came from.  Static images belong to the caller */
+#define CART_IMAGE_STATIC       0
+#define CART_IMAGE_MMAP         1
+#define CART_IMAGE_MALLOC       2
+
+/*  A cartridge mapper decides which parts of the ROM image appear at >6000 and
+ *  >7000 and how writes to the cartridge area switch between them */
+typedef struct
+{
+    const char *name;
+    void (*reset) (void);
+    void (*write) (uint16_t addr, uint16_t value, int size);
+}
+cartMapper;
+
+void cartridgeWrite (uint16_t addr, uint16_t value, int size);
+void cartridgeImageSet (uint8_t *data, int len, int alloc);
+bool cartridgeMapperSelect (const char *name);
+void cartridgeLoad (const char *file);
+void cartridgeMinimemSet (uint8_t *ram);
+void cartridgeClose (void);
+
+#endif
@@ -38,13 +38,6 @@
 #include "cassette.h"
 #include "trace.h"
 
-int Cassette::_sampleCount;
-struct timespec Cassette::_audioStart; // The time at which we last read audio
-int Cassette::_modulationState;
-int Cassette::_modulationNext;
-int Cassette::_modulationReadSamples;
-WavFile Cassette::_wavFile;
-
 /*
  *  Create audio cassette recording.  Modulates a sine wave based on
  *  the square wave from the cassette output.  Uses a 3-bit shift register to
@@ -71,14 +64,26 @@ encoding[] =
     { 0, 0 }  // 111 invalid
 };
 
-void Cassette::timerExpired (int duration)
+Cassette::Cassette ()
 {
-    static double sampleCount = 0;
+    _sampleCount = 0;
+    _audioStart.tv_sec = 0;
+    _audioStart.tv_nsec = 0;
+    _modulationState = 0;
+    _modulationNext = 0;
+    _modulationReadSamples = 0;
+    _writeSampleFraction = 0.0;
+    _readSampleFraction = 0.0;
+    _readIdent = 0;
+    _readLastBit = 0;
+}
 
+void Cassette::timerExpired (int duration)
+{
     /*  Duration is in nanoseconds */
-    sampleCount += 1.0 * CASSETTE_SAMPLE_RATE * duration / 1000000000.0;
-    int samples = (int) sampleCount;
-    sampleCount -= samples;
+    _writeSampleFraction += 1.0 * CASSETTE_SAMPLE_RATE * duration / 1000000000.0;
+    int samples = (int) _writeSampleFraction;
+    _writeSampleFraction -= samples;
 
     if (_wavFile.isOpenWrite ())
     {
@@ -112,7 +117,6 @@ void Cassette::modulationToggle (void)
 
 int Cassette::modulationRead (void)
 {
-    static double sampleCount = 0.0;
 
     /*  If the file is closed (reached EOF) then just return a constantly
      *  flipping bit to get the console out of any infinite loops and realise
@@ -149,22 +153,22 @@ int Cassette::modulationRead (void)
 
         double newSamples = 1.0 * nsec * _wavFile.getSampleRate () / 1000000000.0; //  - audioReadSamplePos;
 
-        if (newSamples + sampleCount >= 1.0)
+        if (newSamples + _readSampleFraction >= 1.0)
         {
             /*  How many samples should we read since we did the last read?  Use
              *  a double to track fractions of samples, then use an int to
              *  create the samples
              */
-            sampleCount += newSamples;
+            _readSampleFraction += newSamples;
 
             /* Go through samples one-by-one to ensure no zero crossing is
              * missed in case time skips forward.  The audio playback may fall
              * behind and stutter a bit */
 
-            // samples = (int) sampleCount;
+            // samples = (int) _readSampleFraction;
             samples = 1;
 
-            sampleCount -= samples;
+            _readSampleFraction -= samples;
 
             /*  Reset the timestamp for the next iteration */
             _audioStart = now;
@@ -173,9 +177,6 @@ int Cassette::modulationRead (void)
 
     if (samples > 0)
     {
-        static int ident;
-        static int lastBit;
-
         for (int i = 0; i < samples; i++)
         {
             short sample = 0;
@@ -186,9 +187,9 @@ int Cassette::modulationRead (void)
             _modulationNext = (sample > 0) ? 1 : 0;
         }
 
-        if (samples>1||lastBit != _modulationNext)
-            mprintf (LVL_CASSETTE, "[CS1 smp=%d id=%d]", samples, ident++);
-        lastBit = _modulationNext;
+        if (samples>1||_readLastBit != _modulationNext)
+            mprintf (LVL_CASSETTE, "[CS1 smp=%d id=%d]", samples, _readIdent++);
+        _readLastBit = _modulationNext;
 
         _sampleCount -= samples;
 
@@ -23,6 +23,8 @@
 #ifndef __CASSETTE_H
 #define __CASSETTE_H
 
+#include <time.h>
+
 #include "types.h"
 
 #include "wav.h"
@@ -34,30 +36,33 @@
 #define CASSETTE_BITS_PER_SAMPLE    8
 #define CASSETTE_FILE_NAME "cassette.wav"
 
-/*  TODO all methods and data in this class need to be completely static until
- *  the CRU callbacks are refactored.  */
 class Cassette
 {
 public:
-    static bool motor(int index, uint8_t value);
-    static bool audioGate(int index, uint8_t value);
-    static bool tapeOutput(int index, uint8_t value);
-    static void modulationToggle (void);
-    static uint8_t tapeInput(int index, uint8_t value);
-    static void timerExpired (int duration);
-    static void fileOpenWrite (const char *name);
-    static void fileCloseWrite (void);
+    Cassette ();
+    bool motor(int index, uint8_t value);
+    bool audioGate(int index, uint8_t value);
+    bool tapeOutput(int index, uint8_t value);
+    void modulationToggle (void);
+    uint8_t tapeInput(int index, uint8_t value);
+    void timerExpired (int duration);
+    void fileOpenWrite (const char *name);
+    void fileCloseWrite (void);
 private:
     /*  Maintain a file sample counter.  For write, this is how many samples we have
      *  generated.  For read, it is how many samples are remaining in the file
      */
-    static int _sampleCount;
-    static struct timespec _audioStart; // The time at which we last read audio
-    static int _modulationState;
-    static int _modulationNext;
-    static int _modulationReadSamples;
-    static WavFile _wavFile;
-    static int modulationRead (void);
+    int _sampleCount;
+    struct timespec _audioStart; // The time at which we last read audio
+    int _modulationState;
+    int _modulationNext;
+    int _modulationReadSamples;
+    double _writeSampleFraction;
+    double _readSampleFraction;
+    int _readIdent;
+    int _readLastBit;
+    WavFile _wavFile;
+    int modulationRead (void);
 };
 
 #endif
@@ -19,12 +19,32 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
-
 /*
  *  Manage conditions for setting conditional breaks when running code.
- *  Conditions can be created to test specific memory locations to be equal or
- *  not equal to a specified value or simply to flag whenever the contents of a
- *  location change.
+ *  A condition is an expression which is compiled to a small stack machine
+ *  when it is added.  Operands are:
+ *
+ *      pc, wp, st      CPU registers
+ *      r0 thru r15     Workspace registers
+ *      grom            GROM address
+ *      @<addr>         Word in CPU memory
+ *      b@<addr>        Byte in CPU memory
+ *      v@<addr>        Byte in VDP memory
+ *      <value>         Constant
+ *
+ *  and operators, from highest to lowest precedence, are:
+ *
+ *      ! ch            Not, value changed since last evaluated
+ *      &               Mask
+ *      == != < <= > >= Compare
+ *      in <lo>..<hi>   Range, inclusive
+ *      &&              And
+ *      ||              Or
+ *
+ *  with parentheses for grouping.  Each operand and operator must be separated
+ *  by spaces.  Conditions are only evaluated when an input may have changed.
+ *  Those that use CPU state are evaluated after every instruction.  Those that
+ *  only use memory are evaluated after a write to a location they use.
  */
 
 #include <stdio.h>
@@ -32,88 +52,426 @@
 
 #include "cond.h"
 #include "mem.h"
+#include "grom.h"
+#include "vdp.h"
+#include "parse.h"
 
 #define MAX 100
+#define MAX_OPS 32
+#define MAX_STACK MAX_OPS
+#define MAX_TEXT 80
 
-#define COND_EQUAL      1
-#define COND_NEQUAL     2
-#define COND_CHANGE     3
+enum
+{
+    OP_CONST, OP_PC, OP_WP, OP_ST, OP_REG, OP_WORD, OP_BYTE, OP_VDP, OP_GROM,
+    OP_NOT, OP_CHANGE, OP_MASK, OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_RANGE, OP_AND, OP_OR
+};
+
+/*  Inputs a condition depends on */
+#define IN_MEMORY       0x01
+#define IN_CPU          0x02
+
+/*  VDP memory is changed through the write ports */
+#define VDP_WRITE_DATA  0x8C00
+#define VDP_WRITE_ADDR  0x8C02
+
+typedef struct
+{
+    uint8_t op;
+    uint16_t arg;
+    uint16_t arg2;  // Range top or last value for change
+}
+condOp;
 
-struct
+typedef struct
 {
-    uint16_t    addr;
-    uint16_t    value;
-    int cond;
+    condOp code[MAX_OPS];
+    int len;
+    int inputs;
+    char text[MAX_TEXT];
 }
-c[MAX];
+condition;
 
+static condition c[MAX];
 static int condCount;
 
-static int conditionEval (int i)
+/*  Compiler state */
+static char **tok;
+static int tokCount;
+static int tokPos;
+static condition *comp;
+static bool compError;
+
+/*  Evaluate a condition.  The last values saved by change operators are only
+ *  updated if update is set, so that listing conditions doesn't hide a
+ *  change that hasn't been checked yet.
+ */
+static uint16_t conditionEval (condition *cond, TMS9900Base *cpu, bool update)
+{
+    uint16_t stack[MAX_STACK];
+    int sp = 0;
+    uint16_t a;
+
+    for (int i = 0; i < cond->len; i++)
+    {
+        condOp *op = &cond->code[i];
+
+        switch (op->op)
+        {
+        case OP_CONST: stack[sp++] = op->arg; break;
+        case OP_PC: stack[sp++] = cpu->getPC (); break;
+        case OP_WP: stack[sp++] = cpu->getWP (); break;
+        case OP_ST: stack[sp++] = cpu->getST (); break;
+        case OP_REG: stack[sp++] = memReadW (cpu->getWP () + op->arg * 2); break;
+        case OP_WORD: stack[sp++] = memReadW (op->arg); break;
+        case OP_BYTE: stack[sp++] = memReadB (op->arg); break;
+        case OP_VDP: stack[sp++] = vdpData (op->arg); break;
+        case OP_GROM: stack[sp++] = gromAddr (); break;
+        case OP_NOT: stack[sp-1] = !stack[sp-1]; break;
+
+        case OP_CHANGE:
+            a = stack[sp-1];
+            stack[sp-1] = (a != op->arg2);
+
+            if (update)
+                op->arg2 = a;
+
+            break;
+
+        case OP_RANGE:
+            stack[sp-1] = (stack[sp-1] >= op->arg && stack[sp-1] <= op->arg2);
+            break;
+
+        default:
+            a = stack[--sp];
+
+            switch (op->op)
+            {
+            case OP_MASK: stack[sp-1] &= a; break;
+            case OP_EQ: stack[sp-1] = (stack[sp-1] == a); break;
+            case OP_NE: stack[sp-1] = (stack[sp-1] != a); break;
+            case OP_LT: stack[sp-1] = (stack[sp-1] < a); break;
+            case OP_LE: stack[sp-1] = (stack[sp-1] <= a); break;
+            case OP_GT: stack[sp-1] = (stack[sp-1] > a); break;
+            case OP_GE: stack[sp-1] = (stack[sp-1] >= a); break;
+            case OP_AND: stack[sp-1] = (stack[sp-1] && a); break;
+            case OP_OR: stack[sp-1] = (stack[sp-1] || a); break;
+            }
+        }
+    }
+
+    return stack[0];
+}
+
+static void emit (int op, uint16_t arg, uint16_t arg2)
+{
+    if (comp->len == MAX_OPS)
+    {
+        printf ("*** Condition too long\n");
+        compError = true;
+        return;
+    }
+
+    comp->code[comp->len].op = op;
+    comp->code[comp->len].arg = arg;
+    comp->code[comp->len].arg2 = arg2;
+    comp->len++;
+}
+
+static bool accept (const char *s)
+{
+    if (tokPos < tokCount && !strcasecmp (tok[tokPos], s))
+    {
+        tokPos++;
+        return true;
+    }
+
+    return false;
+}
+
+/*  Numbers must start with a digit or TI hex notation */
+static bool number (char *s, uint16_t *value)
 {
-    int val = memReadW(c[i].addr);
+    int v;
 
-    switch (c[i].cond)
+    if (!(s[0] >= '0' && s[0] <= '9') && s[0] != '>' && s[0] != 'x')
+        return false;
+
+    if (!parseValue (s, &v))
+        return false;
+
+    *value = v;
+    return true;
+}
+
+static void compileExpr (void);
+
+static void compilePrimary (void)
+{
+    uint16_t value;
+    int reg;
+
+    if (tokPos == tokCount)
     {
-    case COND_EQUAL:
-        if (val == c[i].value)
-            return 1;
-        break;
+        printf ("*** Condition incomplete\n");
+        compError = true;
+        return;
+    }
+
+    char *s = tok[tokPos++];
 
-    case COND_NEQUAL:
-        if (val != c[i].value)
-            return 1;
-        break;
+    if (!strcmp (s, "("))
+    {
+        compileExpr ();
 
-    case COND_CHANGE:
-        if (val != c[i].value)
+        if (!accept (")"))
         {
-            c[i].value = val;
-            return 1;
+            printf ("*** Missing ')'\n");
+            compError = true;
         }
-        break;
     }
+    else if (!strcasecmp (s, "pc"))
+    {
+        emit (OP_PC, 0, 0);
+        comp->inputs |= IN_CPU;
+    }
+    else if (!strcasecmp (s, "wp"))
+    {
+        emit (OP_WP, 0, 0);
+        comp->inputs |= IN_CPU;
+    }
+    else if (!strcasecmp (s, "st"))
+    {
+        emit (OP_ST, 0, 0);
+        comp->inputs |= IN_CPU;
+    }
+    else if (!strcasecmp (s, "grom"))
+    {
+        emit (OP_GROM, 0, 0);
+        comp->inputs |= IN_CPU;
+    }
+    else if ((s[0] == 'r' || s[0] == 'R') && sscanf (s + 1, "%d", &reg) == 1 &&
+             reg >= 0 && reg <= 15)
+    {
+        emit (OP_REG, reg, 0);
+        comp->inputs |= IN_CPU;
+    }
+    else if (s[0] == '@' && number (s + 1, &value))
+    {
+        emit (OP_WORD, value, 0);
+        comp->inputs |= IN_MEMORY;
+    }
+    else if ((s[0] == 'b' || s[0] == 'B') && s[1] == '@' && number (s + 2, &value))
+    {
+        emit (OP_BYTE, value, 0);
+        comp->inputs |= IN_MEMORY;
+    }
+    else if ((s[0] == 'v' || s[0] == 'V') && s[1] == '@' && number (s + 2, &value))
+    {
+        emit (OP_VDP, value & 0x3FFF, 0);
+        comp->inputs |= IN_MEMORY;
+    }
+    else if (number (s, &value))
+        emit (OP_CONST, value, 0);
+    else
+    {
+        printf ("*** Unknown operand '%s'\n", s);
+        compError = true;
+    }
+}
 
-    return 0;
+static void compileUnary (void)
+{
+    if (accept ("!"))
+    {
+        compileUnary ();
+        emit (OP_NOT, 0, 0);
+    }
+    else if (accept ("ch"))
+    {
+        compileUnary ();
+        emit (OP_CHANGE, 0, 0);
+    }
+    else
+        compilePrimary ();
 }
 
-void conditionAdd (uint16_t addr, char *comp, uint16_t value)
+static void compileMask (void)
 {
-    int         i;
+    compileUnary ();
 
-    for (i = 0; i < condCount; i++)
+    while (accept ("&"))
+    {
+        compileUnary ();
+        emit (OP_MASK, 0, 0);
+    }
+}
+
+static void compileCompare (void)
+{
+    static const struct { const char *s; int op; } ops[] =
     {
-        if (c[i].addr == addr)
+        { "==", OP_EQ }, { "!=", OP_NE }, { "<", OP_LT }, { "<=", OP_LE },
+        { ">", OP_GT }, { ">=", OP_GE }
+    };
+
+    compileMask ();
+
+    for (unsigned i = 0; i < sizeof (ops) / sizeof (ops[0]); i++)
+    {
+        if (accept (ops[i].s))
         {
-            printf ("*** Duplicate '%04X'\n", addr);
+            compileMask ();
+            emit (ops[i].op, 0, 0);
             return;
         }
     }
 
+    if (accept ("in"))
+    {
+        uint16_t lo = 0, hi = 0;
+        char *dots = tokPos < tokCount ? strstr (tok[tokPos], "..") : NULL;
+
+        if (!dots)
+        {
+            printf ("*** Range must be <lo>..<hi>\n");
+            compError = true;
+            return;
+        }
+
+        *dots = 0;
+
+        if (!number (tok[tokPos], &lo) || !number (dots + 2, &hi))
+        {
+            printf ("*** Invalid range\n");
+            compError = true;
+        }
+
+        *dots = '.';
+        tokPos++;
+        emit (OP_RANGE, lo, hi);
+    }
+}
+
+static void compileAnd (void)
+{
+    compileCompare ();
+
+    while (accept ("&&"))
+    {
+        compileCompare ();
+        emit (OP_AND, 0, 0);
+    }
+}
+
+static void compileExpr (void)
+{
+    compileAnd ();
+
+    while (accept ("||"))
+    {
+        compileAnd ();
+        emit (OP_OR, 0, 0);
+    }
+}
+
+/*  Watch the memory used by a condition so that it is evaluated when it is
+ *  written */
+static void conditionWatch (condition *cond, bool add)
+{
+    void (*watch) (uint16_t addr) = add ? memWatchAdd : memWatchRemove;
+
+    for (int i = 0; i < cond->len; i++)
+    {
+        switch (cond->code[i].op)
+        {
+        case OP_WORD:
+        case OP_BYTE:
+            watch (cond->code[i].arg);
+            break;
+        case OP_VDP:
+            watch (VDP_WRITE_DATA);
+            watch (VDP_WRITE_ADDR);
+            break;
+        }
+    }
+}
+
+/*  Add a condition from a list of tokens.  The original form of <addr> (EQ |
+ *  NE | CH) <value> on a word in memory is still accepted.
+ */
+void conditionAdd (int argc, char *argv[], TMS9900Base *cpu)
+{
+    char addr[MAX_TEXT];
+    char *legacy[3];
+
     if (condCount == MAX)
     {
-        printf ("*** Can't add '%04X'\n", addr);
+        printf ("*** Can't add condition\n");
         return;
     }
 
-    if (!strcasecmp (comp, "eq"))
-        c[i].cond = COND_EQUAL;
-    else if (!strcasecmp (comp, "ne"))
-        c[i].cond = COND_NEQUAL;
-    else if (!strcasecmp (comp, "ch"))
-        c[i].cond = COND_CHANGE;
-    else
+    if (argc == 3 && strlen (argv[0]) < MAX_TEXT - 1)
     {
-        printf ("*** must be CH, EQ or NE '%s'\n", comp);
+        const char *op = NULL;
+
+        if (!strcasecmp (argv[1], "eq"))
+            op = "==";
+        else if (!strcasecmp (argv[1], "ne"))
+            op = "!=";
+        else if (!strcasecmp (argv[1], "ch"))
+            op = "ch";
+
+        if (op)
+        {
+            sprintf (addr, "@%s", argv[0]);
+            legacy[0] = (char*) (strcmp (op, "ch") ? addr : op);
+            legacy[1] = (char*) (strcmp (op, "ch") ? op : addr);
+            legacy[2] = argv[2];
+            argv = legacy;
+            argc = strcmp (op, "ch") ? 3 : 2;
+        }
+    }
+
+    comp = &c[condCount];
+    comp->len = 0;
+    comp->inputs = 0;
+    comp->text[0] = 0;
+    compError = false;
+    tok = argv;
+    tokCount = argc;
+    tokPos = 0;
+
+    compileExpr ();
+
+    if (!compError && tokPos != tokCount)
+    {
+        printf ("*** Unexpected '%s'\n", tok[tokPos]);
+        compError = true;
+    }
+
+    if (compError)
         return;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strlen (comp->text) + strlen (argv[i]) + 2 > MAX_TEXT)
+            break;
+
+        if (i)
+            strcat (comp->text, " ");
+
+        strcat (comp->text, argv[i]);
     }
 
-    c[i].addr = addr;
-    c[i].value = value;
+    /*  Set the initial values for change operators */
+    conditionEval (comp, cpu, true);
+    conditionWatch (comp, true);
     condCount++;
 }
 
-void conditionList (void)
+void conditionList (TMS9900Base *cpu)
 {
     int         i;
 
@@ -122,48 +480,62 @@ void conditionList (void)
 
     for (i = 0; i < condCount; i++)
     {
-        printf ("#%2d : %04X %s %04X %s\n", i, c[i].addr,
-        c[i].cond==COND_EQUAL?"==":"!=",c[i].value,
-        conditionEval (i) ? "TRUE":"");
+        printf ("#%2d : %s %s\n", i, c[i].text,
+        conditionEval (&c[i], cpu, false) ? "TRUE":"");
     }
 }
 
-void conditionRemove (uint16_t addr)
+void conditionRemove (int index)
 {
     int         i;
 
-    for (i = 0; i < condCount; i++)
-    {
-        if (c[i].addr == addr)
-        {
-            break;
-        }
-    }
-
-    if (i == condCount)
+    if (index < 0 || index >= condCount)
     {
-        printf ("*** Not found '%04X'\n", addr);
+        printf ("*** Not found '#%d'\n", index);
         return;
     }
 
-    for (; i < condCount - 1; i++)
+    conditionWatch (&c[index], false);
+
+    for (i = index; i < condCount - 1; i++)
     {
-        c[i].addr = c[i+1].addr;
-        c[i].cond = c[i+1].cond;
-        c[i].value = c[i+1].value;
+        c[i] = c[i+1];
     }
 
     condCount--;
 }
 
-int conditionTrue (void)
+/*  Evaluate the conditions that depend on CPU state, and those that depend on
+ *  memory if memoryChanged is set after a write to a location they use.
+ *  Returns true if any are true.
+ */
+int conditionTrue (TMS9900Base *cpu, bool memoryChanged)
 {
     int i;
+    int inputs = IN_CPU | (memoryChanged ? IN_MEMORY : 0);
+    int ret = 0;
 
     for (i = 0; i < condCount; i++)
-        if (conditionEval (i))
-            return 1;
+        if ((c[i].inputs & inputs) && conditionEval (&c[i], cpu, true))
+            ret = 1;
 
-    return 0;
+    return ret;
 }
 
+int conditionCount (void)
+{
+    return condCount;
+}
+
+/*  Number of conditions that must be evaluated after every instruction */
+int conditionCpuCount (void)
+{
+    int i;
+    int count = 0;
+
+    for (i = 0; i < condCount; i++)
+        if (c[i].inputs & IN_CPU)
+            count++;
+
+    return count;
+}
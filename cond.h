@@ -25,10 +25,12 @@
 
 #include "cpu.h"
 
-void conditionAdd (uint16_t addr, char *comp, uint16_t value);
-void conditionList (void);
-void conditionRemove (uint16_t addr);
-int conditionTrue (void);
+void conditionAdd (int argc, char *argv[], TMS9900Base *cpu);
+void conditionList (TMS9900Base *cpu);
+void conditionRemove (int index);
+int conditionTrue (TMS9900Base *cpu, bool memoryChanged);
+int conditionCount (void);
+int conditionCpuCount (void);
 
 #endif
 
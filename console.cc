@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <execinfo.h>
 #include <signal.h>
 #include <sys/types.h>
@@ -57,12 +58,13 @@
 #include "fddfile.h"
 // #include "diskdir.h"
 #include "sams.h"
+#include "cartridge.h"
+#include "timer.h"
 #include "mem.h"
 #include "fdd.h"
 
 static const char *fileToRead;
 static bool ti994aQuitFlag;
-static int instPerInterrupt;
 static bool statusPane;
 static int pixelSize = 4;
 
@@ -127,7 +129,12 @@ bool consoleBreak (int argc, char *argv[])
             return false;
 
         if (!strncmp (argv[1], "add", strlen(argv[1])))
-            breakPointAdd (addr);
+        {
+            if (argc > 4 || (argc == 4 && strcmp (argv[3], "bank")))
+                return false;
+
+            breakPointAdd (addr, argc == 4);
+        }
         else if (!strncmp (argv[1], "remove", strlen(argv[1])))
             breakPointRemove (addr);
         else
@@ -162,28 +169,22 @@ bool consoleWatch (int argc, char *argv[])
 bool consoleCondition (int argc, char *argv[])
 {
     if (!strncmp (argv[1], "list", strlen(argv[1])))
-        conditionList ();
-    else
+        conditionList (&ti994a);
+    else if (argc < 3)
+        return false;
+    else if (!strncmp (argv[1], "add", strlen(argv[1])))
+        conditionAdd (argc - 2, argv + 2, &ti994a);
+    else if (!strncmp (argv[1], "remove", strlen(argv[1])))
     {
-        int addr;
+        int index;
 
-        if (argc < 3 || !parseValue (argv[2], &addr))
+        if (!parseValue (argv[2], &index))
             return false;
 
-        if (!strncmp (argv[1], "add", strlen(argv[1])))
-        {
-            int value;
-
-            if (argc < 5 || !parseValue (argv[4], &value))
-                return false;
-
-            conditionAdd (addr, argv[3], value);
-        }
-        else if (!strncmp (argv[1], "remove", strlen(argv[1])))
-            conditionRemove (addr);
-        else
-            return false;
+        conditionRemove (index);
     }
+    else
+        return false;
 
     return true;
 }
@@ -301,13 +302,38 @@ bool consolePoke (int argc, char *argv[])
         }
     }
 
+    ti994a.flushBlocks ();
+
     return true;
 }
 
+static void consoleGoExpired (void)
+{
+    timerStop (TIMER_GO);
+    ti994a.clearRunFlag ();
+}
+
 bool consoleGo (int argc, char *argv[])
 {
+    int msec = 0;
+
+    /*  A limit on emulated time lets a script, such as for the headless
+     *  emulator, carry on with the next command */
+    if (argc > 1)
+    {
+        if (!parseValue (argv[1], &msec) || msec <= 0 ||
+            msec > INT_MAX / (TIMER_CLOCK_HZ / 1000))
+        {
+            printf ("Bad run time '%s'\n", argv[1]);
+            return false;
+        }
+
+        timerStart (TIMER_GO, msec * (TIMER_CLOCK_HZ / 1000), consoleGoExpired);
+    }
+
     printf ("Running\n");
-    ti994a.run (instPerInterrupt);
+    ti994a.run ();
+    timerStop (TIMER_GO);
 
     return true;
 }
@@ -366,23 +392,28 @@ bool consoleLevel (int argc, char *argv[])
 
 bool consoleQuit (int argc, char *argv[])
 {
-    exit (0);
+    /*  Leave through main so that open files, eg. a WAV sound file, are
+     *  closed */
+    ti994aQuitFlag = true;
 
     return true;
 }
 
 bool consoleVideo (int argc, char *argv[])
 {
-    vdpInitGraphics(statusPane, pixelSize);
+    return vdpInitGraphics (argc > 1 ? argv[1] : NULL, statusPane, pixelSize);
+}
+
+bool consoleScreenshot (int argc, char *argv[])
+{
+    vdpFrameSave (argv[1]);
 
     return true;
 }
 
 bool consoleSound (int argc, char *argv[])
 {
-    soundInit();
-
-    return true;
+    return soundInit (argc > 1 ? argv[1] : NULL, argc > 2 ? argv[2] : NULL);
 }
 
 bool consoleLoadRom (int argc, char *argv[])
@@ -397,6 +428,17 @@ bool consoleLoadRom (int argc, char *argv[])
         return false;
 
     memLoad (argv[1], addr, bank);
+    ti994a.flushBlocks ();
+    return true;
+}
+
+bool consoleLoadCartridge (int argc, char *argv[])
+{
+    if (argc == 3 && !cartridgeMapperSelect (argv[2]))
+        return false;
+
+    cartridgeLoad (argv[1]);
+    ti994a.flushBlocks ();
     return true;
 }
 
@@ -418,6 +460,8 @@ bool consoleKeyboard (int argc, char *argv[])
 
     if (argc < 2)
         kbdOpen (NULL);
+    else if (!strcmp (argv[1], "script"))
+        return argc == 3 && kbdScript (argv[2]);
     else
         kbdOpen (argv[1]);
 
@@ -434,20 +478,51 @@ bool consoleCtrlC (int argc, char *argv[])
     return true;
 }
 
+/*  Kept so that old configurations still load.  Speed now follows from the
+ *  cycle counts of the instructions executed.
+ */
 bool consoleInsPerSec (int argc, char *argv[])
 {
-    int count;
+    printf ("inspersec is no longer used and is ignored.  Use throttle to run\n"
+            "as fast as possible or execmode to change how the CPU runs\n");
+
+    return true;
+}
 
-    if (argc < 2 || !parseValue (argv[1], &count))
+bool consoleThrottle (int argc, char *argv[])
+{
+    if (!strcmp (argv[1], "on"))
+        timerThrottle (true);
+    else if (!strcmp (argv[1], "off"))
+        timerThrottle (false);
+    else
         return false;
 
-    if (count < 50)
+    return true;
+}
+
+bool consoleIdle (int argc, char *argv[])
+{
+    if (!strcmp (argv[1], "on"))
+        ti994a.idleSkip (true);
+    else if (!strcmp (argv[1], "off"))
+        ti994a.idleSkip (false);
+    else
         return false;
 
-    instPerInterrupt = count / 50;
+    return true;
+}
 
-    printf ("Running at %d instructions per second (%d per VDP interrupt)\n",
-            count, instPerInterrupt);
+bool consoleExecMode (int argc, char *argv[])
+{
+    if (!strncmp (argv[1], "interpret", strlen(argv[1])))
+        ti994a.setExecMode (EXEC_INTERPRET);
+    else if (!strncmp (argv[1], "block", strlen(argv[1])))
+        ti994a.setExecMode (EXEC_BLOCK);
+    else if (!strncmp (argv[1], "jit", strlen(argv[1])))
+        ti994a.setExecMode (EXEC_JIT);
+    else
+        return false;
 
     return true;
 }
@@ -502,6 +577,7 @@ bool consoleEnableMmap (int argc, char *argv[])
         return false;
 
     memMapFile (argv[1], addr, size);
+    ti994a.flushBlocks ();
 
     return true;
 }
@@ -555,14 +631,19 @@ struct _commands
 }
 commands[] =
 {
-    { "break", 2, consoleBreak, "break [ add <addr> | list | remove <addr> ]",
-            "\tAdd, list or remove breakpoints from addresses in ROM" },
+    { "break", 2, consoleBreak, "break [ add <addr> [ bank ] | list | remove <addr> ]",
+            "\tAdd, list or remove breakpoints from addresses in ROM.  With bank,\n"
+            "\tonly break when the bank currently mapped at the address is mapped." },
     { "watch", 2, consoleWatch, "watch [ add <addr> | list | remove <addr> ]",
             "\tAdd, list or remove a watched memory location" },
-    { "condition", 2, consoleCondition, "condition [ add <addr> <cond> <value> | list | remove <addr> ]",
-            "\tAdd, list or remove a conditional break on a memory location.\n"
-            "\t<cond> can be EQ, NE, or CH for equal, not equal and change\n"
-            "\trespectively" },
+    { "condition", 2, consoleCondition, "condition [ add <expression> | list | remove <number> ]",
+            "\tAdd, list or remove a conditional break.  The expression is made\n"
+            "\tof operands pc, wp, st, r0-r15, grom (address), @<addr> (word),\n"
+            "\tb@<addr> (byte) and v@<addr> (VDP byte) and constants, and operators\n"
+            "\t! ch & == != < <= > >= in <lo>..<hi> && || and parentheses, all\n"
+            "\tseparated by spaces.  eg. \"pc in >6000..>6FFF && b@>8375 == 5\".\n"
+            "\tThe form <addr> (EQ|NE|CH) <value> is also accepted.  Remove takes\n"
+            "\tthe number shown by list" },
     { "peek", 2, consolePeek, "peek [ cpu | pad | padgpl | (mem|grom|vdp) <addr> [<size> [<count>]]]",
             "\tPeek at various things.  Show cpu shows CPU registers, internal and\n" 
             "\tworkspace.  Show pad dumps the scratchpad memory.  Show padgpl shows\n"
@@ -575,8 +656,9 @@ commands[] =
             "\tPokes one or more values into cpu or vdp memory" },
     { "@", 2, consoleReadInput, "@ <file>",
             "\tReads input commands from a file" },
-    { "go", 1, consoleGo, "go",
-            "\tBegin running from the current program counter" },
+    { "go", 1, consoleGo, "go [<msec>]",
+            "\tBegin running from the current program counter.  If a time is\n"
+            "\tgiven, stop after that many msec of emulated time" },
     { "boot", 1, consoleBoot, "boot",
             "\tBoot the CPU.  Initialise WP, PC and ST registers" },
     { "unassemble", 1, consoleUnassemble, "unassemble [ covered ]",
@@ -586,21 +668,47 @@ commands[] =
     { "level", 2, consoleLevel, "level <dbg-level>",
             "\tSet the debug level.  See trace.h for description of levels" },
     { "quit", 1, consoleQuit, "quit", "\tExit the program" },
-    { "video", 1, consoleVideo, "video", "\tEnable video output" },
-    { "sound", 1, consoleSound, "sound", "\tEnable audio output" },
+    { "video", 1, consoleVideo, "video [ gl | memory ]",
+            "\tEnable video output to a window, or only to the framebuffer in\n"
+            "\tmemory.  Default is a window unless headless" },
+    { "screenshot", 2, consoleScreenshot, "screenshot <file>",
+            "\tSave the framebuffer as a PPM image" },
+    { "sound", 1, consoleSound, "sound [ pulse | null | file <wav-file> ]",
+            "\tEnable audio output to pulse audio, nowhere or a WAV file.  Default\n"
+            "\tis pulse audio unless headless" },
     { "comments", 2, consoleComments, "comments <file>",
             "\tLoad disassembly comments from a file" },
     { "load", 3, consoleLoadRom, "load <file> <addr> [<length>]",
             "\tLoad a ROM binary file to the specified CPU memory address" },
+    { "cartridge", 2, consoleLoadCartridge,
+            "cartridge <file> [ write | inverted | paged7 | mbx | minimem ]",
+            "\tMap a banked cartridge ROM image read-only at >6000.  The optional\n"
+            "\tmapper selects how writes to the cartridge switch banks.  Default is\n"
+            "\twrite, where a write to >6000+2n selects 8k bank n." },
     { "grom", 2, consoleLoadGrom, "grom <file>",
             "\tLoad a GROM binary file to the specified GROM memory address" },
-    { "keyboard", 1, consoleKeyboard, "keyboard [<file>]",
+    { "keyboard", 1, consoleKeyboard, "keyboard [ <file> | script <file> ]",
             "\tBegin reading key events from the specified device file, or try\n"
-            "\tto find the event file if none is specified" },
+            "\tto find the event file if none is specified.  A script has lines of\n"
+            "\t<msec> <key> ( down | up ) giving the emulated time of each event" },
     { "ctrlc", 1, consoleCtrlC, "ctrlc",
             "\tCapture Ctrl-C and return to console for input" },
     { "inspersec", 2, consoleInsPerSec, "inspersec <count>",
-            "\tSpecify how many instructions per second to run (minimum 50)" },
+            "\tIgnored.  Speed follows from instruction cycle counts.  See throttle\n"
+            "\tand execmode" },
+    { "throttle", 2, consoleThrottle, "throttle [ on | off ]",
+            "\tKeep emulated time in step with real time (default), or run as fast\n"
+            "\tas possible.  Timing within the emulation is the same either way." },
+    { "idle", 2, consoleIdle, "idle [ on | off ]",
+            "\tSkip ahead to the next event when the CPU is in a loop waiting for\n"
+            "\tone, such as polling the VDP status or keyboard (default on)" },
+    { "execmode", 2, consoleExecMode, "execmode [ interpret | block | jit ]",
+            "\tSelect how the CPU executes instructions.  Interpret decodes each\n"
+            "\tinstruction as it is executed.  Block caches decoded blocks of\n"
+            "\tstraight line code.  JIT also compiles frequently run blocks to\n"
+            "\tx86-64 code, which is not shown in disassembly output.  Falls back\n"
+            "\tto block on other hosts.  Breakpoints, watches and conditions force\n"
+            "\tinterpret mode while set." },
     { "status", 1, consoleStatus, "status",
             "\tDisplay a status pane beside main display (call before enable video)" },
     { "pixelsize", 2, consolePixelSize, "pixelsize <n>",
@@ -743,8 +851,24 @@ int main (int argc, char *argv[])
         exit (1);
     }
 
+    /*  Register the video and audio backends.  The first of each is the
+     *  default.  A headless build has no window or audio device and runs as
+     *  fast as possible.
+     */
+#ifndef HEADLESS
+    vdpDisplayRegister (&vdpDisplayGl);
+    soundSinkRegister (&soundSinkPulse);
+#endif
+    vdpDisplayRegister (&vdpDisplayMemory);
+    soundSinkRegister (&soundSinkNull);
+    soundSinkRegister (&soundSinkFile);
+
     ti994a.init ();
 
+#ifdef HEADLESS
+    timerThrottle (false);
+#endif
+
     while (!ti994aQuitFlag)
     {
         if (fileToRead != NULL)
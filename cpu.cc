@@ -27,6 +27,8 @@
 #include "types.h"
 
 #include "cpu.h"
+#include "x86emit.h"
+#include "cpucore.h"
 
 #if 0
 #include "types.h"
@@ -119,932 +121,515 @@ static OpGroup opGroup[64] =
 //  Declare one global instance of the CPU
 // TMS9900 cpu;
 
-#define REGR(r) _memReadW(_wp+((r)<<1))
-#define REGW(r,d) _memWriteW(_wp+((r)<<1),d)
+DecodedOp TMS9900Base::_decodeTable[0x10000];
+pthread_once_t TMS9900Base::_decodeTableOnce = PTHREAD_ONCE_INIT;
 
-uint16_t TMS9900::fetch (void)
+void TMS9900Base::_statusCarry (bool condition)
 {
-    uint16_t ret;
+    _stPending &= ~FLAG_C;
 
-    ret = _memReadW(_pc);
-    _pc += 2;
-    return ret;
-}
-
-void TMS9900::_blwp (uint16_t addr)
-{
-    uint16_t owp = _wp;
-    uint16_t opc = _pc;
-
-    _wp = _memReadW (addr);
-    _pc = _memReadW (addr+2);
-
-    _debug ("blwp @%x, wp=%x, pc=%x\n", addr, _wp, _pc);
-
-    REGW (13, owp);
-    REGW (14, opc);
-    REGW (15, _st);
-}
-
-void TMS9900::_rtwp (void)
-{
-    _pc = REGR (14);
-    _st = REGR (15);
-    _wp = REGR (13);
-}
-
-/*  Jump if all bits in the set mask are set and all bits in the clear mask are
- *  clear */
-void TMS9900::_jumpAnd (uint16_t setMask, uint16_t clrMask, uint16_t offset)
-{
-    if ((_st & setMask) == setMask &&
-        (~_st & clrMask) == clrMask)
-    {
-        _unasmPostExec("st=%04X[s=%04X&&c=%04X], jump", _st, setMask,
-        clrMask);
-        _pc += offset << 1;
-    }
-}
-
-/*  Jump if any bits in the set mask are set or any bits in the clear mask are
- *  clear */
-void TMS9900::_jumpOr (uint16_t setMask, uint16_t clrMask, uint16_t offset)
-{
-    if ((_st & setMask) != 0 ||
-        (~_st & clrMask) != 0)
-    {
-        _unasmPostExec("st=%04X[s=%04X||c=%04X], jump", _st, setMask,
-        clrMask);
-        _pc += offset << 1;
-    }
-}
-
-void TMS9900::_statusCarry (bool condition)
-{
     if (condition)
         _st |= FLAG_C;
     else
         _st &= ~FLAG_C;
 }
 
-void TMS9900::_statusOverflow (bool condition)
+void TMS9900Base::_statusOverflow (bool condition)
 {
+    _stPending &= ~FLAG_OV;
+
     if (condition)
         _st |= FLAG_OV;
     else
         _st &= ~FLAG_OV;
 }
 
-void TMS9900::_statusEqual (bool condition)
+void TMS9900Base::_statusEqual (bool condition)
 {
+    _stPending &= ~FLAG_EQ;
+
     if (condition)
         _st |= FLAG_EQ;
     else
         _st &= ~FLAG_EQ;
 }
 
-void TMS9900::_statusLogicalGreater (bool condition)
+void TMS9900Base::_statusLogicalGreater (bool condition)
 {
+    _stPending &= ~FLAG_LGT;
+
     if (condition)
         _st |= FLAG_LGT;
     else
         _st &= ~FLAG_LGT;
 }
 
-void TMS9900::_statusArithmeticGreater (bool condition)
+void TMS9900Base::_statusArithmeticGreater (bool condition)
 {
+    _stPending &= ~FLAG_AGT;
+
     if (condition)
         _st |= FLAG_AGT;
     else
         _st &= ~FLAG_AGT;
 }
 
-void TMS9900::_statusParity (uint8_t value)
+void TMS9900Base::_statusParity (uint8_t value)
 {
-    bool oddParity = false;
-
-    for (int i = 0; i < 8; i++)
-        if (value & (1<<i))
-            oddParity = !oddParity;
-
-    // printf("OP %02x = %s\n", value, oddParity ? "ODD" : "EVEN");
-
-    if (oddParity)
-        _st |= FLAG_OP;
-    else
-        _st &= ~FLAG_OP;
+    _parityValue = value;
+    _stPending |= FLAG_OP;
 }
 
-char *TMS9900::_outputStatus (void)
+/*  Record the operands of an add or subtract for evaluating carry and
+ *  overflow.  dData is the destination before the operation. */
+void TMS9900Base::_statusArith (uint8_t kind, uint16_t sData, uint16_t dData)
 {
-    static char text[10];
-    char *tp = text;
-    int st = _st;
-
-    *tp++ = '[';
-    if (st & 0x8000) *tp++ = 'G';
-    if (st & 0x4000) *tp++ = 'A';
-    if (st & 0x2000) *tp++ = '=';
-    if (st & 0x1000) *tp++ = 'C';
-    if (st & 0x0800) *tp++ = 'O';
-    if (st & 0x0400) *tp++ = 'P';
-    if (st & 0x0200) *tp++ = 'X';
-    *tp++=']';
-    *tp++ = 0;
-
-    return text;
-}
-
-void TMS9900::_compareWord (uint16_t sData, uint16_t dData)
-{
-    _statusEqual (sData == dData);
-    _statusLogicalGreater (sData > dData);
-    // _unasmPostExec("[AGT:%x>%x]", (int16_t)sData, (int16_t)dData);
-    _statusArithmeticGreater ((int16_t) sData > (int16_t) dData);
-    _unasmPostExec (_outputStatus());
-}
-
-void TMS9900::_compareByte (uint16_t sData, uint16_t dData)
-{
-    _statusEqual (sData == dData);
-    _statusLogicalGreater (sData > dData);
-    _statusArithmeticGreater ((int8_t) sData > (int8_t) dData);
-    _unasmPostExec (_outputStatus());
+    _arithKind = kind;
+    _arithS = sData;
+    _arithD = dData;
+    _stPending |= FLAG_LAZY_ARITH;
 }
 
-uint16_t TMS9900::_operandDecode (uint16_t mode, uint16_t reg, bool isByte)
+/*  Compute the pending status bits from the operands recorded by the last
+ *  instructions to set them */
+void TMS9900Base::_statusEval (void)
 {
-    uint16_t addr;
+    uint16_t st = 0;
 
-    switch (mode)
+    if (_stPending & FLAG_LAZY_CMP)
     {
-    case AMODE_NORMAL:
-        addr = _wp+(reg<<1);
-        break;
+        uint16_t sData = _cmpS;
+        uint16_t dData = _cmpD;
 
-    case AMODE_INDIR:
-        addr = REGR(reg);
-        break;
+        if (sData == dData)
+            st |= FLAG_EQ;
 
-    case AMODE_SYM:
-        addr = (uint16_t) (fetch() + (reg == 0 ? 0 : REGR(reg)));
-        break;
+        if (sData > dData)
+            st |= FLAG_LGT;
 
-    case AMODE_INDIRINC:
-        addr = REGR(reg);
-        REGW (reg, REGR(reg) + (isByte ? 1 : 2));
-        break;
-
-    default:
-        _halt ("Bad operand mode");
+        if (_cmpKind == LAZY_WORD ? (int16_t) sData > (int16_t) dData :
+                                    (int8_t) sData > (int8_t) dData)
+            st |= FLAG_AGT;
     }
 
-    return addr;
-}
-
-uint16_t TMS9900::_operandFetch (uint16_t mode, uint16_t reg, uint16_t addr, bool isByte, bool doFetch)
-{
-    uint16_t data = 0;
-
-    if (isByte)
+    if (_stPending & FLAG_OP)
     {
-        if (mode)
-            _unasmPostExec("B:[%04X]", addr);
-        else
-            _unasmPostExec("R%d", reg);
+        bool oddParity = false;
 
-        if (doFetch)
-        {
-            data = _memReadB (addr);
-            _unasmPostExec("=%02X", data);
-        }
+        for (int i = 0; i < 8; i++)
+            if (_parityValue & (1<<i))
+                oddParity = !oddParity;
+
+        if (oddParity)
+            st |= FLAG_OP;
     }
-    else
+
+    /*  Byte overflow is tested on bit 15 of the operands, which are always
+     *  zero, so is never set */
+    if (_stPending & FLAG_LAZY_ARITH)
     {
-        if (mode)
-            _unasmPostExec("W:[%04X]", addr);
-        else
-            _unasmPostExec("R%d", reg);
+        uint16_t sData = _arithS;
+        uint16_t dData = _arithD;
+        uint32_t u32;
 
-        if (doFetch)
+        switch (_arithKind)
         {
-            data = _memReadW (addr);
-            _unasmPostExec("=%04X", data);
+        case LAZY_ADD:
+            u32 = (uint32_t) dData + sData;
+            if ((sData & 0x8000) == (dData & 0x8000) &&
+                (u32 & 0x8000) != (dData & 0x8000))
+                st |= FLAG_OV;
+            if ((u32 >> 16) != 0)
+                st |= FLAG_C;
+            break;
+
+        /*  Carry is set when there is no borrow */
+        case LAZY_SUB:
+            u32 = (uint32_t) dData - sData;
+            if ((sData & 0x8000) != (dData & 0x8000) &&
+                (u32 & 0x8000) != (dData & 0x8000))
+                st |= FLAG_OV;
+            if ((u32 >> 16) == 0)
+                st |= FLAG_C;
+            break;
+
+        case LAZY_ADDB:
+            u32 = (uint32_t) dData + sData;
+            if ((u32 >> 8) != 0)
+                st |= FLAG_C;
+            break;
+
+        case LAZY_SUBB:
+            u32 = (uint32_t) dData - sData;
+            if ((u32 >> 8) == 0)
+                st |= FLAG_C;
+            break;
         }
     }
 
-    return data;
+    _st = (_st & ~_stPending) | (st & _stPending);
+    _stPending = 0;
 }
 
-/*
- *  I M M E D I A T E S
- */
-
-void TMS9900::_executeImmediate (uint16_t opcode, uint16_t reg)
+char *TMS9900Base::_outputStatus (void)
 {
-    uint16_t immed;
-    uint32_t data;
-
-    switch (opcode)
-    {
-    case OP_LI:
-        immed = fetch();
-        REGW(reg,immed);
-        break;
-
-    case OP_AI:
-        data = REGR(reg);
-        immed = fetch();
-        /*  Overflow if MSB(data)=MSB(Imm) && MSB(result) != MSB (data) */
-        _statusOverflow ((data & 0x8000) == (immed & 0x8000) &&
-                        ((data+immed) & 0x8000) != (data & 0x8000));
-        _unasmPostExec ("R%d=%04X+%04X=%04X", reg, data, immed, data+immed);
-        data += immed;
-        _statusCarry (data >= 0x10000);
-        data &= 0xffff;
-        REGW(reg,data);
-        _compareWord (data, 0);
-        break;
-
-    case OP_ANDI:
-        data = REGR(reg);
-        immed = fetch();
-        _unasmPostExec ("R%d=%04X&%04X=%04X", reg, data, immed, data&immed);
-        data &= immed;
-        REGW(reg,data);
-        _compareWord (data, 0);
-        break;
-
-    case OP_ORI:
-        data = REGR(reg);
-        immed = fetch();
-        _unasmPostExec ("R%d=%04X|%04X=%04X", reg, data, immed, data|immed);
-        data |= immed;
-        REGW(reg,data);
-        _compareWord (data, 0);
-        break;
-
-    case OP_CI:
-        data = REGR(reg);
-        _unasmPostExec ("R%d=%04X", reg, data);
-        _compareWord (data, fetch());
-        break;
-
-    case OP_STST:
-        immed = _st;
-        _unasmPostExec ("R%d=%04X", reg, immed);
-        REGW(reg,immed);
-        break;
-
-    case OP_STWP:
-        immed = _wp;
-        _unasmPostExec ("R%d=%04X", reg, immed);
-        REGW(reg,immed);
-        break;
-
-    case OP_LWPI:
-        immed = fetch();
-        _wp = immed;
-        break;
-
-    case OP_LIMI:
-        _st = (_st & ~FLAG_MSK) | fetch();
-        break;
+    static thread_local char text[10];
+    char *tp = text;
+    int st = getST ();
 
-    case OP_RTWP:
-        _rtwp ();
-        _unasmPostExec ("pc=%04X", _pc);
-        break;
+    *tp++ = '[';
+    if (st & 0x8000) *tp++ = 'G';
+    if (st & 0x4000) *tp++ = 'A';
+    if (st & 0x2000) *tp++ = '=';
+    if (st & 0x1000) *tp++ = 'C';
+    if (st & 0x0800) *tp++ = 'O';
+    if (st & 0x0400) *tp++ = 'P';
+    if (st & 0x0200) *tp++ = 'X';
+    *tp++=']';
+    *tp++ = 0;
 
-    default:
-        _halt ("Bad immediate opcode");
-    }
+    return text;
 }
 
-void TMS9900::_executeSingle (uint16_t opcode, uint16_t mode, uint16_t reg)
+uint16_t TMS9900Base::decode (uint16_t data, uint16_t *type)
 {
-    uint16_t addr;
-    uint16_t param;
-
-    addr = _operandDecode (mode, reg, false);
-
-    if (mode)
-        _unasmPostExec("W:[%04X]", addr);
-    else
-        _unasmPostExec("R%d", reg);
+    OpGroup *o = &opGroup[data >> 10];
+    *type = o->type;
+    return (data & o->opMask);
+}
 
-    switch (opcode)
+/*  Build the decode table.  Each possible instruction word is decoded once
+ *  here into its handler and operand fields so that execute only needs a
+ *  single table lookup and a switch on the handler.
+ */
+void TMS9900Base::_buildDecodeTable (void)
+{
+    /*  Clock cycles from the data manual excluding addressing modes.  Jumps
+     *  are the cycles when not taken, DIV is the cycles on overflow and ABS
+     *  is the cycles for a positive operand.  Shifts and LDCR exclude the
+     *  cycles per bit and STCR is for 1 to 7 bits.
+     */
+    static const struct
     {
-    case OP_BLWP:
-        _unasmPostExec ("=%04X", addr);
-        _blwp (addr);
-        break;
-
-    case OP_B:
-        _unasmPostExec ("=%04X", addr);
-        _pc = addr;
-        break;
-
-    case OP_X:
-        param = _memReadW (addr);
-        _debug ("X : recurse\n");
-        execute (param);
-        break;
-
-    case OP_CLR:
-        _memWriteW (addr, 0);
-        break;
-
-    case OP_NEG:
-        param = _memReadW (addr);
-        _statusCarry (param == 0x8000);
-        _statusOverflow (param & 0x8000);
-        param = -param;
-        _unasmPostExec ("=%04X", param);
-        _memWriteW (addr, param);
-        _compareWord (param, 0);
-        break;
-
-    case OP_INV:
-        param = ~_memReadW (addr);
-        _unasmPostExec ("=%04X", param);
-        _memWriteW (addr, param);
-        _compareWord (param, 0);
-        break;
-
-    case OP_INC:
-        param = _memReadW (addr);
-        _statusOverflow ((param & 0x8000) == 0 &&
-                        ((param + 1) & 0x8000) == 0x8000);
-        _statusCarry (param == 0xFFFF);
-        param += 1;
-        _unasmPostExec ("=%04X", param);
-        _memWriteW (addr, param);
-        _compareWord (param, 0);
-        break;
+        uint16_t opcode;
+        uint8_t handler;
+        uint8_t cycles;
+    }
+    handlers[] =
+    {
+        { OP_LI,   H_LI,   12 }, { OP_AI,   H_AI,   14 },
+        { OP_ANDI, H_ANDI, 14 }, { OP_ORI,  H_ORI,  14 },
+        { OP_CI,   H_CI,   14 }, { OP_STWP, H_STWP,  8 },
+        { OP_STST, H_STST,  8 }, { OP_LWPI, H_LWPI, 10 },
+        { OP_LIMI, H_LIMI, 16 }, { OP_RTWP, H_RTWP, 14 },
+
+        { OP_BLWP, H_BLWP, 26 }, { OP_B,    H_B,     8 },
+        { OP_X,    H_X,     8 }, { OP_CLR,  H_CLR,  10 },
+        { OP_NEG,  H_NEG,  12 }, { OP_INV,  H_INV,  10 },
+        { OP_INC,  H_INC,  10 }, { OP_INCT, H_INCT, 10 },
+        { OP_DEC,  H_DEC,  10 }, { OP_DECT, H_DECT, 10 },
+        { OP_BL,   H_BL,   12 }, { OP_SWPB, H_SWPB, 10 },
+        { OP_SETO, H_SETO, 10 }, { OP_ABS,  H_ABS,  12 },
+
+        { OP_SRA,  H_SRA,  12 }, { OP_SRL,  H_SRL,  12 },
+        { OP_SLA,  H_SLA,  12 }, { OP_SRC,  H_SRC,  12 },
+
+        { OP_JMP,  H_JMP,   8 }, { OP_JLT,  H_JLT,   8 },
+        { OP_JLE,  H_JLE,   8 }, { OP_JEQ,  H_JEQ,   8 },
+        { OP_JHE,  H_JHE,   8 }, { OP_JGT,  H_JGT,   8 },
+        { OP_JNE,  H_JNE,   8 }, { OP_JNC,  H_JNC,   8 },
+        { OP_JOC,  H_JOC,   8 }, { OP_JNO,  H_JNO,   8 },
+        { OP_JL,   H_JL,    8 }, { OP_JH,   H_JH,    8 },
+        { OP_SBO,  H_SBO,  12 }, { OP_SBZ,  H_SBZ,  12 },
+        { OP_TB,   H_TB,   12 },
+
+        { OP_COC,  H_COC,  14 }, { OP_CZC,  H_CZC,  14 },
+        { OP_XOR,  H_XOR,  14 }, { OP_XOP,  H_XOP,  36 },
+        { OP_LDCR, H_LDCR, 20 }, { OP_STCR, H_STCR, 42 },
+        { OP_MPY,  H_MPY,  52 }, { OP_DIV,  H_DIV,  16 },
+
+        { OP_SZC,  H_SZC,  14 }, { OP_SZCB, H_SZCB, 14 },
+        { OP_S,    H_S,    14 }, { OP_SB,   H_SB,   14 },
+        { OP_C,    H_C,    14 }, { OP_CB,   H_CB,   14 },
+        { OP_A,    H_A,    14 }, { OP_AB,   H_AB,   14 },
+        { OP_MOV,  H_MOV,  14 }, { OP_MOVB, H_MOVB, 14 },
+        { OP_SOC,  H_SOC,  14 }, { OP_SOCB, H_SOCB, 14 }
+    };
+
+    /*  Clock cycles added by each addressing mode for word and byte
+     *  operands.  Auto increment takes longer for words.
+     */
+    static const uint8_t modeCycles[2][4] =
+    {
+        { 0, 4, 8, 8 },
+        { 0, 4, 8, 6 }
+    };
 
-    case OP_INCT:
-        param = _memReadW (addr);
-        _statusOverflow ((param & 0x8000) == 0 &&
-                        ((param + 2) & 0x8000) == 0x8000);
-        _statusCarry ((param & 0xFFFE) == 0xFFFE);
-        param += 2;
-        if(addr&1)
+    for (int data = 0; data < 0x10000; data++)
+    {
+        DecodedOp *d = &_decodeTable[data];
+        uint16_t type;
+        bool isByte;
+
+        d->opcode = decode (data, &type);
+        d->type = type;
+        d->sMode = 0;
+        d->sReg = 0;
+        d->dMode = 0;
+        d->dReg = 0;
+        d->offset = 0;
+        d->handler = H_ILLEGAL;
+        d->cycles = 0;
+
+        switch (type)
         {
-            param&=0xFF;
-            _unasmPostExec ("=%02X", param);
-            _memWriteB(addr,param);
-            _compareByte (param, 0);
+        case OPTYPE_IMMED:
+            d->sReg   =  data & 0x000F;
+            break;
+
+        case OPTYPE_SINGLE:
+            d->sMode = (data & 0x0030) >> 4;
+            d->sReg  =  data & 0x000F;
+            d->cycles = modeCycles[0][d->sMode];
+            break;
+
+        case OPTYPE_SHIFT:
+            d->dReg = (data & 0x00F0) >> 4;
+            d->sReg =  data & 0x000F;
+            d->cycles = 2 * d->dReg;
+            break;
+
+        case OPTYPE_JUMP:
+            d->offset = data & 0x00FF;
+            break;
+
+        case OPTYPE_DUAL1:
+            d->dReg  = (data & 0x03C0) >> 6;
+            d->sMode = (data & 0x0030) >> 4;
+            d->sReg  =  data & 0x000F;
+            isByte = ((d->opcode == OP_LDCR || d->opcode == OP_STCR) &&
+                      d->dReg != 0 && d->dReg <= 8);
+            d->cycles = modeCycles[isByte][d->sMode];
+            break;
+
+        case OPTYPE_DUAL2:
+            d->dMode = (data & 0x0C00) >> 10;
+            d->dReg  = (data & 0x03C0) >> 6;
+            d->sMode = (data & 0x0030) >> 4;
+            d->sReg  =  data & 0x000F;
+            isByte = (data & 0x1000) != 0;
+            d->cycles = modeCycles[isByte][d->sMode] +
+                        modeCycles[isByte][d->dMode];
+            break;
+
+        default:
+            /*  Leave as illegal */
+            continue;
         }
-        else
+
+        for (unsigned i = 0; i < sizeof (handlers) / sizeof (handlers[0]); i++)
         {
-            _unasmPostExec ("=%04X", param);
-            _memWriteW (addr, param);
-            _compareWord (param, 0);
+            if (handlers[i].opcode == d->opcode)
+            {
+                d->handler = handlers[i].handler;
+                d->cycles += handlers[i].cycles;
+                break;
+            }
         }
-        break;
 
-    case OP_DEC:
-        param = _memReadW (addr);
-        _statusCarry (param != 0);
-        _statusOverflow ((param & 0x8000) == 0x8000 &&
-                        ((param - 1) & 0x8000) == 0);
-        param -= 1;
-        _unasmPostExec ("=%04X", param);
-        _memWriteW (addr, param);
-        _compareWord (param, 0);
-        break;
+        /*  A bit count of zero transfers 16 bits */
+        if (d->opcode == OP_LDCR)
+            d->cycles += 2 * (d->dReg ? d->dReg : 16);
 
-    case OP_DECT:
-        param = _memReadW (addr);
-        _statusCarry (param != 0 && param != 1);
-        _statusOverflow ((param & 0x8000) == 0x8000 &&
-                        ((param - 2) & 0x8000) == 0);
-        param -= 2;
-        /*  Not sure if this is strictly necessary, but in the ROM code there
-         *  are several places where DECT is called on an odd address.  Does
-         *  this mean only the low byte should be decremented?  Assume so for
-         *  now.
-         */
-        if(addr&1)
+        if (d->opcode == OP_STCR)
         {
-            param&=0xFF;
-            _unasmPostExec ("=%02X", param);
-            _memWriteB(addr,param);
-            _compareByte (param, 0);
+            if (d->dReg == 0)
+                d->cycles += 18;
+            else if (d->dReg == 8)
+                d->cycles += 2;
+            else if (d->dReg > 8)
+                d->cycles += 16;
         }
-        else
-        {
-            _unasmPostExec ("=%04X", param);
-            _memWriteW (addr, param);
-            _compareWord (param, 0);
-        }
-        break;
-
-    case OP_BL:
-        REGW(11, _pc);
-        _pc = addr;
-        break;
-
-    case OP_SWPB:
-        param = _memReadW (addr);
-        param = SWAP(param);
-        _unasmPostExec ("=%04X", param);
-        _memWriteW (addr, param);
-        _compareWord (param, 0);
-        break;
-
-    case OP_SETO:
-        _memWriteW (addr, 0xFFFF);
-        break;
-
-    case OP_ABS:
-        param = _memReadW (addr);
-        _statusCarry (param == 0x8000);
-        _statusOverflow (param & 0x8000);
-        /*  AGT for ABS is unusual in that it takes the sign of the source into
-         *  account and doesn't just do a comparison of the result to zero */
-        _statusArithmeticGreater ((int8_t) param > 0);
-        param = ((int16_t) param < 0) ? -param : param;
-        _unasmPostExec ("=%04X", param);
-        _memWriteW (addr, param);
-        _statusEqual (param == 0);
-        _statusLogicalGreater (param != 0);
-        _unasmPostExec (_outputStatus());
-        break;
-
-    default:
-        _halt ("Bad single opcode");
     }
 }
 
-void TMS9900::_executeShift (uint16_t opcode, uint16_t reg, uint16_t count)
+TMS9900Base::TMS9900Base ()
 {
-    uint32_t u32;
-    int32_t i32;
+    pthread_once (&_decodeTableOnce, _buildDecodeTable);
 
-    if (count == 0)
-        count = REGR(0) & 0x000F;
-
-    if (count == 0)
-        count = 16;
-
-    switch (opcode)
-    {
-    case OP_SRA:
-        i32 = REGR (reg) << 16;
-        _unasmPostExec ("%04X=>", i32>>16);
-        i32 >>= count;
-
-        /* Set carry flag if last bit shifted is set */
-        _statusCarry ((i32 & 0x8000) != 0);
-
-        u32 = (i32 >> 16) & 0xffff;
-        REGW (reg, u32);
-        _compareWord (u32, 0);
-        break;
+    _wsHost = NULL;
+    _wsWait = 0;
+    _cycles = 0;
+    _st = 0;
+    _stPending = 0;
+    _execMode = EXEC_INTERPRET;
+    _blockPool = NULL;
+    _blockFree = NULL;
+    _blockMap = NULL;
+    _codeWord = NULL;
+    _blockCurrent = NULL;
+    _blockAbort = false;
+    _jit = NULL;
+    _jitFull = false;
+}
 
-    case OP_SRC:
-        u32 = REGR (reg);
-        _unasmPostExec ("%04X=>", u32);
-        u32 |= (u32 << 16);
-        _debug ("u32=%x\n", u32);
-        u32 >>= count;
-        _debug ("u32=%x\n", u32);
+/*
+ *  B L O C K   C A C H E
+ */
 
-        /* Set carry flag if last bit shifted is set */
-        _statusCarry ((u32 & 0x8000) != 0);
+/*  Return the number of words an instruction occupies including any
+ *  immediate or symbolic address words that follow it */
+int TMS9900Base::_instructionWords (const DecodedOp *op)
+{
+    int words = 1;
 
-        u32 &= 0xffff;
-        REGW (reg, u32);
-        _compareWord (u32, 0);
+    switch (op->type)
+    {
+    case OPTYPE_IMMED:
+        if (op->opcode != OP_STST && op->opcode != OP_STWP &&
+            op->opcode != OP_RTWP)
+            words++;
         break;
 
-    case OP_SRL:
-        u32 = REGR (reg) << 16;
-        _unasmPostExec ("%04X=>", u32>>16);
-        u32 >>= count;
-
-        /* Set carry flag if last bit shifted is set */
-        _statusCarry ((u32 & 0x8000) != 0);
-
-        u32 >>= 16;
-        REGW (reg, u32);
-        _compareWord (u32, 0);
+    case OPTYPE_SINGLE:
+    case OPTYPE_DUAL1:
+        if (op->sMode == AMODE_SYM)
+            words++;
         break;
 
-    case OP_SLA:
-        i32 = REGR (reg);
-        _unasmPostExec ("%04X=>", i32);
-        u32 = i32 << count;
-
-        /* Set carry flag if last bit shifted is set */
-        _statusCarry ((u32 & 0x10000) != 0);
-
-        /* Set if MSB changes */
-        _statusOverflow ((u32 & 0x8000) != (i32 & 0x8000));
-
-        u32 &= 0xFFFF;
-        REGW (reg, u32);
-        _compareWord (u32, 0);
+    case OPTYPE_DUAL2:
+        if (op->sMode == AMODE_SYM)
+            words++;
+        if (op->dMode == AMODE_SYM)
+            words++;
         break;
-
-    default:
-        _halt ("Bad shift opcode");
     }
 
-    _unasmPostExec ("%04X", u32);
+    return words;
 }
 
-/*
- *  J U M P
+/*  Return true if a block must end after this instruction.  This is any
+ *  instruction that can change the PC other than by stepping over it, that
+ *  changes the workspace or that can unmask interrupts which must be checked
+ *  for immediately.
  */
-void TMS9900::_executeJump (uint16_t opcode, int16_t offset)
+bool TMS9900Base::_blockEnds (const DecodedOp *op)
 {
-    switch (opcode)
+    if (op->handler == H_ILLEGAL)
+        return true;
+
+    switch (op->opcode)
     {
-    case OP_JMP: _jumpAnd (0,        0,                  offset);    break;
-    case OP_JLT: _jumpAnd (0,        FLAG_AGT | FLAG_EQ, offset);    break;
-    case OP_JGT: _jumpAnd (FLAG_AGT, FLAG_EQ,                  offset);    break;
-    case OP_JL:  _jumpAnd (0,        FLAG_LGT | FLAG_EQ, offset);    break;
-    case OP_JLE: _jumpOr  (FLAG_EQ,  FLAG_LGT,           offset);    break;
-    case OP_JH:  _jumpAnd (FLAG_LGT, FLAG_EQ,                  offset);    break;
-    case OP_JHE: _jumpOr  (FLAG_LGT | FLAG_EQ, 0,            offset);    break;
-    case OP_JNC: _jumpAnd (0,        FLAG_C,             offset);    break;
-    case OP_JOC: _jumpAnd (FLAG_C,   0,                  offset);    break;
-    case OP_JNO: _jumpAnd (0,        FLAG_OV,            offset);    break;
-    case OP_JNE: _jumpAnd (0,        FLAG_EQ,            offset);    break;
-    case OP_JEQ: _jumpAnd (FLAG_EQ,  0,                  offset);    break;
-
-    case OP_SBZ:        _cruBitOutput (REGR(12), offset, 0);        break;
-    case OP_SBO:        _cruBitOutput (REGR(12), offset, 1);        break;
+    case OP_B:
+    case OP_BL:
+    case OP_BLWP:
+    case OP_RTWP:
+    case OP_X:
+    case OP_XOP:
+    case OP_LWPI:
+    case OP_LIMI:
+        return true;
 
+    case OP_SBO:
+    case OP_SBZ:
     case OP_TB:
-        // _st &= ~FLAG_EQ;
-        // _st |= (cruBitGet (REGR(12), offset) ? FLAG_EQ : 0);
-        _statusEqual (_cruBitGet (REGR(12), offset));
-        break;
-
-    default:
-        _halt ("Bad jump opcode");
+        return false;
     }
+
+    return op->type == OPTYPE_JUMP;
 }
 
-void TMS9900::_executeDual1 (uint16_t opcode, uint16_t dReg, uint16_t sMode, uint16_t sReg)
+void TMS9900Base::setExecMode (int mode)
 {
-    uint16_t sAddr;
-    uint16_t sData;
-    uint16_t dData;
-    uint32_t u32;
-    
-    sAddr = _operandDecode (sMode, sReg, false);
-    sData = _operandFetch (sMode, sReg, sAddr, false, true);
-
-    switch (opcode)
-    {
-    case OP_COC:
-        dData = REGR (dReg);
-        _unasmPostExec ("&(R%d=%04X)=%04X", dReg, dData, sData & dData);
-        _compareWord (sData & dData, sData);
-        break;
-
-    case OP_CZC:
-        dData = REGR (dReg);
-        _unasmPostExec ("&~(R%d=%04X)=%04X", dReg, dData, sData & ~dData);
-        _compareWord (sData & ~dData, sData);
-        break;
-
-    case OP_XOR:
-        dData = REGR (dReg);
-        _unasmPostExec ("&~(R%d=%04X)=%04X", dReg, dData, sData ^ dData);
-        dData ^= sData;
-        REGW (dReg, dData);
-        _compareWord (dData, 0);
-        break;
-
-    case OP_XOP:
-        _xop (dReg, sData);
-        break;
+    flushBlocks ();
 
-    case OP_MPY:
-        dData = REGR (dReg);
-        _unasmPostExec ("*(R%d=%04X)=%04X", dReg, dData, sData * dData);
-        u32 = dData * sData;
-        REGW(dReg, u32 >> 16);
-        REGW(dReg+1, u32 & 0xFFFF);
-        break;
-
-    case OP_DIV:
-        dData = REGR (dReg);
-        if (sData <= dData)
-        {
-            _unasmPostExec ("<(%04X<%04X)->OVF", sData, dData);
-            _statusOverflow (true);
-        }
-        else
-        {
-            _statusOverflow (false);
-            u32 = REGR(dReg) << 16 | REGR(dReg+1);
-            _unasmPostExec (",(%X/%X)=>%04X,%04X", u32, sData, u32 / sData, u32 % sData);
-            REGW(dReg, u32 / sData);
-            REGW(dReg+1, u32 % sData);
-        }
-
-        break;
-
-    /*
-     *  C R U
-     */
-    case OP_LDCR:
-        if (dReg <= 8)
-        {
-            sData = _memReadB (sAddr);
-            _statusParity (sData);
-        }
-
-        _cruMultiBitSet (REGR(12), sData, dReg);
-        _debug ("LDCR R12=%x s=%x d=%x\n", REGR(12), sData, dReg);
-        break;
+    if (mode != EXEC_INTERPRET && !_blockPool)
+    {
+        _blockPool = new Block[BLOCK_POOL];
+        _blockMap = new Block*[0x8000];
+        _codeWord = new uint16_t[0x8000];
+        flushBlocks ();
+    }
 
-    case OP_STCR:
-        if (dReg <= 8)
-        {
-            sData = _cruMultiBitGet (REGR(12), dReg);
-            _memWriteB(sAddr, sData);
-            _statusParity (sData);
-        }
-        else
-            _memWriteW(sAddr, _cruMultiBitGet (REGR(12), dReg));
-        break;
+    /*  Fall back to block mode if native code can't be generated */
+    if (mode == EXEC_JIT && !_jit && !_jitInit ())
+        mode = EXEC_BLOCK;
 
-    default:
-        _halt ("Bad dual1 opcode");
-    }
+    _execMode = mode;
 }
 
-/*
- *  D U A L   O P E R A N D
+/*  Discard all cached blocks.  Must be called if memory containing code is
+ *  modified other than by the CPU.
  */
-void TMS9900::_executeDual2 (uint16_t opcode, uint16_t dMode, uint16_t dReg,
-                             uint16_t sMode, uint16_t sReg, bool isByte)
+void TMS9900Base::flushBlocks (void)
 {
-    bool doStore = true;
-    uint16_t sAddr;
-    uint16_t sData;
-    uint16_t dAddr;
-    uint16_t dData;
-    uint32_t u32;
-
-    sAddr = _operandDecode (sMode, sReg, isByte);
-    sData = _operandFetch (sMode, sReg, sAddr, isByte, true);
-
-    _unasmPostExec (",");
-    dAddr = _operandDecode (dMode, dReg, isByte);
-    /*  Don't fetch the contents of the destination if op is a MOV */
-    dData = _operandFetch (dMode, dReg, dAddr, isByte,
-                          (opcode != OP_MOV && opcode != OP_MOVB));
-
-    switch (opcode)
-    {
-    case OP_SZC:
-        dData &= ~sData;
-        _unasmPostExec (":&~:%04X", dData);
-        _compareWord (dData, 0);
-        break;
-
-    case OP_SZCB:
-        dData &= ~sData;
-        _unasmPostExec (":&~:%02X", dData);
-        _compareByte (dData, 0);
-        _statusParity (dData);
-        break;
-
-    case OP_S:
-        u32 = (uint32_t) dData - sData;
-        _statusOverflow ((sData & 0x8000) != (dData & 0x8000) &&
-                        (u32 & 0x8000) != (dData & 0x8000));
-        dData = u32 & 0xFFFF;
-        u32 >>= 16;
-        _unasmPostExec (":-:%04X", dData);
-
-        /* 15-AUG-23 carry flag meaning is inverted for S, SB, DEC, DECT.  Where
-         * is this documented ??????
-         */
-        // statusCarry (u32 != 0);
-        _statusCarry (u32 == 0);
-        _compareWord (dData, 0);
-        break;
-
-    case OP_SB:
-        u32 = (uint32_t) dData - sData;
-        _statusOverflow ((sData & 0x8000) != (dData & 0x8000) &&
-                        (u32 & 0x8000) != (dData & 0x8000));
-        dData = u32 & 0xFF;
-        u32 >>= 8;
-        _unasmPostExec (":-:%02X", dData);
-
-        /* 15-AUG-23 carry flag meaning is inverted for S, SB, DEC, DECT.  Where
-         * is this documented ??????
-         */
-        // statusCarry (u32 != 0);
-        _statusCarry (u32 == 0);
-        _compareByte (dData, 0);
-        _statusParity (dData);
-        break;
-
-    case OP_C:
-        _compareWord (sData, dData);
-        _unasmPostExec (":==:");
-        doStore = false;
-        break;
-
-    case OP_CB:
-        _compareByte (sData, dData);
-        _statusParity (sData);
-        _unasmPostExec (":==:");
-        doStore = false;
-        break;
-
-    case OP_MOV:
-        dData = sData;
-        _compareWord (dData, 0);
-        break;
+    if (!_blockPool)
+        return;
 
-    case OP_MOVB:
-        dData = sData;
-        _statusParity (sData);
-        _compareByte (dData, 0);
-        break;
-
-    case OP_SOC:
-        dData |= sData;
-        _unasmPostExec (":|:%04X", dData);
-        _compareWord (dData, 0);
-        break;
-
-    case OP_SOCB:
-        dData |= sData;
-        _unasmPostExec (":|:%02X", dData);
-        _compareByte (dData, 0);
-        _statusParity (dData);
-        break;
-
-    case OP_A:
-        u32 = (uint32_t) dData + sData;
-        _statusOverflow ((sData & 0x8000) == (dData & 0x8000) &&
-                        (u32 & 0x8000) != (dData & 0x8000));
-        dData = u32 & 0xFFFF;
-        _unasmPostExec (":+:%04X", dData);
-        u32 >>= 16;
-
-        _statusCarry (u32 != 0);
-        _compareWord (dData, 0);
-        break;
-
-    case OP_AB:
-        u32 = (uint32_t) dData + sData;
-        _statusOverflow ((sData & 0x8000) == (dData & 0x8000) &&
-                        (u32 & 0x8000) != (dData & 0x8000));
-        dData = u32 & 0xFF;
-        _unasmPostExec (":+:%02X", dData);
-        u32 >>= 8;
-
-        _statusCarry (u32 != 0);
-        _compareByte (dData, 0);
-        _statusParity (dData);
-        break;
-
-    default:
-        _halt ("Bad dual2 opcode");
-    }
-
-    if (doStore)
+    for (int i = 0; i < 0x8000; i++)
     {
-        if (isByte)
-            _memWriteB (dAddr, dData);
-        else
-            _memWriteW (dAddr, dData);
+        _blockMap[i] = NULL;
+        _codeWord[i] = 0;
     }
-}
-
-uint16_t TMS9900::decode (uint16_t data, uint16_t *type)
-{
-    OpGroup *o = &opGroup[data >> 10];
-    *type = o->type;
-    return (data & o->opMask);
-}
 
-void TMS9900::execute (uint16_t data)
-{
-    int sReg = 0;
-    int sMode = 0;
-    int dReg = 0;
-    int dMode = 0;
-    int8_t offset;
-    bool isByte = false;
-    uint16_t type;
+    _blockFree = NULL;
 
-    uint16_t opcode = decode (data, &type);
-
-    _unasmPreExec (_pc, data, type, opcode);
-
-    switch (type)
+    for (int i = 0; i < BLOCK_POOL; i++)
     {
-    case OPTYPE_IMMED:
-        sReg   =  data & 0x000F;
-        _executeImmediate (opcode, sReg);
-        break;
+        _blockPool[i].next = _blockFree;
+        _blockFree = &_blockPool[i];
+    }
 
-    case OPTYPE_SINGLE:
-        sMode = (data & 0x0030) >> 4;
-        sReg     =  data & 0x000F;
-        _executeSingle (opcode, sMode, sReg);
-        break;
+    if (_blockCurrent)
+        _blockAbort = true;
 
-    case OPTYPE_SHIFT:
-        dReg = (data & 0x00F0) >> 4;
-        sReg =  data & 0x000F;
-        _executeShift (opcode, sReg, dReg);
-        break;
+    if (_jit)
+        _jit->reset ();
 
-    case OPTYPE_JUMP:
-        offset = data & 0x00FF;
-        _executeJump (opcode, offset);
-        break;
-
-    case OPTYPE_DUAL1:
-        dReg     = (data & 0x03C0) >> 6;
-        sMode = (data & 0x0030) >> 4;
-        sReg     =  data & 0x000F;
-        _executeDual1 (opcode, dReg, sMode, sReg);
-        break;
+    _jitFull = false;
+}
 
-    case OPTYPE_DUAL2:
-        dMode = (data & 0x0C00) >> 10;
-        dReg     = (data & 0x03C0) >> 6;
-        sMode = (data & 0x0030) >> 4;
-        sReg     =  data & 0x000F;
-        isByte = (data & 0x1000) >> 12;
-        _executeDual2 (opcode, dMode, dReg, sMode, sReg, isByte);
-        break;
+void TMS9900Base::_blockInvalidate (Block *b)
+{
+    for (int i = 0; i < b->count; i++)
+    {
+        uint16_t pc = b->ops[i].pc - 2;
 
-    default:
-        _halt ("Bad optype");
+        for (int j = _instructionWords (b->ops[i].op); j > 0; j--, pc += 2)
+            _codeWord[pc >> 1]--;
     }
 
-    _unasmEndLine ();
-
-    int mask = _st & FLAG_MSK;
-    int level = _interruptLevel (mask);
+    _blockMap[b->start >> 1] = NULL;
+    b->next = _blockFree;
+    _blockFree = b;
 
-    if (level >= 0)
-    {
-        _debug ("interrupt level=%d st=%x\n", level, _st);
-        _blwp (4 * level);
-
-        /*  The ISR mask is automatically lowered to 1 less than the interrupt
-         *  being serviced to ensure only higher priority interrupts can
-         *  interrupt this ISR.
-         */
-        if (level > 0)
-            mask = level - 1;
-        else
-            mask = 0;
-
-        _st = (_st & ~FLAG_MSK) | mask;
-    }
+    /*  If the block being executed has modified itself then stop executing
+     *  it after the current instruction */
+    if (b == _blockCurrent)
+        _blockAbort = true;
 }
 
-void TMS9900::showStatus(void)
+/*  A write has been made to a word that is an instruction in one or more
+ *  cached blocks.  Find the blocks and discard them.
+ */
+void TMS9900Base::_blockCodeWrite (uint16_t addr)
 {
-    uint16_t i;
-
-    _debug ("CPU\n");
-    _debug ("===\n");
-    _debug ("st=%04X\nwp=%04X\npc=%04X\n", _st, _wp, _pc);
+    addr &= ~1;
 
-    for (i = 0; i < 16; i++)
+    for (int i = 0; i < BLOCK_MAX_BYTES; i += 2)
     {
-        _debug ("R%02d: %04X ", i, REGR(i));
-        if ((i + 1) % 4 == 0)
-            _debug ("\n");
-    }
-}
-
-void TMS9900::showStWord(void)
-{
-    _debug ("st=%04X %s int=%d)\n",
-             _st, _outputStatus(), _st & 15);
-}
+        uint16_t start = addr - i;
+        Block *b = _blockMap[start >> 1];
 
-void TMS9900::boot (void)
-{
-    _st = 0;
-    _blwp (0x0);
+        if (b && (uint16_t) (addr - start) < (uint16_t) (b->end - start))
+            _blockInvalidate (b);
+    }
 }
 
-void TMS9900::branch (uint16_t addr)
+void TMS9900Base::branch (uint16_t addr)
 {
     _pc = addr;
 }
 
+/*  Instantiate the core for the abstract CPU class */
+template class TMS9900Core<TMS9900>;
@@ -25,6 +25,7 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <pthread.h>
 
 /*  Define addressing modes, optypes and opcodes.  These are used by the disassembler as well */
 
@@ -120,83 +121,444 @@
 #define FLAG_XOP 0x0200
 #define FLAG_MSK 0x000F
 
-/*  Define a class for the CPU.  This is a standalone class with no dependencies.  It is 
- *  an abstract virtual class.  An instantiated class must derive from this and provide
- *  at a minimum methods for reading and writing memory.  There are optional void overridable
- *  methods for debug, disassembly, CRU and XOP. */
+/*  Status bits that can be evaluated lazily and the kinds of operation they
+ *  are evaluated from */
+#define FLAG_LAZY_CMP   (FLAG_LGT | FLAG_AGT | FLAG_EQ)
+#define FLAG_LAZY_ARITH (FLAG_C | FLAG_OV)
+
+#define LAZY_WORD       0
+#define LAZY_BYTE       1
+#define LAZY_ADD        0
+#define LAZY_SUB        1
+#define LAZY_ADDB       2
+#define LAZY_SUBB       3
+
+/*  Execution modes.  Interpret fetches and decodes each instruction as it is
+ *  executed.  Block mode caches straight line runs of decoded instructions.
+ *  JIT mode additionally compiles frequently executed blocks to native code.
+ */
+#define EXEC_INTERPRET  0
+#define EXEC_BLOCK      1
+#define EXEC_JIT        2
+
+#define BLOCK_MAX_OPS   32      // Max instructions in a cached block
+#define BLOCK_MAX_BYTES (BLOCK_MAX_OPS * 6) // Max span of a cached block
+#define BLOCK_POOL      4096    // Number of blocks that can be cached
+
+#define JIT_THRESHOLD   16      // Executions before a block is compiled
+#define JIT_CODE_SIZE   (8 << 20) // Size of the native code buffer
+#define JIT_BLOCK_SPACE 16384   // Max native code generated for a block
+
+class TMS9900Base;
+class X86Emitter;
+
+/*  Compiled native code for a block.  Takes the host address of the
+ *  workspace and the status register and returns the new PC in bits 0-15,
+ *  the new status in bits 16-31 and the number of instructions executed in
+ *  bits 32-63.
+ */
+typedef uint64_t (*JitCode) (TMS9900Base *cpu, uint8_t *ws, uint32_t st);
+
+/*  Instruction handlers.  The decode table holds one of these for each
+ *  instruction word and the core dispatches on it with a switch so that the
+ *  handlers can be inlined.
+ */
+enum
+{
+    H_ILLEGAL,
+
+    H_LI, H_AI, H_ANDI, H_ORI, H_CI, H_STWP, H_STST, H_LWPI, H_LIMI, H_RTWP,
+
+    H_BLWP, H_B, H_X, H_CLR, H_NEG, H_INV, H_INC, H_INCT, H_DEC, H_DECT,
+    H_BL, H_SWPB, H_SETO, H_ABS,
 
-class TMS9900
+    H_SRA, H_SRL, H_SLA, H_SRC,
+
+    H_JMP, H_JLT, H_JLE, H_JEQ, H_JHE, H_JGT, H_JNE, H_JNC, H_JOC, H_JNO,
+    H_JL, H_JH, H_SBO, H_SBZ, H_TB,
+
+    H_COC, H_CZC, H_XOR, H_XOP, H_LDCR, H_STCR, H_MPY, H_DIV,
+
+    H_SZC, H_SZCB, H_S, H_SB, H_C, H_CB, H_A, H_AB, H_MOV, H_MOVB, H_SOC,
+    H_SOCB
+};
+
+/*  Pre-decoded instruction.  There is one of these for every possible 16-bit
+ *  instruction word.  The handler executes the instruction and the operand
+ *  fields are already extracted from the instruction word.  For shifts, dReg
+ *  holds the shift count.  For LDCR, STCR and XOP, dReg holds the bit count or
+ *  XOP vector respectively.  For jumps and CRU bit ops, offset holds the
+ *  signed displacement.  cycles is the number of clock cycles taken by the
+ *  instruction and its addressing modes.  Handlers add any cycles that
+ *  depend on operand values and the bus adds wait states for each access.
+ */
+typedef struct
+{
+    uint16_t opcode;
+    uint8_t handler;
+    uint8_t type;
+    uint8_t sMode;
+    uint8_t sReg;
+    uint8_t dMode;
+    uint8_t dReg;
+    int8_t offset;
+    uint8_t cycles;
+}
+DecodedOp;
+
+#define CYCLES_INTERRUPT 22     // Clock cycles to enter an interrupt
+
+/*  One instruction in a cached block.  pc is the address following the
+ *  instruction word, which is where any immediate operands are fetched from.
+ *  cycles includes the wait states for fetching the instruction word since
+ *  it isn't read from memory again.  Compiled code accesses the workspace
+ *  and immediates without going through the bus, so for an instruction
+ *  generated inline jitWait is the wait states for its immediates and
+ *  jitRegs the number of workspace accesses the interpreter would make.
+ *  jitRegs is -1 for instructions compiled as calls to the interpreter.
+ */
+typedef struct
+{
+    const DecodedOp *op;
+    uint16_t data;
+    uint16_t pc;
+    uint8_t cycles;
+    uint8_t jitWait;
+    int8_t jitRegs;
+}
+BlockOp;
+
+/*  A cached block of straight line code.  A block ends with any instruction
+ *  that changes the flow of execution, the workspace or the interrupt mask.
+ *  The bank is the identifier returned by the memory bank hook when the
+ *  block was built.  cycles is the total of the cycles of its instructions.
+ *  In JIT mode, hits counts executions until the block is compiled to
+ *  native and jitWait and jitRegs are the totals of those of its inline
+ *  instructions.
+ */
+typedef struct _block
+{
+    uint16_t start;
+    uint16_t end;
+    intptr_t bank;
+    int count;
+    int cycles;
+    int hits;
+    JitCode native;
+    int jitWait;
+    int jitRegs;
+    BlockOp ops[BLOCK_MAX_OPS];
+    struct _block *next;
+}
+Block;
+
+/*  Functions called from compiled code to access memory and to run
+ *  instructions that aren't compiled.  Each CPU core provides its own.
+ */
+typedef struct
+{
+    uint64_t (*callOp) (TMS9900Base *cpu, const BlockOp *o, uint32_t st);
+    uint32_t (*readW) (TMS9900Base *cpu, uint32_t addr);
+    uint32_t (*readB) (TMS9900Base *cpu, uint32_t addr);
+    uint32_t (*writeW) (TMS9900Base *cpu, uint32_t addr, uint32_t data);
+    uint32_t (*writeB) (TMS9900Base *cpu, uint32_t addr, uint32_t data);
+}
+JitHelpers;
+
+/*  CPU state and the parts of the CPU that don't access the bus: status
+ *  evaluation, instruction decoding and block cache management.
+ */
+class TMS9900Base
 {
 public:
-    // uint16_t read(uint16_t addr);
-    void showStatus(void);
-    void showStWord(void);
-    uint16_t fetch (void);
-    uint16_t decode (uint16_t data, uint16_t *type);
-    void execute (uint16_t data);
+    TMS9900Base ();
+    static uint16_t decode (uint16_t data, uint16_t *type);
     uint16_t getPC (void) { return _pc; }
     uint16_t getWP (void) { return _wp; }
-    uint16_t getST (void) { return _st; }
+    uint16_t getST (void) { if (_stPending) _statusEval (); return _st; }
     uint16_t getIntMask (void) { return _st & FLAG_MSK; }
-    void interrupt (int level);
-    void boot (void);
     void branch (uint16_t addr);
-private:
+    void setExecMode (int mode);
+    int getExecMode (void) { return _execMode; }
+    void flushBlocks (void);
+    uint64_t getCycles (void) { return _cycles; }
+protected:
     uint16_t _pc;
     uint16_t _wp;
     uint16_t _st;
 
-    /*  Mandatory memory access overrides */
-    virtual uint16_t _memReadW (uint16_t addr) = 0; // { return 0; }
-    virtual uint8_t _memReadB (uint16_t addr) = 0; // { return 0; }
-    virtual void _memWriteW (uint16_t addr, uint16_t data) = 0; // { }
-    virtual void _memWriteB (uint16_t addr, uint8_t data) = 0; // { }
+    /*  Clock cycles executed since the CPU was created */
+    uint64_t _cycles;
+
+    /*  Host memory holding the workspace registers or NULL if they must be
+     *  accessed through the bus, and the wait states for accessing them */
+    uint8_t *_wsHost;
+    int _wsWait;
+
+    /*  Lazily evaluated status bits.  Instructions record the operands the
+     *  compare, parity and carry/overflow bits depend on and the bits in
+     *  _stPending are only computed from them when the status is read.
+     */
+    uint16_t _stPending;
+    uint8_t _cmpKind;
+    uint16_t _cmpS;
+    uint16_t _cmpD;
+    uint8_t _parityValue;
+    uint8_t _arithKind;
+    uint16_t _arithS;
+    uint16_t _arithD;
+
+    /*  Block cache.  Only allocated when block mode is selected.  The code
+     *  word map counts how many cached blocks contain each instruction word
+     *  so that writes to code can be detected with a single lookup.
+     */
+    int _execMode;
+    Block *_blockPool;
+    Block *_blockFree;
+    Block **_blockMap;
+    uint16_t *_codeWord;
+    Block *_blockCurrent;
+    bool _blockAbort;
+
+    /*  Native code buffer, only allocated when JIT mode is selected.  When
+     *  full, all blocks are flushed before the next block is executed.
+     */
+    X86Emitter *_jit;
+    bool _jitFull;
+
+    /*  Decode table shared by all instances, built once by the first
+     *  constructor to run on any thread */
+    static DecodedOp _decodeTable[0x10000];
+    static pthread_once_t _decodeTableOnce;
+
+    static void _buildDecodeTable (void);
+    int _instructionWords (const DecodedOp *op);
+    bool _blockEnds (const DecodedOp *op);
+    void _blockInvalidate (Block *b);
+    void _blockCodeWrite (uint16_t addr);
+    bool _jitInit (void);
+    bool _jitGenerate (Block *b, const JitHelpers *h);
+    static bool _jitJumpTaken (const DecodedOp *op, uint16_t st);
+    void _statusCarry (bool condition);
+    void _statusOverflow (bool condition);
+    void _statusEqual (bool condition);
+    void _statusLogicalGreater (bool condition);
+    void _statusArithmeticGreater (bool condition);
+    void _statusParity (uint8_t value);
+    void _statusArith (uint8_t kind, uint16_t sData, uint16_t dData);
+    void _statusEval (void);
+    char *_outputStatus (void);
+};
+
+/*  The CPU core.  Memory, CRU, interrupts and disassembly are reached
+ *  through hooks on the Bus class, which must derive from TMS9900Core<Bus>.
+ *  The hooks are bound at compile time so a bus with inline hooks has them
+ *  inlined into the instruction handlers.  A bus must provide methods for
+ *  reading and writing memory and may provide any of the optional hooks
+ *  declared here to replace the defaults.  The core is implemented in
+ *  cpucore.h, which must be included where it is instantiated for a bus.
+ */
+template <class Bus>
+class TMS9900Core : public TMS9900Base
+{
+public:
+    void showStatus(void);
+    void showStWord(void);
+    uint16_t fetch (void);
+    void execute (uint16_t data);
+    void interrupt (int level);
+    void boot (void);
+    int executeBlock (void);
+    void memoryRemapped (void);
+protected:
+    /*  Optional memory bank identification for the block cache.  Should
+     *  return a value that changes whenever different memory is paged in at
+     *  addr or -1 if code at addr must never be cached.  memoryRemapped must
+     *  be called when memory is paged in so that a block being executed from
+     *  the old memory is stopped.
+     */
+    intptr_t _memBank (uint16_t addr) { return 0; }
+
+    /*  Optional direct memory access for JIT compiled code.  Should return a
+     *  host pointer to the byte at addr if it is plain RAM with no side
+     *  effects on read or write, or NULL.  Used to access the workspace
+     *  directly when it is plain RAM.  memoryRemapped must be called if the
+     *  memory returned for an address changes.
+     */
+    uint8_t *_memHostPtr (uint16_t addr) { return NULL; }
+
+    /*  Optional wait states.  Should return the number of clock cycles added
+     *  to each access to memory at addr.
+     */
+    int _memWait (uint16_t addr) { return 0; }
 
     /*  Optional debug */
-    virtual void _debug (const char *s, ...) {}
+    void _debug (const char *s, ...) {}
 
     /*  Optional disassembly hooks */
-    virtual uint16_t _unasmPreExec (uint16_t pc, uint16_t data, uint16_t type, uint16_t opcode) { return 0; }
-    virtual void _unasmPostExec (const char *s, ...) {}
-    virtual void _unasmEndLine (void) {}
+    uint16_t _unasmPreExec (uint16_t pc, uint16_t data, uint16_t type, uint16_t opcode) { return 0; }
+    void _unasmPostExec (const char *s, ...) {}
+    void _unasmEndLine (void) {}
+
+    /*  Optional check whether the current instruction is being disassembled.
+     *  Status output that requires evaluating lazy status bits is skipped if
+     *  not.
+     */
+    bool _unasmActive (void) { return false; }
 
     /*  Optional interrupt handlers */
-    virtual int _interruptLevel (int mask) { return 0; }
-    virtual void _halt (const char *s) { std::cerr << s; exit(1); }
+    int _interruptLevel (int mask) { return 0; }
+    void _halt (const char *s) { std::cerr << s; exit(1); }
 
     /*  Optional CRU handlers */
-    virtual void _cruBitOutput (uint16_t base, uint16_t offset, uint8_t state) {}
-    virtual void _cruMultiBitSet (uint16_t base, uint16_t data, int nBits) {}
-    virtual uint16_t _cruMultiBitGet (uint16_t base, uint16_t offset) { return 0; }
-    virtual uint8_t _cruBitGet (uint16_t base, int8_t bitOffset) { return 0; }
+    void _cruBitOutput (uint16_t base, uint16_t offset, uint8_t state) {}
+    void _cruMultiBitSet (uint16_t base, uint16_t data, int nBits) {}
+    uint16_t _cruMultiBitGet (uint16_t base, uint16_t offset) { return 0; }
+    uint8_t _cruBitGet (uint16_t base, int8_t bitOffset) { return 0; }
 
     /*  Optional XOP handlers */
-    virtual void _xop (uint8_t vector, uint16_t data) {}
+    void _xop (uint8_t vector, uint16_t data) {}
+private:
+    Bus *_bus (void) { return static_cast<Bus*>(this); }
 
-    /*  private methods implemented in cc */
+    /*  private methods implemented in cpucore.h */
+    void _dispatch (const DecodedOp *op);
+    void _writeW (uint16_t addr, uint16_t data);
+    void _writeB (uint16_t addr, uint8_t data);
+    uint16_t _readW (uint16_t addr);
+    uint8_t _readB (uint16_t addr);
+    void _workspaceMap (void);
+    void _interruptCheck (void);
+    Block *_blockBuild (uint16_t pc, intptr_t bank);
+    bool _jitCompile (Block *b);
+    void _jitCycles (Block *b, int count);
+    uint8_t *_jitWorkspace (void);
+    static uint64_t _jitCallOp (TMS9900Base *cpu, const BlockOp *o, uint32_t st);
+    static uint32_t _jitReadW (TMS9900Base *cpu, uint32_t addr);
+    static uint32_t _jitReadB (TMS9900Base *cpu, uint32_t addr);
+    static uint32_t _jitWriteW (TMS9900Base *cpu, uint32_t addr, uint32_t data);
+    static uint32_t _jitWriteB (TMS9900Base *cpu, uint32_t addr, uint32_t data);
     void _blwp (uint16_t addr);
     void _rtwp (void);
     void _jumpAnd (uint16_t setMask, uint16_t clrMask, uint16_t offset);
     void _jumpOr (uint16_t setMask, uint16_t clrMask, uint16_t offset);
-    void _statusCarry (bool condition);
-    void _statusOverflow (bool condition);
-    void _statusEqual (bool condition);
-    void _statusLogicalGreater (bool condition);
-    void _statusArithmeticGreater (bool condition);
-    void _statusParity (uint8_t value);
-    char *_outputStatus (void);
     void _compareWord (uint16_t sData, uint16_t dData);
     void _compareByte (uint16_t sData, uint16_t dData);
     uint16_t _operandDecode (uint16_t mode, uint16_t reg, bool isByte);
     uint16_t _operandFetch (uint16_t mode, uint16_t reg, uint16_t addr, bool isByte, bool doFetch);
-    void _executeImmediate (uint16_t opcode, uint16_t reg);
-    void _executeSingle (uint16_t opcode, uint16_t mode, uint16_t reg);
-    void _executeShift (uint16_t opcode, uint16_t reg, uint16_t count);
-    void _executeJump (uint16_t opcode, int16_t offset);
-    void _executeDual1 (uint16_t opcode, uint16_t dReg, uint16_t sMode, uint16_t sReg);
-    void _executeDual2 (uint16_t opcode, uint16_t dMode, uint16_t dReg,
-                                 uint16_t sMode, uint16_t sReg, bool isByte);
+    uint16_t _singleOperand (const DecodedOp *op);
+    uint16_t _shiftCount (const DecodedOp *op);
+    void _dual2Operands (const DecodedOp *op, bool isByte, bool fetchDest,
+                         uint16_t *sData, uint16_t *dAddr, uint16_t *dData);
+
+    /*  Instruction handlers dispatched from the decode table */
+    void _opIllegal (const DecodedOp *op);
+
+    void _opLI (const DecodedOp *op);
+    void _opAI (const DecodedOp *op);
+    void _opANDI (const DecodedOp *op);
+    void _opORI (const DecodedOp *op);
+    void _opCI (const DecodedOp *op);
+    void _opSTST (const DecodedOp *op);
+    void _opSTWP (const DecodedOp *op);
+    void _opLWPI (const DecodedOp *op);
+    void _opLIMI (const DecodedOp *op);
+    void _opRTWP (const DecodedOp *op);
+
+    void _opBLWP (const DecodedOp *op);
+    void _opB (const DecodedOp *op);
+    void _opX (const DecodedOp *op);
+    void _opCLR (const DecodedOp *op);
+    void _opNEG (const DecodedOp *op);
+    void _opINV (const DecodedOp *op);
+    void _opINC (const DecodedOp *op);
+    void _opINCT (const DecodedOp *op);
+    void _opDEC (const DecodedOp *op);
+    void _opDECT (const DecodedOp *op);
+    void _opBL (const DecodedOp *op);
+    void _opSWPB (const DecodedOp *op);
+    void _opSETO (const DecodedOp *op);
+    void _opABS (const DecodedOp *op);
+
+    void _opSRA (const DecodedOp *op);
+    void _opSRC (const DecodedOp *op);
+    void _opSRL (const DecodedOp *op);
+    void _opSLA (const DecodedOp *op);
+
+    void _opJMP (const DecodedOp *op);
+    void _opJLT (const DecodedOp *op);
+    void _opJGT (const DecodedOp *op);
+    void _opJL (const DecodedOp *op);
+    void _opJLE (const DecodedOp *op);
+    void _opJH (const DecodedOp *op);
+    void _opJHE (const DecodedOp *op);
+    void _opJNC (const DecodedOp *op);
+    void _opJOC (const DecodedOp *op);
+    void _opJNO (const DecodedOp *op);
+    void _opJNE (const DecodedOp *op);
+    void _opJEQ (const DecodedOp *op);
+    void _opSBZ (const DecodedOp *op);
+    void _opSBO (const DecodedOp *op);
+    void _opTB (const DecodedOp *op);
+
+    void _opCOC (const DecodedOp *op);
+    void _opCZC (const DecodedOp *op);
+    void _opXOR (const DecodedOp *op);
+    void _opXOP (const DecodedOp *op);
+    void _opMPY (const DecodedOp *op);
+    void _opDIV (const DecodedOp *op);
+    void _opLDCR (const DecodedOp *op);
+    void _opSTCR (const DecodedOp *op);
+
+    void _opSZC (const DecodedOp *op);
+    void _opSZCB (const DecodedOp *op);
+    void _opS (const DecodedOp *op);
+    void _opSB (const DecodedOp *op);
+    void _opC (const DecodedOp *op);
+    void _opCB (const DecodedOp *op);
+    void _opMOV (const DecodedOp *op);
+    void _opMOVB (const DecodedOp *op);
+    void _opSOC (const DecodedOp *op);
+    void _opSOCB (const DecodedOp *op);
+    void _opA (const DecodedOp *op);
+    void _opAB (const DecodedOp *op);
 };
 
+/*  Define a class for the CPU.  This is a standalone class with no dependencies.  It is 
+ *  an abstract virtual class.  An instantiated class must derive from this and provide
+ *  at a minimum methods for reading and writing memory.  There are optional void overridable
+ *  methods for debug, disassembly, CRU and XOP.  Every hook is an indirect call so
+ *  the emulator itself binds its bus to TMS9900Core directly instead. */
+
+class TMS9900 : public TMS9900Core<TMS9900>
+{
+    friend class TMS9900Core<TMS9900>;
+private:
+    /*  Mandatory memory access overrides */
+    virtual uint16_t _memReadW (uint16_t addr) = 0; // { return 0; }
+    virtual uint8_t _memReadB (uint16_t addr) = 0; // { return 0; }
+    virtual void _memWriteW (uint16_t addr, uint16_t data) = 0; // { }
+    virtual void _memWriteB (uint16_t addr, uint8_t data) = 0; // { }
+
+    /*  Optional overrides, see TMS9900Core */
+    virtual intptr_t _memBank (uint16_t addr) { return 0; }
+    virtual uint8_t *_memHostPtr (uint16_t addr) { return NULL; }
+    virtual int _memWait (uint16_t addr) { return 0; }
+    virtual void _debug (const char *s, ...) {}
+    virtual uint16_t _unasmPreExec (uint16_t pc, uint16_t data, uint16_t type, uint16_t opcode) { return 0; }
+    virtual void _unasmPostExec (const char *s, ...) {}
+    virtual void _unasmEndLine (void) {}
+    virtual bool _unasmActive (void) { return false; }
+    virtual int _interruptLevel (int mask) { return 0; }
+    virtual void _halt (const char *s) { std::cerr << s; exit(1); }
+    virtual void _cruBitOutput (uint16_t base, uint16_t offset, uint8_t state) {}
+    virtual void _cruMultiBitSet (uint16_t base, uint16_t data, int nBits) {}
+    virtual uint16_t _cruMultiBitGet (uint16_t base, uint16_t offset) { return 0; }
+    virtual uint8_t _cruBitGet (uint16_t base, int8_t bitOffset) { return 0; }
+    virtual void _xop (uint8_t vector, uint16_t data) {}
+};
+
+extern template class TMS9900Core<TMS9900>;
+
 #endif
 
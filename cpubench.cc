@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ *  Measure how fast the CPU core runs a fixed loop with the bus bound through
+ *  virtual hooks, as the TMS9900 class does, and bound at compile time, as
+ *  the emulator does, in each execution mode.  The loop copies and sums a
+ *  table with a mix of register, indirect and byte operands.
+ *
+ *  usage: cpubench [<instructions>]
+ *
+ *  The figures only mean something if this and the core are built with
+ *  optimisation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "cpu.h"
+#include "cpucore.h"
+
+static uint8_t mem[0x10000];
+
+static const uint16_t vectors[] =
+{
+    0x8300, 0x0100,             // WP=>8300 PC=>0100
+};
+
+static const uint16_t loop[] =
+{
+    0x0201, 0xA000,             // loop LI   R1,>A000
+    0x0202, 0xB000,             //      LI   R2,>B000
+    0x0203, 0x0100,             //      LI   R3,>0100
+    0xC131,                     // copy MOV  *R1+,R4
+    0xA144,                     //      A    R4,R5
+    0x0B35,                     //      SRC  R5,3
+    0xDC84,                     //      MOVB R4,*R2+
+    0x8105,                     //      C    R5,R4
+    0x1501,                     //      JGT  $+4
+    0x0586,                     //      INC  R6
+    0x0603,                     //      DEC  R3
+    0x16F7,                     //      JNE  copy
+    0x10F0                      //      JMP  loop
+};
+
+static uint16_t readW (uint16_t addr)
+{
+    addr &= ~1;
+    return (mem[addr] << 8) | mem[addr+1];
+}
+
+static void writeW (uint16_t addr, uint16_t data)
+{
+    addr &= ~1;
+    mem[addr] = data >> 8;
+    mem[addr+1] = data & 0xff;
+}
+
+static uint8_t *hostPtr (uint16_t addr)
+{
+    return addr >= 0x2000 ? mem + addr : NULL;
+}
+
+/*  Bus bound through the virtual hooks of TMS9900 */
+class VirtualCPU : public TMS9900
+{
+    uint16_t _memReadW (uint16_t addr) { return readW (addr); }
+    uint8_t _memReadB (uint16_t addr) { return mem[addr]; }
+    void _memWriteW (uint16_t addr, uint16_t data) { writeW (addr, data); }
+    void _memWriteB (uint16_t addr, uint8_t data) { mem[addr] = data; }
+    uint8_t *_memHostPtr (uint16_t addr) { return hostPtr (addr); }
+    int _interruptLevel (int mask) { return -1; }
+};
+
+/*  The same bus bound at compile time */
+class InlineCPU : public TMS9900Core<InlineCPU>
+{
+    friend class TMS9900Core<InlineCPU>;
+    uint16_t _memReadW (uint16_t addr) { return readW (addr); }
+    uint8_t _memReadB (uint16_t addr) { return mem[addr]; }
+    void _memWriteW (uint16_t addr, uint16_t data) { writeW (addr, data); }
+    void _memWriteB (uint16_t addr, uint8_t data) { mem[addr] = data; }
+    uint8_t *_memHostPtr (uint16_t addr) { return hostPtr (addr); }
+    int _interruptLevel (int mask) { return -1; }
+};
+
+template class TMS9900Core<InlineCPU>;
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load (void)
+{
+    memset (mem, 0, sizeof mem);
+
+    for (unsigned i = 0; i < sizeof vectors / sizeof vectors[0]; i++)
+        writeW (i * 2, vectors[i]);
+
+    for (unsigned i = 0; i < sizeof loop / sizeof loop[0]; i++)
+        writeW (0x0100 + i * 2, loop[i]);
+
+    for (int i = 0; i < 0x200; i++)
+        mem[0xA000 + i] = i * 37;
+}
+
+/*  Run a CPU for a number of instructions in a mode and report the rate */
+template <class CPU>
+static void bench (const char *name, int mode, long count)
+{
+    static const char *modes[] = { "interpret", "block", "jit" };
+    CPU *cpu = new CPU;
+    long executed = 0;
+
+    load ();
+    cpu->setExecMode (mode);
+
+    if (cpu->getExecMode () != mode)
+    {
+        printf ("%-8s %-10s not available\n", name, modes[mode]);
+        return;
+    }
+
+    cpu->boot ();
+
+    double start = now ();
+
+    if (mode == EXEC_INTERPRET)
+    {
+        for (executed = 0; executed < count; executed++)
+            cpu->execute (cpu->fetch ());
+    }
+    else
+    {
+        while (executed < count)
+            executed += cpu->executeBlock ();
+    }
+
+    double secs = now () - start;
+
+    printf ("%-8s %-10s %8.1f M instructions/s\n", name, modes[mode],
+            executed / secs / 1e6);
+}
+
+int main (int argc, char *argv[])
+{
+    long count = argc > 1 ? atol (argv[1]) : 50000000;
+
+    bench<VirtualCPU> ("virtual", EXEC_INTERPRET, count);
+    bench<InlineCPU> ("inline", EXEC_INTERPRET, count);
+    bench<VirtualCPU> ("virtual", EXEC_BLOCK, count);
+    bench<InlineCPU> ("inline", EXEC_BLOCK, count);
+    bench<VirtualCPU> ("virtual", EXEC_JIT, count);
+    bench<InlineCPU> ("inline", EXEC_JIT, count);
+
+    return 0;
+}
@@ -0,0 +1,1569 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ *  Implements the TMS9900 CPU core.  Included by the translation unit that
+ *  instantiates the core for each bus class.
+ */
+
+#ifndef __CPUCORE_H
+#define __CPUCORE_H
+
+#include "cpu.h"
+
+#define REGR(r) _readW(_wp+((r)<<1))
+#define REGW(r,d) _writeW(_wp+((r)<<1),d)
+
+/*  All writes by the CPU go through these so that writes to instructions in
+ *  cached blocks can be detected.  The code word map only exists in block
+ *  mode.  Writes to the workspace go directly to its host memory if it has
+ *  any.
+ */
+template <class Bus>
+void TMS9900Core<Bus>::_writeW (uint16_t addr, uint16_t data)
+{
+    if (_codeWord && _codeWord[addr >> 1])
+        _blockCodeWrite (addr);
+
+    uint16_t offset = addr - _wp;
+
+    if (_wsHost && offset < 32)
+    {
+        offset &= ~1;
+        _wsHost[offset] = data >> 8;
+        _wsHost[offset + 1] = data & 0xFF;
+        _cycles += _wsWait;
+        return;
+    }
+
+    _cycles += _bus()->_memWait (addr);
+    _bus()->_memWriteW (addr, data);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_writeB (uint16_t addr, uint8_t data)
+{
+    if (_codeWord && _codeWord[addr >> 1])
+        _blockCodeWrite (addr);
+
+    uint16_t offset = addr - _wp;
+
+    if (_wsHost && offset < 32)
+    {
+        _wsHost[offset] = data;
+        _cycles += _wsWait;
+        return;
+    }
+
+    _cycles += _bus()->_memWait (addr);
+    _bus()->_memWriteB (addr, data);
+}
+
+/*  Operand reads by instructions.  Reads from the workspace come directly
+ *  from its host memory if it has any.
+ */
+template <class Bus>
+uint16_t TMS9900Core<Bus>::_readW (uint16_t addr)
+{
+    uint16_t offset = addr - _wp;
+
+    if (_wsHost && offset < 32)
+    {
+        offset &= ~1;
+        _cycles += _wsWait;
+        return (_wsHost[offset] << 8) | _wsHost[offset + 1];
+    }
+
+    _cycles += _bus()->_memWait (addr);
+    return _bus()->_memReadW (addr);
+}
+
+template <class Bus>
+uint8_t TMS9900Core<Bus>::_readB (uint16_t addr)
+{
+    uint16_t offset = addr - _wp;
+
+    if (_wsHost && offset < 32)
+    {
+        _cycles += _wsWait;
+        return _wsHost[offset];
+    }
+
+    _cycles += _bus()->_memWait (addr);
+    return _bus()->_memReadB (addr);
+}
+
+/*  Find the host memory holding the workspace.  Registers are only accessed
+ *  directly if the whole workspace is plain RAM with no side effects.  Since
+ *  the host memory is the RAM itself, accesses through any other address
+ *  that maps to it stay coherent.  Must be repeated whenever WP changes or
+ *  the memory at WP is remapped.
+ */
+template <class Bus>
+void TMS9900Core<Bus>::_workspaceMap (void)
+{
+    uint8_t *ws = NULL;
+
+    if ((_wp & 1) == 0)
+    {
+        ws = _bus()->_memHostPtr (_wp);
+
+        if (ws && _bus()->_memHostPtr (_wp + 30) != ws + 30)
+            ws = NULL;
+    }
+
+    _wsHost = ws;
+    _wsWait = _bus()->_memWait (_wp);
+}
+
+/*  Called by the bus when a different bank or device is mapped into memory.
+ *  The rest of a block being executed was decoded from the old memory so it
+ *  is stopped after the current instruction.
+ */
+template <class Bus>
+void TMS9900Core<Bus>::memoryRemapped (void)
+{
+    _workspaceMap ();
+
+    if (_blockCurrent)
+        _blockAbort = true;
+}
+
+template <class Bus>
+uint16_t TMS9900Core<Bus>::fetch (void)
+{
+    uint16_t ret;
+
+    _cycles += _bus()->_memWait (_pc);
+    ret = _bus()->_memReadW(_pc);
+    _pc += 2;
+    return ret;
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_blwp (uint16_t addr)
+{
+    uint16_t owp = _wp;
+    uint16_t opc = _pc;
+
+    _cycles += 2 * _bus()->_memWait (addr);
+    _wp = _bus()->_memReadW (addr);
+    _pc = _bus()->_memReadW (addr+2);
+    _workspaceMap ();
+
+    _bus()->_debug ("blwp @%x, wp=%x, pc=%x\n", addr, _wp, _pc);
+
+    REGW (13, owp);
+    REGW (14, opc);
+    REGW (15, getST ());
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_rtwp (void)
+{
+    _pc = REGR (14);
+    _st = REGR (15);
+    _stPending = 0;
+    _wp = REGR (13);
+    _workspaceMap ();
+}
+
+/*  Jump if all bits in the set mask are set and all bits in the clear mask are
+ *  clear */
+template <class Bus>
+void TMS9900Core<Bus>::_jumpAnd (uint16_t setMask, uint16_t clrMask, uint16_t offset)
+{
+    if (_stPending & (setMask | clrMask))
+        _statusEval ();
+
+    if ((_st & setMask) == setMask &&
+        (~_st & clrMask) == clrMask)
+    {
+        if (_bus()->_unasmActive ())
+            _bus()->_unasmPostExec("st=%04X[s=%04X&&c=%04X], jump", getST (), setMask,
+            clrMask);
+        _pc += offset << 1;
+        _cycles += 2;
+    }
+}
+
+/*  Jump if any bits in the set mask are set or any bits in the clear mask are
+ *  clear */
+template <class Bus>
+void TMS9900Core<Bus>::_jumpOr (uint16_t setMask, uint16_t clrMask, uint16_t offset)
+{
+    if (_stPending & (setMask | clrMask))
+        _statusEval ();
+
+    if ((_st & setMask) != 0 ||
+        (~_st & clrMask) != 0)
+    {
+        if (_bus()->_unasmActive ())
+            _bus()->_unasmPostExec("st=%04X[s=%04X||c=%04X], jump", getST (), setMask,
+            clrMask);
+        _pc += offset << 1;
+        _cycles += 2;
+    }
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_compareWord (uint16_t sData, uint16_t dData)
+{
+    _cmpKind = LAZY_WORD;
+    _cmpS = sData;
+    _cmpD = dData;
+    _stPending |= FLAG_LAZY_CMP;
+
+    if (_bus()->_unasmActive ())
+        _bus()->_unasmPostExec (_outputStatus());
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_compareByte (uint16_t sData, uint16_t dData)
+{
+    _cmpKind = LAZY_BYTE;
+    _cmpS = sData;
+    _cmpD = dData;
+    _stPending |= FLAG_LAZY_CMP;
+
+    if (_bus()->_unasmActive ())
+        _bus()->_unasmPostExec (_outputStatus());
+}
+
+template <class Bus>
+uint16_t TMS9900Core<Bus>::_operandDecode (uint16_t mode, uint16_t reg, bool isByte)
+{
+    uint16_t addr;
+
+    switch (mode)
+    {
+    case AMODE_NORMAL:
+        addr = _wp+(reg<<1);
+        break;
+
+    case AMODE_INDIR:
+        addr = REGR(reg);
+        break;
+
+    case AMODE_SYM:
+        addr = (uint16_t) (fetch() + (reg == 0 ? 0 : REGR(reg)));
+        break;
+
+    case AMODE_INDIRINC:
+        addr = REGR(reg);
+        REGW (reg, REGR(reg) + (isByte ? 1 : 2));
+        break;
+
+    default:
+        _bus()->_halt ("Bad operand mode");
+    }
+
+    return addr;
+}
+
+template <class Bus>
+uint16_t TMS9900Core<Bus>::_operandFetch (uint16_t mode, uint16_t reg, uint16_t addr, bool isByte, bool doFetch)
+{
+    uint16_t data = 0;
+
+    if (isByte)
+    {
+        if (mode)
+            _bus()->_unasmPostExec("B:[%04X]", addr);
+        else
+            _bus()->_unasmPostExec("R%d", reg);
+
+        if (doFetch)
+        {
+            data = _readB (addr);
+            _bus()->_unasmPostExec("=%02X", data);
+        }
+    }
+    else
+    {
+        if (mode)
+            _bus()->_unasmPostExec("W:[%04X]", addr);
+        else
+            _bus()->_unasmPostExec("R%d", reg);
+
+        if (doFetch)
+        {
+            data = _readW (addr);
+            _bus()->_unasmPostExec("=%04X", data);
+        }
+    }
+
+    return data;
+}
+
+/*
+ *  I M M E D I A T E S
+ */
+
+template <class Bus>
+void TMS9900Core<Bus>::_opLI (const DecodedOp *op)
+{
+    uint16_t immed;
+
+    immed = fetch();
+    REGW(op->sReg,immed);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opAI (const DecodedOp *op)
+{
+    uint16_t immed;
+    uint32_t data;
+    int reg = op->sReg;
+
+    data = REGR(reg);
+    immed = fetch();
+    _statusArith (LAZY_ADD, immed, data);
+    _bus()->_unasmPostExec ("R%d=%04X+%04X=%04X", reg, data, immed, data+immed);
+    data += immed;
+    data &= 0xffff;
+    REGW(reg,data);
+    _compareWord (data, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opANDI (const DecodedOp *op)
+{
+    uint16_t immed;
+    uint32_t data;
+    int reg = op->sReg;
+
+    data = REGR(reg);
+    immed = fetch();
+    _bus()->_unasmPostExec ("R%d=%04X&%04X=%04X", reg, data, immed, data&immed);
+    data &= immed;
+    REGW(reg,data);
+    _compareWord (data, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opORI (const DecodedOp *op)
+{
+    uint16_t immed;
+    uint32_t data;
+    int reg = op->sReg;
+
+    data = REGR(reg);
+    immed = fetch();
+    _bus()->_unasmPostExec ("R%d=%04X|%04X=%04X", reg, data, immed, data|immed);
+    data |= immed;
+    REGW(reg,data);
+    _compareWord (data, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opCI (const DecodedOp *op)
+{
+    uint32_t data;
+    int reg = op->sReg;
+
+    data = REGR(reg);
+    _bus()->_unasmPostExec ("R%d=%04X", reg, data);
+    _compareWord (data, fetch());
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSTST (const DecodedOp *op)
+{
+    uint16_t immed;
+
+    immed = getST ();
+    _bus()->_unasmPostExec ("R%d=%04X", op->sReg, immed);
+    REGW(op->sReg,immed);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSTWP (const DecodedOp *op)
+{
+    uint16_t immed;
+
+    immed = _wp;
+    _bus()->_unasmPostExec ("R%d=%04X", op->sReg, immed);
+    REGW(op->sReg,immed);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opLWPI (const DecodedOp *op)
+{
+    _wp = fetch();
+    _workspaceMap ();
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opLIMI (const DecodedOp *op)
+{
+    /*  The immediate isn't masked so can also set status bits */
+    _st = (getST () & ~FLAG_MSK) | fetch();
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opRTWP (const DecodedOp *op)
+{
+    _rtwp ();
+    _bus()->_unasmPostExec ("pc=%04X", _pc);
+}
+
+/*
+ *  S I N G L E   O P E R A N D
+ */
+
+/*  Decode the operand of a single operand instruction and return its address */
+template <class Bus>
+uint16_t TMS9900Core<Bus>::_singleOperand (const DecodedOp *op)
+{
+    uint16_t addr;
+
+    addr = _operandDecode (op->sMode, op->sReg, false);
+
+    if (op->sMode)
+        _bus()->_unasmPostExec("W:[%04X]", addr);
+    else
+        _bus()->_unasmPostExec("R%d", op->sReg);
+
+    return addr;
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opBLWP (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+
+    _bus()->_unasmPostExec ("=%04X", addr);
+    _blwp (addr);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opB (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+
+    _bus()->_unasmPostExec ("=%04X", addr);
+    _pc = addr;
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opX (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _bus()->_debug ("X : recurse\n");
+    execute (param);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opCLR (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+
+    _writeW (addr, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opNEG (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _statusCarry (param == 0x8000);
+    _statusOverflow (param & 0x8000);
+    param = -param;
+    _bus()->_unasmPostExec ("=%04X", param);
+    _writeW (addr, param);
+    _compareWord (param, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opINV (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = ~_readW (addr);
+    _bus()->_unasmPostExec ("=%04X", param);
+    _writeW (addr, param);
+    _compareWord (param, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opINC (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _statusArith (LAZY_ADD, 1, param);
+    param += 1;
+    _bus()->_unasmPostExec ("=%04X", param);
+    _writeW (addr, param);
+    _compareWord (param, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opINCT (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _statusArith (LAZY_ADD, 2, param);
+    param += 2;
+    if(addr&1)
+    {
+        param&=0xFF;
+        _bus()->_unasmPostExec ("=%02X", param);
+        _writeB (addr,param);
+        _compareByte (param, 0);
+    }
+    else
+    {
+        _bus()->_unasmPostExec ("=%04X", param);
+        _writeW (addr, param);
+        _compareWord (param, 0);
+    }
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opDEC (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _statusArith (LAZY_SUB, 1, param);
+    param -= 1;
+    _bus()->_unasmPostExec ("=%04X", param);
+    _writeW (addr, param);
+    _compareWord (param, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opDECT (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _statusArith (LAZY_SUB, 2, param);
+    param -= 2;
+    /*  Not sure if this is strictly necessary, but in the ROM code there
+     *  are several places where DECT is called on an odd address.  Does
+     *  this mean only the low byte should be decremented?  Assume so for
+     *  now.
+     */
+    if(addr&1)
+    {
+        param&=0xFF;
+        _bus()->_unasmPostExec ("=%02X", param);
+        _writeB (addr,param);
+        _compareByte (param, 0);
+    }
+    else
+    {
+        _bus()->_unasmPostExec ("=%04X", param);
+        _writeW (addr, param);
+        _compareWord (param, 0);
+    }
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opBL (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+
+    REGW(11, _pc);
+    _pc = addr;
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSWPB (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    param = SWAP(param);
+    _bus()->_unasmPostExec ("=%04X", param);
+    _writeW (addr, param);
+    _compareWord (param, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSETO (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+
+    _writeW (addr, 0xFFFF);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opABS (const DecodedOp *op)
+{
+    uint16_t addr = _singleOperand (op);
+    uint16_t param;
+
+    param = _readW (addr);
+    _statusCarry (param == 0x8000);
+    _statusOverflow (param & 0x8000);
+    /*  AGT for ABS is unusual in that it takes the sign of the source into
+     *  account and doesn't just do a comparison of the result to zero */
+    _statusArithmeticGreater ((int8_t) param > 0);
+
+    if ((int16_t) param < 0)
+    {
+        param = -param;
+        _cycles += 2;
+    }
+
+    _bus()->_unasmPostExec ("=%04X", param);
+    _writeW (addr, param);
+    _statusEqual (param == 0);
+    _statusLogicalGreater (param != 0);
+
+    if (_bus()->_unasmActive ())
+        _bus()->_unasmPostExec (_outputStatus());
+}
+
+/*
+ *  S H I F T
+ */
+
+/*  Shift count is in the instruction or if zero, in R0.  If that is also zero
+ *  then shift by 16.  The cycles for a count in the instruction are in the
+ *  decode table.
+ */
+template <class Bus>
+uint16_t TMS9900Core<Bus>::_shiftCount (const DecodedOp *op)
+{
+    uint16_t count = op->dReg;
+
+    if (count != 0)
+        return count;
+
+    count = REGR(0) & 0x000F;
+
+    if (count == 0)
+        count = 16;
+
+    _cycles += 8 + 2 * count;
+    return count;
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSRA (const DecodedOp *op)
+{
+    uint16_t count = _shiftCount (op);
+    uint32_t u32;
+    int32_t i32;
+
+    i32 = REGR (op->sReg) << 16;
+    _bus()->_unasmPostExec ("%04X=>", i32>>16);
+    i32 >>= count;
+
+    /* Set carry flag if last bit shifted is set */
+    _statusCarry ((i32 & 0x8000) != 0);
+
+    u32 = (i32 >> 16) & 0xffff;
+    REGW (op->sReg, u32);
+    _compareWord (u32, 0);
+    _bus()->_unasmPostExec ("%04X", u32);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSRC (const DecodedOp *op)
+{
+    uint16_t count = _shiftCount (op);
+    uint32_t u32;
+
+    u32 = REGR (op->sReg);
+    _bus()->_unasmPostExec ("%04X=>", u32);
+    u32 |= (u32 << 16);
+    _bus()->_debug ("u32=%x\n", u32);
+    u32 >>= count;
+    _bus()->_debug ("u32=%x\n", u32);
+
+    /* Set carry flag if last bit shifted is set */
+    _statusCarry ((u32 & 0x8000) != 0);
+
+    u32 &= 0xffff;
+    REGW (op->sReg, u32);
+    _compareWord (u32, 0);
+    _bus()->_unasmPostExec ("%04X", u32);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSRL (const DecodedOp *op)
+{
+    uint16_t count = _shiftCount (op);
+    uint32_t u32;
+
+    u32 = REGR (op->sReg) << 16;
+    _bus()->_unasmPostExec ("%04X=>", u32>>16);
+    u32 >>= count;
+
+    /* Set carry flag if last bit shifted is set */
+    _statusCarry ((u32 & 0x8000) != 0);
+
+    u32 >>= 16;
+    REGW (op->sReg, u32);
+    _compareWord (u32, 0);
+    _bus()->_unasmPostExec ("%04X", u32);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSLA (const DecodedOp *op)
+{
+    uint16_t count = _shiftCount (op);
+    uint32_t u32;
+    int32_t i32;
+
+    i32 = REGR (op->sReg);
+    _bus()->_unasmPostExec ("%04X=>", i32);
+    u32 = i32 << count;
+
+    /* Set carry flag if last bit shifted is set */
+    _statusCarry ((u32 & 0x10000) != 0);
+
+    /* Set if MSB changes */
+    _statusOverflow ((u32 & 0x8000) != (i32 & 0x8000));
+
+    u32 &= 0xFFFF;
+    REGW (op->sReg, u32);
+    _compareWord (u32, 0);
+    _bus()->_unasmPostExec ("%04X", u32);
+}
+
+/*
+ *  J U M P
+ */
+template <class Bus>
+void TMS9900Core<Bus>::_opJMP (const DecodedOp *op) { _jumpAnd (0,        0,                  op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJLT (const DecodedOp *op) { _jumpAnd (0,        FLAG_AGT | FLAG_EQ, op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJGT (const DecodedOp *op) { _jumpAnd (FLAG_AGT, FLAG_EQ,            op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJL (const DecodedOp *op)  { _jumpAnd (0,        FLAG_LGT | FLAG_EQ, op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJLE (const DecodedOp *op) { _jumpOr  (FLAG_EQ,  FLAG_LGT,           op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJH (const DecodedOp *op)  { _jumpAnd (FLAG_LGT, FLAG_EQ,            op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJHE (const DecodedOp *op) { _jumpOr  (FLAG_LGT | FLAG_EQ, 0,        op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJNC (const DecodedOp *op) { _jumpAnd (0,        FLAG_C,             op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJOC (const DecodedOp *op) { _jumpAnd (FLAG_C,   0,                  op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJNO (const DecodedOp *op) { _jumpAnd (0,        FLAG_OV,            op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJNE (const DecodedOp *op) { _jumpAnd (0,        FLAG_EQ,            op->offset); }
+template <class Bus>
+void TMS9900Core<Bus>::_opJEQ (const DecodedOp *op) { _jumpAnd (FLAG_EQ,  0,                  op->offset); }
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSBZ (const DecodedOp *op) { _bus()->_cruBitOutput (REGR(12), op->offset, 0); }
+template <class Bus>
+void TMS9900Core<Bus>::_opSBO (const DecodedOp *op) { _bus()->_cruBitOutput (REGR(12), op->offset, 1); }
+
+template <class Bus>
+void TMS9900Core<Bus>::_opTB (const DecodedOp *op)
+{
+    // _st &= ~FLAG_EQ;
+    // _st |= (cruBitGet (REGR(12), offset) ? FLAG_EQ : 0);
+    _statusEqual (_bus()->_cruBitGet (REGR(12), op->offset));
+}
+
+/*
+ *  D U A L   O P E R A N D   ( R E G I S T E R   D E S T )
+ */
+
+template <class Bus>
+void TMS9900Core<Bus>::_opCOC (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+    uint16_t dData;
+
+    dData = REGR (op->dReg);
+    _bus()->_unasmPostExec ("&(R%d=%04X)=%04X", op->dReg, dData, sData & dData);
+    _compareWord (sData & dData, sData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opCZC (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+    uint16_t dData;
+
+    dData = REGR (op->dReg);
+    _bus()->_unasmPostExec ("&~(R%d=%04X)=%04X", op->dReg, dData, sData & ~dData);
+    _compareWord (sData & ~dData, sData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opXOR (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+    uint16_t dData;
+
+    dData = REGR (op->dReg);
+    _bus()->_unasmPostExec ("&~(R%d=%04X)=%04X", op->dReg, dData, sData ^ dData);
+    dData ^= sData;
+    REGW (op->dReg, dData);
+    _compareWord (dData, 0);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opXOP (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+
+    _bus()->_xop (op->dReg, sData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opMPY (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+    uint16_t dData;
+    uint32_t u32;
+
+    dData = REGR (op->dReg);
+    _bus()->_unasmPostExec ("*(R%d=%04X)=%04X", op->dReg, dData, sData * dData);
+    u32 = dData * sData;
+    REGW(op->dReg, u32 >> 16);
+    REGW(op->dReg+1, u32 & 0xFFFF);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opDIV (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+    uint16_t dData;
+    uint32_t u32;
+
+    dData = REGR (op->dReg);
+    if (sData <= dData)
+    {
+        _bus()->_unasmPostExec ("<(%04X<%04X)->OVF", sData, dData);
+        _statusOverflow (true);
+    }
+    else
+    {
+        /*  Division takes 92 to 124 cycles depending on the operands */
+        _statusOverflow (false);
+        _cycles += 92;
+        u32 = REGR(op->dReg) << 16 | REGR(op->dReg+1);
+        _bus()->_unasmPostExec (",(%X/%X)=>%04X,%04X", u32, sData, u32 / sData, u32 % sData);
+        REGW(op->dReg, u32 / sData);
+        REGW(op->dReg+1, u32 % sData);
+    }
+}
+
+/*
+ *  C R U
+ */
+template <class Bus>
+void TMS9900Core<Bus>::_opLDCR (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData = _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+
+    if (op->dReg <= 8)
+    {
+        sData = _readB (sAddr);
+        _statusParity (sData);
+    }
+
+    _bus()->_cruMultiBitSet (REGR(12), sData, op->dReg);
+    _bus()->_debug ("LDCR R12=%x s=%x d=%x\n", REGR(12), sData, op->dReg);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSTCR (const DecodedOp *op)
+{
+    uint16_t sAddr = _operandDecode (op->sMode, op->sReg, false);
+    uint16_t sData;
+
+    _operandFetch (op->sMode, op->sReg, sAddr, false, true);
+
+    if (op->dReg <= 8)
+    {
+        sData = _bus()->_cruMultiBitGet (REGR(12), op->dReg);
+        _writeB (sAddr, sData);
+        _statusParity (sData);
+    }
+    else
+        _writeW (sAddr, _bus()->_cruMultiBitGet (REGR(12), op->dReg));
+}
+
+/*
+ *  D U A L   O P E R A N D
+ */
+
+/*  Decode and fetch both operands of a dual operand instruction.  The
+ *  destination contents are only fetched if required by the instruction.
+ */
+template <class Bus>
+void TMS9900Core<Bus>::_dual2Operands (const DecodedOp *op, bool isByte, bool fetchDest,
+                              uint16_t *sData, uint16_t *dAddr, uint16_t *dData)
+{
+    uint16_t sAddr;
+
+    sAddr = _operandDecode (op->sMode, op->sReg, isByte);
+    *sData = _operandFetch (op->sMode, op->sReg, sAddr, isByte, true);
+
+    _bus()->_unasmPostExec (",");
+    *dAddr = _operandDecode (op->dMode, op->dReg, isByte);
+    *dData = _operandFetch (op->dMode, op->dReg, *dAddr, isByte, fetchDest);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSZC (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, false, true, &sData, &dAddr, &dData);
+    dData &= ~sData;
+    _bus()->_unasmPostExec (":&~:%04X", dData);
+    _compareWord (dData, 0);
+    _writeW (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSZCB (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, true, true, &sData, &dAddr, &dData);
+    dData &= ~sData;
+    _bus()->_unasmPostExec (":&~:%02X", dData);
+    _compareByte (dData, 0);
+    _statusParity (dData);
+    _writeB (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opS (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+    uint32_t u32;
+
+    _dual2Operands (op, false, true, &sData, &dAddr, &dData);
+    u32 = (uint32_t) dData - sData;
+
+    /* 15-AUG-23 carry flag meaning is inverted for S, SB, DEC, DECT.  Where
+     * is this documented ??????
+     */
+    _statusArith (LAZY_SUB, sData, dData);
+    dData = u32 & 0xFFFF;
+    _bus()->_unasmPostExec (":-:%04X", dData);
+    _compareWord (dData, 0);
+    _writeW (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSB (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+    uint32_t u32;
+
+    _dual2Operands (op, true, true, &sData, &dAddr, &dData);
+    u32 = (uint32_t) dData - sData;
+
+    /* 15-AUG-23 carry flag meaning is inverted for S, SB, DEC, DECT.  Where
+     * is this documented ??????
+     */
+    _statusArith (LAZY_SUBB, sData, dData);
+    dData = u32 & 0xFF;
+    _bus()->_unasmPostExec (":-:%02X", dData);
+    _compareByte (dData, 0);
+    _statusParity (dData);
+    _writeB (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opC (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, false, true, &sData, &dAddr, &dData);
+    _compareWord (sData, dData);
+    _bus()->_unasmPostExec (":==:");
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opCB (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, true, true, &sData, &dAddr, &dData);
+    _compareByte (sData, dData);
+    _statusParity (sData);
+    _bus()->_unasmPostExec (":==:");
+}
+
+/*  Don't fetch the contents of the destination if op is a MOV */
+template <class Bus>
+void TMS9900Core<Bus>::_opMOV (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, false, false, &sData, &dAddr, &dData);
+    dData = sData;
+    _compareWord (dData, 0);
+    _writeW (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opMOVB (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, true, false, &sData, &dAddr, &dData);
+    dData = sData;
+    _statusParity (sData);
+    _compareByte (dData, 0);
+    _writeB (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSOC (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, false, true, &sData, &dAddr, &dData);
+    dData |= sData;
+    _bus()->_unasmPostExec (":|:%04X", dData);
+    _compareWord (dData, 0);
+    _writeW (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opSOCB (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+
+    _dual2Operands (op, true, true, &sData, &dAddr, &dData);
+    dData |= sData;
+    _bus()->_unasmPostExec (":|:%02X", dData);
+    _compareByte (dData, 0);
+    _statusParity (dData);
+    _writeB (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opA (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+    uint32_t u32;
+
+    _dual2Operands (op, false, true, &sData, &dAddr, &dData);
+    u32 = (uint32_t) dData + sData;
+    _statusArith (LAZY_ADD, sData, dData);
+    dData = u32 & 0xFFFF;
+    _bus()->_unasmPostExec (":+:%04X", dData);
+    _compareWord (dData, 0);
+    _writeW (dAddr, dData);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::_opAB (const DecodedOp *op)
+{
+    uint16_t sData, dAddr, dData;
+    uint32_t u32;
+
+    _dual2Operands (op, true, true, &sData, &dAddr, &dData);
+    u32 = (uint32_t) dData + sData;
+    _statusArith (LAZY_ADDB, sData, dData);
+    dData = u32 & 0xFF;
+    _bus()->_unasmPostExec (":+:%02X", dData);
+    _compareByte (dData, 0);
+    _statusParity (dData);
+    _writeB (dAddr, dData);
+}
+
+/*  Handler for any instruction word that doesn't decode to a valid opcode */
+template <class Bus>
+void TMS9900Core<Bus>::_opIllegal (const DecodedOp *op)
+{
+    switch (op->type)
+    {
+    case OPTYPE_IMMED:  _bus()->_halt ("Bad immediate opcode"); break;
+    case OPTYPE_SINGLE: _bus()->_halt ("Bad single opcode"); break;
+    case OPTYPE_SHIFT:  _bus()->_halt ("Bad shift opcode"); break;
+    case OPTYPE_JUMP:   _bus()->_halt ("Bad jump opcode"); break;
+    case OPTYPE_DUAL1:  _bus()->_halt ("Bad dual1 opcode"); break;
+    case OPTYPE_DUAL2:  _bus()->_halt ("Bad dual2 opcode"); break;
+    default:            _bus()->_halt ("Bad optype"); break;
+    }
+}
+
+/*  Execute an instruction.  The handlers are bound at compile time so are
+ *  candidates for inlining here. */
+template <class Bus>
+void TMS9900Core<Bus>::_dispatch (const DecodedOp *op)
+{
+    switch (op->handler)
+    {
+    case H_LI:   _opLI (op); break;
+    case H_AI:   _opAI (op); break;
+    case H_ANDI: _opANDI (op); break;
+    case H_ORI:  _opORI (op); break;
+    case H_CI:   _opCI (op); break;
+    case H_STWP: _opSTWP (op); break;
+    case H_STST: _opSTST (op); break;
+    case H_LWPI: _opLWPI (op); break;
+    case H_LIMI: _opLIMI (op); break;
+    case H_RTWP: _opRTWP (op); break;
+
+    case H_BLWP: _opBLWP (op); break;
+    case H_B:    _opB (op); break;
+    case H_X:    _opX (op); break;
+    case H_CLR:  _opCLR (op); break;
+    case H_NEG:  _opNEG (op); break;
+    case H_INV:  _opINV (op); break;
+    case H_INC:  _opINC (op); break;
+    case H_INCT: _opINCT (op); break;
+    case H_DEC:  _opDEC (op); break;
+    case H_DECT: _opDECT (op); break;
+    case H_BL:   _opBL (op); break;
+    case H_SWPB: _opSWPB (op); break;
+    case H_SETO: _opSETO (op); break;
+    case H_ABS:  _opABS (op); break;
+
+    case H_SRA:  _opSRA (op); break;
+    case H_SRL:  _opSRL (op); break;
+    case H_SLA:  _opSLA (op); break;
+    case H_SRC:  _opSRC (op); break;
+
+    case H_JMP:  _opJMP (op); break;
+    case H_JLT:  _opJLT (op); break;
+    case H_JLE:  _opJLE (op); break;
+    case H_JEQ:  _opJEQ (op); break;
+    case H_JHE:  _opJHE (op); break;
+    case H_JGT:  _opJGT (op); break;
+    case H_JNE:  _opJNE (op); break;
+    case H_JNC:  _opJNC (op); break;
+    case H_JOC:  _opJOC (op); break;
+    case H_JNO:  _opJNO (op); break;
+    case H_JL:   _opJL (op); break;
+    case H_JH:   _opJH (op); break;
+    case H_SBO:  _opSBO (op); break;
+    case H_SBZ:  _opSBZ (op); break;
+    case H_TB:   _opTB (op); break;
+
+    case H_COC:  _opCOC (op); break;
+    case H_CZC:  _opCZC (op); break;
+    case H_XOR:  _opXOR (op); break;
+    case H_XOP:  _opXOP (op); break;
+    case H_LDCR: _opLDCR (op); break;
+    case H_STCR: _opSTCR (op); break;
+    case H_MPY:  _opMPY (op); break;
+    case H_DIV:  _opDIV (op); break;
+
+    case H_SZC:  _opSZC (op); break;
+    case H_SZCB: _opSZCB (op); break;
+    case H_S:    _opS (op); break;
+    case H_SB:   _opSB (op); break;
+    case H_C:    _opC (op); break;
+    case H_CB:   _opCB (op); break;
+    case H_A:    _opA (op); break;
+    case H_AB:   _opAB (op); break;
+    case H_MOV:  _opMOV (op); break;
+    case H_MOVB: _opMOVB (op); break;
+    case H_SOC:  _opSOC (op); break;
+    case H_SOCB: _opSOCB (op); break;
+
+    default:     _opIllegal (op); break;
+    }
+}
+
+/*  Check for a pending interrupt and service it if not masked */
+template <class Bus>
+void TMS9900Core<Bus>::_interruptCheck (void)
+{
+    int mask = _st & FLAG_MSK;
+    int level = _bus()->_interruptLevel (mask);
+
+    if (level >= 0)
+    {
+        _bus()->_debug ("interrupt level=%d st=%x\n", level, getST ());
+        _cycles += CYCLES_INTERRUPT;
+        _blwp (4 * level);
+
+        /*  The ISR mask is automatically lowered to 1 less than the interrupt
+         *  being serviced to ensure only higher priority interrupts can
+         *  interrupt this ISR.
+         */
+        if (level > 0)
+            mask = level - 1;
+        else
+            mask = 0;
+
+        _st = (_st & ~FLAG_MSK) | mask;
+    }
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::execute (uint16_t data)
+{
+    const DecodedOp *op = &_decodeTable[data];
+
+    _bus()->_unasmPreExec (_pc, data, op->type, op->opcode);
+
+    _cycles += op->cycles;
+    _dispatch (op);
+
+    _bus()->_unasmEndLine ();
+    _interruptCheck ();
+}
+
+/*  Decode a block of instructions starting at pc.  A block stops at any
+ *  instruction that changes flow, after BLOCK_MAX_OPS instructions or at a
+ *  4K boundary since that is the smallest unit of memory that can be paged.
+ */
+template <class Bus>
+Block *TMS9900Core<Bus>::_blockBuild (uint16_t pc, intptr_t bank)
+{
+    Block *b = _blockFree;
+
+    if (!b)
+    {
+        flushBlocks ();
+        b = _blockFree;
+    }
+
+    _blockFree = b->next;
+
+    b->start = pc;
+    b->bank = bank;
+    b->count = 0;
+    b->cycles = 0;
+    b->hits = 0;
+    b->native = NULL;
+
+    while (b->count < BLOCK_MAX_OPS)
+    {
+        uint16_t data = _bus()->_memReadW (pc);
+        const DecodedOp *op = &_decodeTable[data];
+        BlockOp *o = &b->ops[b->count++];
+
+        o->op = op;
+        o->data = data;
+        o->pc = pc + 2;
+        o->cycles = op->cycles + _bus()->_memWait (pc);
+        b->cycles += o->cycles;
+
+        /*  Count immediate words as code too since compiled blocks have
+         *  them built in */
+        for (int j = _instructionWords (op); j > 0; j--, pc += 2)
+            _codeWord[pc >> 1]++;
+
+        if (_blockEnds (op) || ((pc ^ b->start) & 0xF000) != 0)
+            break;
+    }
+
+    b->end = pc;
+    _blockMap[b->start >> 1] = b;
+
+    return b;
+}
+
+/*  Execute a cached block starting at the current PC, building it first if
+ *  needed.  Returns the number of instructions executed.  Interrupts are
+ *  checked at the end of each block rather than after each instruction.  In
+ *  JIT mode a block is compiled once it has been executed JIT_THRESHOLD
+ *  times and the native code is used whenever the workspace is plain RAM.
+ */
+template <class Bus>
+int TMS9900Core<Bus>::executeBlock (void)
+{
+    if (_jitFull)
+        flushBlocks ();
+
+    if (_execMode == EXEC_INTERPRET || (_pc & 1))
+    {
+        execute (fetch ());
+        return 1;
+    }
+
+    intptr_t bank = _bus()->_memBank (_pc);
+
+    if (bank == -1)
+    {
+        execute (fetch ());
+        return 1;
+    }
+
+    Block *b = _blockMap[_pc >> 1];
+
+    if (b && b->bank != bank)
+    {
+        _blockInvalidate (b);
+        b = NULL;
+    }
+
+    if (!b)
+        b = _blockBuild (_pc, bank);
+
+    _blockCurrent = b;
+    _blockAbort = false;
+
+    if (_execMode == EXEC_JIT && b->hits++ == JIT_THRESHOLD)
+        _jitCompile (b);
+
+    if (b->native)
+    {
+        uint8_t *ws = _jitWorkspace ();
+
+        if (ws)
+        {
+            uint64_t ret = b->native (this, ws, getST ());
+            int count = ret >> 32;
+
+            _pc = ret & 0xFFFF;
+            _st = (ret >> 16) & 0xFFFF;
+            _blockCurrent = NULL;
+            _jitCycles (b, count);
+            _interruptCheck ();
+
+            return count;
+        }
+    }
+
+    int count = b->count;
+    int i;
+
+    for (i = 0; i < count; )
+    {
+        const BlockOp *o = &b->ops[i++];
+
+        _pc = o->pc;
+        _cycles += o->cycles;
+        _bus()->_unasmPreExec (_pc, o->data, o->op->type, o->op->opcode);
+        _dispatch (o->op);
+        _bus()->_unasmEndLine ();
+
+        if (_blockAbort)
+            break;
+    }
+
+    _blockCurrent = NULL;
+    _interruptCheck ();
+
+    return i;
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::showStatus(void)
+{
+    uint16_t i;
+
+    _bus()->_debug ("CPU\n");
+    _bus()->_debug ("===\n");
+    _bus()->_debug ("st=%04X\nwp=%04X\npc=%04X\n", getST (), _wp, _pc);
+
+    for (i = 0; i < 16; i++)
+    {
+        _bus()->_debug ("R%02d: %04X ", i, REGR(i));
+        if ((i + 1) % 4 == 0)
+            _bus()->_debug ("\n");
+    }
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::showStWord(void)
+{
+    _bus()->_debug ("st=%04X %s int=%d)\n",
+             getST (), _outputStatus(), _st & 15);
+}
+
+template <class Bus>
+void TMS9900Core<Bus>::boot (void)
+{
+    _st = 0;
+    _stPending = 0;
+    _blwp (0x0);
+}
+
+/*
+ *  J I T   S U P P O R T
+ */
+
+template <class Bus>
+bool TMS9900Core<Bus>::_jitCompile (Block *b)
+{
+    static const JitHelpers helpers =
+    {
+        _jitCallOp, _jitReadW, _jitReadB, _jitWriteW, _jitWriteB
+    };
+
+    /*  Reading immediates while compiling isn't part of execution */
+    uint64_t cycles = _cycles;
+    bool ret = _jitGenerate (b, &helpers);
+
+    _cycles = cycles;
+
+    if (!ret)
+        return false;
+
+    /*  Immediates are built into the code so their wait states are known
+     *  now */
+    b->jitWait = 0;
+    b->jitRegs = 0;
+
+    for (int i = 0; i < b->count; i++)
+    {
+        BlockOp *o = &b->ops[i];
+
+        o->jitWait = 0;
+
+        if (o->jitRegs < 0)
+            continue;
+
+        for (int j = _instructionWords (o->op) - 1; j > 0; j--)
+            o->jitWait += _bus()->_memWait (o->pc + ((j - 1) << 1));
+
+        b->jitWait += o->jitWait;
+        b->jitRegs += o->jitRegs;
+    }
+
+    return true;
+}
+
+/*  Add the cycles for the instructions compiled code executed, with the wait
+ *  states for the workspace and immediate accesses it made directly.  The
+ *  workspace can't change within a block so its wait states are the same
+ *  as on exit.  Jumps always end a block and are always compiled, so the
+ *  extra cycles for a taken jump are added here if the jump's condition
+ *  holds for the status it left.
+ */
+template <class Bus>
+void TMS9900Core<Bus>::_jitCycles (Block *b, int count)
+{
+    if (count == b->count)
+        _cycles += b->cycles + b->jitWait + b->jitRegs * _wsWait;
+    else
+    {
+        for (int i = 0; i < count; i++)
+        {
+            const BlockOp *o = &b->ops[i];
+
+            _cycles += o->cycles;
+
+            if (o->jitRegs >= 0)
+                _cycles += o->jitWait + o->jitRegs * _wsWait;
+        }
+    }
+
+    const BlockOp *o = &b->ops[count - 1];
+
+    if (o->op->type == OPTYPE_JUMP && o->jitRegs >= 0 && _jitJumpTaken (o->op, _st))
+        _cycles += 2;
+}
+
+/*  Return the host address of the workspace if compiled code can access it
+ *  directly.  It must be plain RAM and must not hold any cached code since
+ *  compiled code writes registers without checking for that.
+ */
+template <class Bus>
+uint8_t *TMS9900Core<Bus>::_jitWorkspace (void)
+{
+    if (!_wsHost)
+        return NULL;
+
+    for (int i = 0; i < 16; i++)
+        if (_codeWord[(uint16_t) (_wp + (i << 1)) >> 1])
+            return NULL;
+
+    return _wsHost;
+}
+
+/*  Helpers called from compiled code */
+template <class Bus>
+uint64_t TMS9900Core<Bus>::_jitCallOp (TMS9900Base *base, const BlockOp *o, uint32_t st)
+{
+    TMS9900Core *cpu = static_cast<TMS9900Core*>(base);
+
+    cpu->_pc = o->pc;
+    cpu->_st = st;
+    cpu->_bus()->_unasmPreExec (cpu->_pc, o->data, o->op->type, o->op->opcode);
+    cpu->_dispatch (o->op);
+    cpu->_bus()->_unasmEndLine ();
+
+    return cpu->getST () | (cpu->_pc << 16) | ((uint64_t) cpu->_blockAbort << 32);
+}
+
+template <class Bus>
+uint32_t TMS9900Core<Bus>::_jitReadW (TMS9900Base *base, uint32_t addr)
+{
+    TMS9900Core *cpu = static_cast<TMS9900Core*>(base);
+
+    cpu->_cycles += cpu->_bus()->_memWait (addr);
+    return cpu->_bus()->_memReadW (addr);
+}
+
+template <class Bus>
+uint32_t TMS9900Core<Bus>::_jitReadB (TMS9900Base *base, uint32_t addr)
+{
+    TMS9900Core *cpu = static_cast<TMS9900Core*>(base);
+
+    cpu->_cycles += cpu->_bus()->_memWait (addr);
+    return cpu->_bus()->_memReadB (addr);
+}
+
+template <class Bus>
+uint32_t TMS9900Core<Bus>::_jitWriteW (TMS9900Base *base, uint32_t addr, uint32_t data)
+{
+    TMS9900Core *cpu = static_cast<TMS9900Core*>(base);
+
+    cpu->_writeW (addr, data);
+    return cpu->_blockAbort;
+}
+
+template <class Bus>
+uint32_t TMS9900Core<Bus>::_jitWriteB (TMS9900Base *base, uint32_t addr, uint32_t data)
+{
+    TMS9900Core *cpu = static_cast<TMS9900Core*>(base);
+
+    cpu->_writeB (addr, data);
+    return cpu->_blockAbort;
+}
+
+#undef REGR
+#undef REGW
+
+#endif
@@ -0,0 +1,989 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ *  Compiles cached TMS9900 blocks to x86-64 native code
+ *
+ *  Register to register operations, immediates, shifts and jumps are
+ *  generated inline, working directly on the workspace in host memory.
+ *  Operands in memory other than the workspace are read and written through
+ *  the normal memory hooks.  Anything else calls the interpreter handler for
+ *  the instruction so the interpreter remains the reference for behaviour.
+ *
+ *  The status register is held in a host register.  Each instruction only
+ *  computes the status bits that are read before being overwritten later in
+ *  the block.  All status bits are assumed to be read after the block and
+ *  before any instruction handled by the interpreter.
+ */
+
+#include "types.h"
+#include "cpu.h"
+#include "x86emit.h"
+
+#if defined(__x86_64__)
+
+/*  Register use in generated code.  RBX holds the CPU, R12 the host address
+ *  of the workspace and R13 the status register.  R14 and R15 hold the
+ *  source operand and destination address across calls.  The rest are
+ *  scratch.
+ */
+#define R_CPU   X86_RBX
+#define R_WS    X86_R12
+#define R_ST    X86_R13
+#define R_SRC   X86_R14
+#define R_ADDR  X86_R15
+
+#define FLAGS_CMP       (FLAG_LGT | FLAG_AGT | FLAG_EQ)
+#define FLAGS_ARITH     (FLAGS_CMP | FLAG_C | FLAG_OV)
+#define FLAGS_ALL       (FLAGS_ARITH | FLAG_OP)
+
+#define MAX_FLAGS       6
+#define MAX_EXITS       (BLOCK_MAX_OPS * 2 + 2)
+
+/*  Jump conditions as passed to _jumpAnd () and _jumpOr () by the handlers */
+static const struct
+{
+    uint16_t opcode;
+    bool any;
+    uint16_t setMask;
+    uint16_t clrMask;
+}
+jumpCond[] =
+{
+    { OP_JMP, false, 0,                   0 },
+    { OP_JLT, false, 0,                   FLAG_AGT | FLAG_EQ },
+    { OP_JGT, false, FLAG_AGT,            FLAG_EQ },
+    { OP_JL,  false, 0,                   FLAG_LGT | FLAG_EQ },
+    { OP_JLE, true,  FLAG_EQ,             FLAG_LGT },
+    { OP_JH,  false, FLAG_LGT,            FLAG_EQ },
+    { OP_JHE, true,  FLAG_LGT | FLAG_EQ,  0 },
+    { OP_JNC, false, 0,                   FLAG_C },
+    { OP_JOC, false, FLAG_C,              0 },
+    { OP_JNO, false, 0,                   FLAG_OV },
+    { OP_JNE, false, 0,                   FLAG_EQ },
+    { OP_JEQ, false, FLAG_EQ,             0 }
+};
+
+/*  Host byte registers used to hold status bits until they are merged */
+static const int flagReg[MAX_FLAGS] =
+{
+    X86_R8, X86_R9, X86_R10, X86_R11, X86_RSI, X86_RDI
+};
+
+typedef struct
+{
+    X86Emitter *e;
+    const void *readW;
+    const void *readB;
+    const void *writeW;
+    const void *writeB;
+    const void *callOp;
+
+    /*  Status bits the current instruction must compute */
+    uint16_t needed;
+    int flagCount;
+    int flagBit[MAX_FLAGS];
+
+    /*  Instruction count and address of the next instruction for exits */
+    int count;
+    uint16_t next;
+
+    int exits[MAX_EXITS];
+    int exitCount;
+}
+JitContext;
+
+/*  Return the status bits an instruction sets or -1 if it is not generated
+ *  inline.  For jumps, the bits tested are returned in uses.
+ */
+static int jitFlags (const DecodedOp *op, uint16_t *uses)
+{
+    *uses = 0;
+
+    switch (op->opcode)
+    {
+    case OP_LI:     return 0;
+    case OP_AI:     return FLAGS_ARITH;
+    case OP_ANDI:
+    case OP_ORI:
+    case OP_CI:     return FLAGS_CMP;
+
+    case OP_CLR:
+    case OP_SETO:   return 0;
+    case OP_INV:
+    case OP_SWPB:   return FLAGS_CMP;
+    case OP_NEG:
+    case OP_INC:
+    case OP_DEC:    return FLAGS_ARITH;
+
+    /*  INCT and DECT on odd addresses act on bytes, so leave them to the
+     *  interpreter unless they are on a register */
+    case OP_INCT:
+    case OP_DECT:   return op->sMode == AMODE_NORMAL ? FLAGS_ARITH : -1;
+
+    case OP_SRA:
+    case OP_SRL:
+    case OP_SRC:    return op->dReg ? FLAGS_CMP | FLAG_C : -1;
+    case OP_SLA:    return op->dReg ? FLAGS_ARITH : -1;
+
+    case OP_COC:
+    case OP_CZC:
+    case OP_XOR:    return FLAGS_CMP;
+
+    case OP_MOV:
+    case OP_C:
+    case OP_SOC:
+    case OP_SZC:    return FLAGS_CMP;
+    case OP_MOVB:
+    case OP_CB:
+    case OP_SOCB:
+    case OP_SZCB:   return FLAGS_CMP | FLAG_OP;
+    case OP_A:
+    case OP_S:      return FLAGS_ARITH;
+    case OP_AB:
+    case OP_SB:     return FLAGS_ALL;
+    }
+
+    for (unsigned i = 0; i < sizeof jumpCond / sizeof jumpCond[0]; i++)
+    {
+        if (jumpCond[i].opcode == op->opcode && op->type == OPTYPE_JUMP)
+        {
+            *uses = jumpCond[i].setMask | jumpCond[i].clrMask;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*  Return true if an inline instruction writes to memory other than the
+ *  workspace */
+static bool jitWritesMemory (const DecodedOp *op)
+{
+    switch (op->type)
+    {
+    case OPTYPE_SINGLE:
+        return op->sMode != AMODE_NORMAL;
+
+    case OPTYPE_DUAL2:
+        return op->dMode != AMODE_NORMAL &&
+               op->opcode != OP_C && op->opcode != OP_CB;
+    }
+
+    return false;
+}
+
+/*  Return the number of workspace accesses made by the interpreter to
+ *  decode an operand */
+static int jitDecodeRegs (int mode, int reg)
+{
+    switch (mode)
+    {
+    case AMODE_INDIR:    return 1;
+    case AMODE_SYM:      return reg ? 1 : 0;
+    case AMODE_INDIRINC: return 3;
+    }
+
+    return 0;
+}
+
+/*  Return the number of workspace accesses the interpreter makes for an
+ *  inline instruction other than through the memory helpers.  Compiled code
+ *  makes them directly so their wait states are added when the block exits.
+ */
+static int jitRegs (const DecodedOp *op)
+{
+    bool sReg = op->sMode == AMODE_NORMAL;
+    bool dReg = op->dMode == AMODE_NORMAL;
+    bool fetchDest = op->opcode != OP_MOV && op->opcode != OP_MOVB;
+    bool store = op->opcode != OP_C && op->opcode != OP_CB;
+
+    switch (op->type)
+    {
+    case OPTYPE_IMMED:
+        return (op->opcode == OP_LI || op->opcode == OP_CI) ? 1 : 2;
+
+    case OPTYPE_SINGLE:
+        if (!sReg)
+            return jitDecodeRegs (op->sMode, op->sReg);
+
+        return (op->opcode == OP_CLR || op->opcode == OP_SETO) ? 1 : 2;
+
+    case OPTYPE_SHIFT:
+        return 2;
+
+    case OPTYPE_DUAL1:
+        return jitDecodeRegs (op->sMode, op->sReg) + sReg + 1 +
+               (op->opcode == OP_XOR);
+
+    case OPTYPE_DUAL2:
+        return jitDecodeRegs (op->sMode, op->sReg) + sReg +
+               jitDecodeRegs (op->dMode, op->dReg) +
+               (dReg ? fetchDest + store : 0);
+    }
+
+    return 0;
+}
+
+static int bitNumber (uint16_t bit)
+{
+    int n = 0;
+
+    while ((1 << n) != bit)
+        n++;
+
+    return n;
+}
+
+/*  Capture a status bit from the host condition codes if it is needed */
+static void flagSet (JitContext *c, int cc, uint16_t flag)
+{
+    if (!(c->needed & flag))
+        return;
+
+    c->e->setcc (cc, flagReg[c->flagCount]);
+    c->flagBit[c->flagCount++] = bitNumber (flag);
+}
+
+/*  Set the status bits for a comparison of a word or byte against zero, as
+ *  done by _compareWord (x, 0) and _compareByte (x, 0) */
+static void flagsZero (JitContext *c, int size, int reg)
+{
+    c->e->test (size, reg, reg);
+    flagSet (c, X86_CC_E, FLAG_EQ);
+    flagSet (c, X86_CC_NE, FLAG_LGT);
+    flagSet (c, X86_CC_G, FLAG_AGT);
+}
+
+/*  Merge the captured status bits into the status register.  Needed bits
+ *  that weren't captured are cleared. */
+static void flagsCommit (JitContext *c)
+{
+    X86Emitter *e = c->e;
+
+    if (c->needed)
+        e->aluImm (X86_AND, 4, R_ST, ~c->needed);
+
+    for (int i = 0; i < c->flagCount; i++)
+    {
+        e->movzx (1, flagReg[i], flagReg[i]);
+        e->shift (X86_SHL, 4, flagReg[i], c->flagBit[i]);
+        e->alu (X86_OR, 4, R_ST, flagReg[i]);
+    }
+
+    c->flagCount = 0;
+}
+
+/*  Leave the block with the PC in ECX and the instruction count in EDX */
+static void jitExitDynamic (JitContext *c)
+{
+    c->e->movImm (X86_RDX, c->count);
+    c->exits[c->exitCount++] = c->e->jmp ();
+}
+
+static void jitExit (JitContext *c, uint16_t pc)
+{
+    c->e->movImm (X86_RCX, pc);
+    jitExitDynamic (c);
+}
+
+/*  Registers are big endian in the workspace */
+static void regLoad (JitContext *c, int dst, int reg, bool isByte)
+{
+    if (isByte)
+        c->e->load (1, dst, R_WS, reg << 1);
+    else
+    {
+        c->e->load (2, dst, R_WS, reg << 1);
+        c->e->shift (X86_ROL, 2, dst, 8);
+    }
+}
+
+static void regStore (JitContext *c, int reg, int src, bool isByte)
+{
+    if (isByte)
+        c->e->store (1, R_WS, reg << 1, src);
+    else
+    {
+        c->e->mov (4, X86_RCX, src);
+        c->e->shift (X86_ROL, 2, X86_RCX, 8);
+        c->e->store (2, R_WS, reg << 1, X86_RCX);
+    }
+}
+
+/*  Compute the address of an operand in EAX as done by _operandDecode () for
+ *  all modes other than register */
+static void jitAddress (JitContext *c, int mode, int reg, bool isByte, uint16_t imm)
+{
+    X86Emitter *e = c->e;
+
+    switch (mode)
+    {
+    case AMODE_INDIR:
+        regLoad (c, X86_RAX, reg, false);
+        break;
+
+    case AMODE_SYM:
+        if (reg == 0)
+            e->movImm (X86_RAX, imm);
+        else
+        {
+            regLoad (c, X86_RAX, reg, false);
+            e->aluImm (X86_ADD, 4, X86_RAX, imm);
+            e->movzx (2, X86_RAX, X86_RAX);
+        }
+        break;
+
+    case AMODE_INDIRINC:
+        regLoad (c, X86_RAX, reg, false);
+        e->mov (4, X86_RDX, X86_RAX);
+        e->aluImm (X86_ADD, 4, X86_RDX, isByte ? 1 : 2);
+        regStore (c, reg, X86_RDX, false);
+        break;
+    }
+}
+
+static void jitRead (JitContext *c, int addrReg, bool isByte)
+{
+    X86Emitter *e = c->e;
+
+    e->mov (8, X86_RDI, R_CPU);
+    e->mov (4, X86_RSI, addrReg);
+    e->call (isByte ? c->readB : c->readW);
+}
+
+/*  Write EAX to memory at the address in R15 and leave the block if the
+ *  write modified the block being executed */
+static void jitWrite (JitContext *c, bool isByte)
+{
+    X86Emitter *e = c->e;
+
+    e->mov (8, X86_RDI, R_CPU);
+    e->mov (4, X86_RSI, R_ADDR);
+    e->mov (4, X86_RDX, X86_RAX);
+    e->call (isByte ? c->writeB : c->writeW);
+    e->test (4, X86_RAX, X86_RAX);
+
+    int cont = e->jcc (X86_CC_E);
+    jitExit (c, c->next);
+    e->bind (cont);
+}
+
+/*  Fetch an operand into dst */
+static void jitOperand (JitContext *c, int mode, int reg, bool isByte, uint16_t imm, int dst)
+{
+    if (mode == AMODE_NORMAL)
+        regLoad (c, dst, reg, isByte);
+    else
+    {
+        jitAddress (c, mode, reg, isByte, imm);
+        jitRead (c, X86_RAX, isByte);
+
+        if (dst != X86_RAX)
+            c->e->mov (4, dst, X86_RAX);
+    }
+}
+
+static void jitImmediate (JitContext *c, const DecodedOp *op, uint16_t imm)
+{
+    X86Emitter *e = c->e;
+    int reg = op->sReg;
+
+    if (op->opcode == OP_LI)
+    {
+        e->movImm (X86_RAX, SWAP (imm));
+        e->store (2, R_WS, reg << 1, X86_RAX);
+        return;
+    }
+
+    regLoad (c, X86_RAX, reg, false);
+
+    switch (op->opcode)
+    {
+    case OP_AI:
+        e->aluImm (X86_ADD, 2, X86_RAX, imm);
+        flagSet (c, X86_CC_B, FLAG_C);
+        flagSet (c, X86_CC_O, FLAG_OV);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    case OP_ANDI:
+        e->aluImm (X86_AND, 4, X86_RAX, imm);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    case OP_ORI:
+        e->aluImm (X86_OR, 4, X86_RAX, imm);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    case OP_CI:
+        e->aluImm (X86_CMP, 2, X86_RAX, imm);
+        flagSet (c, X86_CC_E, FLAG_EQ);
+        flagSet (c, X86_CC_A, FLAG_LGT);
+        flagSet (c, X86_CC_G, FLAG_AGT);
+        flagsCommit (c);
+        return;
+    }
+
+    flagsCommit (c);
+    regStore (c, reg, X86_RAX, false);
+}
+
+static void jitSingle (JitContext *c, const DecodedOp *op, uint16_t imm)
+{
+    X86Emitter *e = c->e;
+    bool reg = op->sMode == AMODE_NORMAL;
+
+    if (!reg)
+    {
+        jitAddress (c, op->sMode, op->sReg, false, imm);
+        e->mov (4, R_ADDR, X86_RAX);
+    }
+
+    switch (op->opcode)
+    {
+    case OP_CLR:
+        e->movImm (X86_RAX, 0);
+        break;
+
+    case OP_SETO:
+        e->movImm (X86_RAX, 0xFFFF);
+        break;
+
+    default:
+        if (reg)
+            regLoad (c, X86_RAX, op->sReg, false);
+        else
+            jitRead (c, R_ADDR, false);
+    }
+
+    switch (op->opcode)
+    {
+    case OP_INV:
+        e->notReg (4, X86_RAX);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    case OP_NEG:
+        e->aluImm (X86_CMP, 2, X86_RAX, 0x8000);
+        flagSet (c, X86_CC_E, FLAG_C);
+        e->testImm (2, X86_RAX, 0x8000);
+        flagSet (c, X86_CC_NE, FLAG_OV);
+        e->neg (2, X86_RAX);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    case OP_INC:
+    case OP_INCT:
+        e->aluImm (X86_ADD, 2, X86_RAX, op->opcode == OP_INC ? 1 : 2);
+        flagSet (c, X86_CC_B, FLAG_C);
+        flagSet (c, X86_CC_O, FLAG_OV);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    /*  Carry is set when there is no borrow */
+    case OP_DEC:
+    case OP_DECT:
+        e->aluImm (X86_SUB, 2, X86_RAX, op->opcode == OP_DEC ? 1 : 2);
+        flagSet (c, X86_CC_AE, FLAG_C);
+        flagSet (c, X86_CC_O, FLAG_OV);
+        flagsZero (c, 2, X86_RAX);
+        break;
+
+    case OP_SWPB:
+        e->shift (X86_ROL, 2, X86_RAX, 8);
+        flagsZero (c, 2, X86_RAX);
+        break;
+    }
+
+    flagsCommit (c);
+
+    if (reg)
+        regStore (c, op->sReg, X86_RAX, false);
+    else
+        jitWrite (c, false);
+}
+
+static void jitShift (JitContext *c, const DecodedOp *op)
+{
+    X86Emitter *e = c->e;
+    int count = op->dReg;
+
+    regLoad (c, X86_RAX, op->sReg, false);
+
+    switch (op->opcode)
+    {
+    case OP_SRA:
+        e->shift (X86_SAR, 2, X86_RAX, count);
+        flagSet (c, X86_CC_B, FLAG_C);
+        break;
+
+    case OP_SRL:
+        e->shift (X86_SHR, 2, X86_RAX, count);
+        flagSet (c, X86_CC_B, FLAG_C);
+        break;
+
+    case OP_SRC:
+        e->shift (X86_ROR, 2, X86_RAX, count);
+        flagSet (c, X86_CC_B, FLAG_C);
+        break;
+
+    /*  Overflow is set if the MSB has changed */
+    case OP_SLA:
+        e->mov (4, X86_RCX, X86_RAX);
+        e->shift (X86_SHL, 2, X86_RAX, count);
+        flagSet (c, X86_CC_B, FLAG_C);
+        e->alu (X86_XOR, 4, X86_RCX, X86_RAX);
+        e->testImm (4, X86_RCX, 0x8000);
+        flagSet (c, X86_CC_NE, FLAG_OV);
+        break;
+    }
+
+    flagsZero (c, 2, X86_RAX);
+    flagsCommit (c);
+    regStore (c, op->sReg, X86_RAX, false);
+}
+
+/*  COC, CZC and XOR.  The destination is always a register. */
+static void jitDual1 (JitContext *c, const DecodedOp *op, uint16_t imm)
+{
+    X86Emitter *e = c->e;
+
+    jitOperand (c, op->sMode, op->sReg, false, imm, R_SRC);
+    regLoad (c, X86_RAX, op->dReg, false);
+
+    switch (op->opcode)
+    {
+    case OP_COC:
+    case OP_CZC:
+        if (op->opcode == OP_CZC)
+            e->notReg (4, X86_RAX);
+
+        e->alu (X86_AND, 4, X86_RAX, R_SRC);
+        e->alu (X86_CMP, 2, X86_RAX, R_SRC);
+        flagSet (c, X86_CC_E, FLAG_EQ);
+        flagSet (c, X86_CC_A, FLAG_LGT);
+        flagSet (c, X86_CC_G, FLAG_AGT);
+        flagsCommit (c);
+        break;
+
+    case OP_XOR:
+        e->alu (X86_XOR, 4, X86_RAX, R_SRC);
+        flagsZero (c, 2, X86_RAX);
+        flagsCommit (c);
+        regStore (c, op->dReg, X86_RAX, false);
+        break;
+    }
+}
+
+static void jitDual2 (JitContext *c, const DecodedOp *op, uint16_t sImm, uint16_t dImm)
+{
+    X86Emitter *e = c->e;
+    bool isByte = (op->opcode & 0x1000) != 0;
+    int size = isByte ? 1 : 2;
+    bool fetchDest = op->opcode != OP_MOV && op->opcode != OP_MOVB;
+    bool store = op->opcode != OP_C && op->opcode != OP_CB;
+
+    jitOperand (c, op->sMode, op->sReg, isByte, sImm, R_SRC);
+
+    if (op->dMode == AMODE_NORMAL)
+    {
+        if (fetchDest)
+            regLoad (c, X86_RAX, op->dReg, isByte);
+    }
+    else
+    {
+        jitAddress (c, op->dMode, op->dReg, isByte, dImm);
+        e->mov (4, R_ADDR, X86_RAX);
+
+        if (fetchDest)
+            jitRead (c, R_ADDR, isByte);
+    }
+
+    switch (op->opcode)
+    {
+    case OP_MOV:
+    case OP_MOVB:
+        e->mov (4, X86_RAX, R_SRC);
+        break;
+
+    case OP_A:
+    case OP_AB:
+        e->alu (X86_ADD, size, X86_RAX, R_SRC);
+        flagSet (c, X86_CC_B, FLAG_C);
+
+        /*  Byte overflow is tested on bit 15 so can never be set */
+        if (!isByte)
+            flagSet (c, X86_CC_O, FLAG_OV);
+        break;
+
+    /*  Carry is set when there is no borrow */
+    case OP_S:
+    case OP_SB:
+        e->alu (X86_SUB, size, X86_RAX, R_SRC);
+        flagSet (c, X86_CC_AE, FLAG_C);
+
+        if (!isByte)
+            flagSet (c, X86_CC_O, FLAG_OV);
+        break;
+
+    case OP_C:
+    case OP_CB:
+        e->alu (X86_CMP, size, R_SRC, X86_RAX);
+        flagSet (c, X86_CC_E, FLAG_EQ);
+        flagSet (c, X86_CC_A, FLAG_LGT);
+        flagSet (c, X86_CC_G, FLAG_AGT);
+        break;
+
+    case OP_SOC:
+    case OP_SOCB:
+        e->alu (X86_OR, 4, X86_RAX, R_SRC);
+        break;
+
+    case OP_SZC:
+    case OP_SZCB:
+        e->mov (4, X86_RCX, R_SRC);
+        e->notReg (4, X86_RCX);
+        e->alu (X86_AND, 4, X86_RAX, X86_RCX);
+        break;
+    }
+
+    /*  Compares set the status from the source, everything else from the
+     *  result */
+    if (store)
+        flagsZero (c, size, X86_RAX);
+
+    if (isByte)
+    {
+        int reg = store ? X86_RAX : R_SRC;
+
+        c->e->test (1, reg, reg);
+        flagSet (c, X86_CC_NP, FLAG_OP);
+    }
+
+    flagsCommit (c);
+
+    if (!store)
+        return;
+
+    if (op->dMode == AMODE_NORMAL)
+        regStore (c, op->dReg, X86_RAX, isByte);
+    else
+        jitWrite (c, isByte);
+}
+
+/*  Jumps always end a block */
+static void jitJump (JitContext *c, const DecodedOp *op, uint16_t pc)
+{
+    X86Emitter *e = c->e;
+    uint16_t target = pc + (op->offset << 1);
+    int taken = -1;
+    int taken2 = -1;
+
+    for (unsigned i = 0; i < sizeof jumpCond / sizeof jumpCond[0]; i++)
+    {
+        uint16_t set = jumpCond[i].setMask;
+        uint16_t clr = jumpCond[i].clrMask;
+
+        if (jumpCond[i].opcode != op->opcode)
+            continue;
+
+        if (!jumpCond[i].any)
+        {
+            if ((set | clr) == 0)
+                break;
+
+            e->mov (4, X86_RAX, R_ST);
+            e->aluImm (X86_AND, 4, X86_RAX, set | clr);
+            e->aluImm (X86_CMP, 4, X86_RAX, set);
+            taken = e->jcc (X86_CC_E);
+        }
+        else
+        {
+            if (set)
+            {
+                e->testImm (4, R_ST, set);
+                taken = e->jcc (X86_CC_NE);
+            }
+
+            if (clr)
+            {
+                e->mov (4, X86_RAX, R_ST);
+                e->aluImm (X86_AND, 4, X86_RAX, clr);
+                e->aluImm (X86_CMP, 4, X86_RAX, clr);
+                taken2 = e->jcc (X86_CC_NE);
+            }
+        }
+
+        jitExit (c, pc);
+        break;
+    }
+
+    if (taken >= 0)
+        e->bind (taken);
+
+    if (taken2 >= 0)
+        e->bind (taken2);
+
+    jitExit (c, target);
+}
+
+/*  Call the interpreter to execute an instruction.  The helper returns the
+ *  status in bits 0-15, the PC in bits 16-31 and the abort flag in bit 32.
+ */
+static void jitCall (JitContext *c, const BlockOp *o, bool last)
+{
+    X86Emitter *e = c->e;
+
+    e->mov (8, X86_RDI, R_CPU);
+    e->movImm64 (X86_RSI, (uint64_t) o);
+    e->mov (4, X86_RDX, R_ST);
+    e->call (c->callOp);
+    e->movzx (2, R_ST, X86_RAX);
+    e->mov (4, X86_RCX, X86_RAX);
+    e->shift (X86_SHR, 4, X86_RCX, 16);
+
+    if (last)
+    {
+        jitExitDynamic (c);
+        return;
+    }
+
+    e->shift (X86_SHR, 8, X86_RAX, 32);
+    int cont = e->jcc (X86_CC_E);
+    jitExitDynamic (c);
+    e->bind (cont);
+}
+
+/*  Return true if a jump generated inline is taken with the status st */
+bool TMS9900Base::_jitJumpTaken (const DecodedOp *op, uint16_t st)
+{
+    for (unsigned i = 0; i < sizeof jumpCond / sizeof jumpCond[0]; i++)
+    {
+        uint16_t set = jumpCond[i].setMask;
+        uint16_t clr = jumpCond[i].clrMask;
+
+        if (jumpCond[i].opcode != op->opcode)
+            continue;
+
+        if (jumpCond[i].any)
+            return (st & set) != 0 || (~st & clr) != 0;
+
+        return (st & set) == set && (~st & clr) == clr;
+    }
+
+    return false;
+}
+
+bool TMS9900Base::_jitInit (void)
+{
+    _jit = new X86Emitter;
+
+    if (!_jit->init (JIT_CODE_SIZE))
+    {
+        delete _jit;
+        _jit = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*  Compile a block to native code calling the CPU core's helpers for memory
+ *  access and instructions that aren't generated inline.  Returns false if
+ *  the block can't be compiled, in which case it continues to be
+ *  interpreted.
+ */
+bool TMS9900Base::_jitGenerate (Block *b, const JitHelpers *h)
+{
+    X86Emitter *e = _jit;
+    uint16_t needed[BLOCK_MAX_OPS];
+    bool native[BLOCK_MAX_OPS];
+    uint16_t live = FLAGS_ALL;
+    JitContext c;
+
+    if (e->space () < JIT_BLOCK_SPACE)
+    {
+        _jitFull = true;
+        return false;
+    }
+
+    /*  Work back from the end of the block to find which status bits each
+     *  instruction needs to compute */
+    for (int i = b->count - 1; i >= 0; i--)
+    {
+        uint16_t uses;
+        int defs = jitFlags (b->ops[i].op, &uses);
+
+        native[i] = defs >= 0;
+
+        /*  A write to memory can discard the block if it modifies code, so
+         *  all status bits must be valid at that point */
+        if (jitWritesMemory (b->ops[i].op))
+            live = FLAGS_ALL;
+
+        if (native[i])
+        {
+            needed[i] = defs & live;
+            live = (live & ~defs) | uses;
+        }
+        else
+        {
+            needed[i] = 0;
+            live = FLAGS_ALL;
+        }
+    }
+
+    c.e = e;
+    c.readW = (const void*) h->readW;
+    c.readB = (const void*) h->readB;
+    c.writeW = (const void*) h->writeW;
+    c.writeB = (const void*) h->writeB;
+    c.callOp = (const void*) h->callOp;
+    c.flagCount = 0;
+    c.exitCount = 0;
+
+    uint8_t *code = e->current ();
+
+    e->push (X86_RBX);
+    e->push (X86_RBP);
+    e->push (X86_R12);
+    e->push (X86_R13);
+    e->push (X86_R14);
+    e->push (X86_R15);
+    e->aluImm (X86_SUB, 8, X86_RSP, 8);
+    e->mov (8, R_CPU, X86_RDI);
+    e->mov (8, R_WS, X86_RSI);
+    e->mov (4, R_ST, X86_RDX);
+
+    bool ended = false;
+
+    for (int i = 0; i < b->count; i++)
+    {
+        const BlockOp *o = &b->ops[i];
+        const DecodedOp *op = o->op;
+        bool last = (i == b->count - 1);
+        uint16_t imm1 = 0;
+        uint16_t imm2 = 0;
+
+        c.needed = needed[i];
+        c.count = i + 1;
+        c.next = o->pc + ((_instructionWords (op) - 1) << 1);
+        b->ops[i].jitRegs = native[i] ? jitRegs (op) : -1;
+
+        if (!native[i])
+        {
+            jitCall (&c, o, last);
+            ended = last;
+            continue;
+        }
+
+        /*  Immediates are part of the block and any write to them discards
+         *  it, so they can be built into the code */
+        if (c.next != o->pc)
+            imm1 = h->readW (this, o->pc);
+
+        if (c.next - o->pc == 4)
+            imm2 = h->readW (this, o->pc + 2);
+
+        switch (op->type)
+        {
+        case OPTYPE_IMMED:
+            jitImmediate (&c, op, imm1);
+            break;
+
+        case OPTYPE_SINGLE:
+            jitSingle (&c, op, imm1);
+            break;
+
+        case OPTYPE_SHIFT:
+            jitShift (&c, op);
+            break;
+
+        case OPTYPE_JUMP:
+            jitJump (&c, op, o->pc);
+            ended = true;
+            break;
+
+        case OPTYPE_DUAL1:
+            jitDual1 (&c, op, imm1);
+            break;
+
+        case OPTYPE_DUAL2:
+            jitDual2 (&c, op, imm1, op->sMode == AMODE_SYM ? imm2 : imm1);
+            break;
+        }
+    }
+
+    if (!ended)
+    {
+        c.count = b->count;
+        jitExit (&c, b->end);
+    }
+
+    /*  Common exit.  Pack the status, PC and count into the return value. */
+    for (int i = 0; i < c.exitCount; i++)
+        e->bind (c.exits[i]);
+
+    e->movzx (2, X86_RAX, R_ST);
+    e->shift (X86_SHL, 4, X86_RAX, 16);
+    e->alu (X86_OR, 4, X86_RAX, X86_RCX);
+    e->shift (X86_SHL, 8, X86_RDX, 32);
+    e->alu (X86_OR, 8, X86_RAX, X86_RDX);
+    e->aluImm (X86_ADD, 8, X86_RSP, 8);
+    e->pop (X86_R15);
+    e->pop (X86_R14);
+    e->pop (X86_R13);
+    e->pop (X86_R12);
+    e->pop (X86_RBP);
+    e->pop (X86_RBX);
+    e->ret ();
+
+    if (e->overflow ())
+    {
+        _jitFull = true;
+        return false;
+    }
+
+    b->native = (JitCode) code;
+    return true;
+}
+
+#else
+
+bool TMS9900Base::_jitJumpTaken (const DecodedOp *op, uint16_t st)
+{
+    return false;
+}
+
+bool TMS9900Base::_jitInit (void)
+{
+    return false;
+}
+
+bool TMS9900Base::_jitGenerate (Block *b, const JitHelpers *h)
+{
+    return false;
+}
+
+#endif
@@ -26,8 +26,7 @@
 #include "types.h"
 #include "trace.h"
 #include "cru.h"
-
-#define MAX_CRU_BIT 4096
+#include "machine.h"
 
 /*  Maintains state of the CRU bits and call callbacks as required when bits
  *  change.  Some bits have different behaviours when input vs output.  So we
@@ -42,34 +41,6 @@
  *  may not modify the state.  e.g. bit 3 set will not affect the input to bit
  *  3.
  */
-struct _cru
-{
-    uint8_t state;
-
-    /*  All pins power up as inputs.  Outputting a value to a pin changes it to
-     *  an output until the next reset
-     */
-    bool isOutput;
-    /*  Define an input callback to be called when an entity external to the CPU
-     *  modifies a CRU bit.  The callback should return true if the change is to
-     *  be accepted.
-     */
-    bool (*inputCallback) (int index, uint8_t state);
-
-    /*  Define a callback to be called when software tries to modify a bit.  The
-     *  callback should return true if it has absorbed the change and the bit
-     *  should not be modified or false is the change should be stored.
-     */
-    bool (*outputCallback) (int index, uint8_t state);
-
-    /*  Define a read callback that is called when software reads a bit.  The
-     *  current state of the bit is passed as a parameter. The read function may
-     *  accept this value and return it, or over-ride it with its own value and
-     *  return that instead.
-     */
-    uint8_t (*readCallback) (int index, uint8_t state);
-}
-cru[MAX_CRU_BIT];
 
 /*  Input bits are set by an external actuator, e.g. keyboard */
 void cruBitInput (uint16_t base, int8_t bitOffset, uint8_t state)
@@ -85,7 +56,7 @@ void cruBitInput (uint16_t base, int8_t bitOffset, uint8_t state)
         halt ("out of range CRU");
     }
 
-    struct _cru *c = &cru[index];
+    CruBit *c = &machine->cru.bit[index];
 
     c->state = state;
 
@@ -110,9 +81,13 @@ void cruBitOutput (uint16_t base, int8_t bitOffset, uint8_t state)
         halt ("out of range CRU");
     }
 
-    struct _cru *c = &cru[index];
+    CruBit *c = &machine->cru.bit[index];
+
+    if (!c->isOutput || c->output != state)
+        machine->cru.outputChanges++;
 
     c->isOutput = true;
+    c->output = state;
 
     /*  If there is no output callback or if the output callback returns false
      *  to indicate the value should be stored, then store the value
@@ -138,7 +113,7 @@ uint8_t cruBitGet (uint16_t base, int8_t bitOffset)
         halt ("out of range CRU");
     }
 
-    struct _cru *c = &cru[index];
+    CruBit *c = &machine->cru.bit[index];
 
     if (c->readCallback)
         c->state = c->readCallback (index, c->state);
@@ -196,16 +171,16 @@ uint16_t cruMultiBitGet (uint16_t base, int nBits)
 
 void cruInputCallbackSet (int index, bool (*callback) (int index, uint8_t state))
 {
-    cru[index].inputCallback = callback;
+    machine->cru.bit[index].inputCallback = callback;
 }
 
 void cruOutputCallbackSet (int index, bool (*callback) (int index, uint8_t state))
 {
-    cru[index].outputCallback = callback;
+    machine->cru.bit[index].outputCallback = callback;
 }
 
 void cruReadCallbackSet (int index, uint8_t (*callback) (int index, uint8_t state))
 {
-    cru[index].readCallback = callback;
+    machine->cru.bit[index].readCallback = callback;
 }
 
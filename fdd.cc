@@ -39,6 +39,7 @@
 #include "mem.h"
 #include "cpu.h"
 #include "fdd.h"
+#include "machine.h"
 #include "cru.h"
 #include "interrupt.h"
 #include "trace.h"
@@ -59,90 +60,66 @@
 #define DISK_STATUS_DRQ                 0x02
 #define DISK_STATUS_BUSY                0x01
 
-static uint8_t diskId[6];
-static uint8_t diskSector[DISK_BYTES_PER_SECTOR];
-static int sectorsPerTrack = 9;
-static int tracksPerSide = 40;
-
-/*  Declare one extra drive handler as drives are numbered 1 to 3 and 0 means no
- *  drive selected */
-static fddHandler driveHandler[DISK_DRIVE_COUNT+1];
-
-static struct
-{
-    uint8_t command;
-    uint8_t data;
-    uint8_t sector;
-    uint8_t track;
-    uint8_t unit;
-    uint8_t side;
-    uint8_t *buffer;
-    int bufferLen;
-    int bufferPos;
-    uint8_t status;
-    bool direction; // true = inward
-    bool ignoreIRQ;
-    bool motorStrobe;
-} fdd;
-
 static void seekDisk (void)
 {
-    int sector = fdd.sector;
+    FddState *fdd = &machine->fdd;
+    int sector = fdd->sector;
 
-    if (fdd.side)
+    if (fdd->side)
     {
         /*  Add the offset for the first side */
-        sector += sectorsPerTrack * tracksPerSide;
+        sector += fdd->sectorsPerTrack * fdd->tracksPerSide;
 
         /*  For double sided disks saved in a sector-dump (.dsk file), the track
          *  number is "inverted" so track 39 is the first track on the second
          *  side and track 0 is the last track.
          */
-        sector += (tracksPerSide - 1 - fdd.track) * sectorsPerTrack;
+        sector += (fdd->tracksPerSide - 1 - fdd->track) * fdd->sectorsPerTrack;
     }
     else
-        sector += fdd.track * sectorsPerTrack;
+        sector += fdd->track * fdd->sectorsPerTrack;
 
     mprintf (LVL_DISK, "DSK - access sector %d [T:%d Sec:%d Side:%d]\n", sector, 
-             fdd.track, fdd.sector, fdd.side);
+             fdd->track, fdd->sector, fdd->side);
 
-    if (driveHandler[fdd.unit].seek)
-        driveHandler[fdd.unit].seek (sector);
+    if (fdd->driveHandler[fdd->unit].seek)
+        fdd->driveHandler[fdd->unit].seek (sector);
 }
 
-uint16_t fddRead (uint16_t addr, uint16_t size)
+uint16_t fddRead (uint16_t addr, int size)
 {
+    FddState *fdd = &machine->fdd;
     uint8_t data;
 
     switch(addr)
     {
     case 0:
-        mprintf (LVL_DISK, "DSK - read status=%02X\n", fdd.status);
-        return ~fdd.status;
+        mprintf (LVL_DISK, "DSK - read status=%02X\n", fdd->status);
+        return ~fdd->status;
         break;
     case 2:
-        mprintf (LVL_DISK, "DSK - read track=%02X\n", fdd.track);
-        return ~fdd.track;
+        mprintf (LVL_DISK, "DSK - read track=%02X\n", fdd->track);
+        return ~fdd->track;
         break;
     case 4:
-        mprintf (LVL_DISK, "DSK - read sector=%02X\n", fdd.sector);
-        return ~fdd.sector;
+        mprintf (LVL_DISK, "DSK - read sector=%02X\n", fdd->sector);
+        return ~fdd->sector;
         break;
     case 6:
-        if (fdd.buffer)
-            data = fdd.buffer[fdd.bufferPos++];
+        if (fdd->buffer)
+            data = fdd->buffer[fdd->bufferPos++];
         else
-            data = fdd.data;
+            data = fdd->data;
 
-        // if (fdd.bufferPos<6)
+        // if (fdd->bufferPos<6)
             mprintf (LVL_DISK, "DSK - read data [%02X]=%02X\n",
-            fdd.bufferPos-1,data);
+            fdd->bufferPos-1,data);
 
-        if (fdd.bufferPos == fdd.bufferLen)
+        if (fdd->bufferPos == fdd->bufferLen)
         {
             mprintf (LVL_DISK, "DSK - read finished\n");
-            fdd.bufferPos = 0;
-            fdd.buffer = NULL;
+            fdd->bufferPos = 0;
+            fdd->buffer = NULL;
         }
         return ~data;
     default:
@@ -154,24 +131,28 @@ uint16_t fddRead (uint16_t addr, uint16_t size)
 
 static void trackUpdate (bool inward)
 {
+    FddState *fdd = &machine->fdd;
+
     if (inward)
     {
-        if (fdd.track < tracksPerSide)
-            fdd.track++;
+        if (fdd->track < fdd->tracksPerSide)
+            fdd->track++;
     }
     else
     {
-        if (fdd.track > 0)
-            fdd.track--;
+        if (fdd->track > 0)
+            fdd->track--;
     }
 }
 
-void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
+void fddWrite (uint16_t addr, uint16_t data, int size)
 {
+    FddState *fdd = &machine->fdd;
+
     /*  Data bus is inverted in FD1771 */
     data = (~data & 0xFF);
 
-    fdd.status = 0;
+    fdd->status = 0;
 
     switch(addr)
     {
@@ -192,9 +173,9 @@ void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
         {
         case 0x00:
             mprintf (LVL_DISK, "restore\n");
-            fdd.track = 0;
-            fdd.direction = true;
-            fdd.status |= DISK_STATUS_TRACK0;
+            fdd->track = 0;
+            fdd->direction = true;
+            fdd->status |= DISK_STATUS_TRACK0;
             break;
         case 0x10:
             /*  "[Seek] assumes that the Track Register contains the track
@@ -204,10 +185,10 @@ void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
              *  So we just copy the data register to the track register to
              *  complete the seek.
              */
-            fdd.track = fdd.data;
-            mprintf (LVL_DISK, "seek T=%d, S=%d\n", fdd.track, fdd.sector);
-            if (fdd.track == 0)
-                fdd.status |= DISK_STATUS_TRACK0;
+            fdd->track = fdd->data;
+            mprintf (LVL_DISK, "seek T=%d, S=%d\n", fdd->track, fdd->sector);
+            if (fdd->track == 0)
+                fdd->status |= DISK_STATUS_TRACK0;
             break;
         case 0x20:
         case 0x30:
@@ -216,7 +197,7 @@ void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
              *  track
              */
             mprintf (LVL_DISK, "step\n");
-            trackUpdate (fdd.direction);
+            trackUpdate (fdd->direction);
             break;
         case 0x40:
         case 0x50:
@@ -232,37 +213,37 @@ void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
             mprintf (LVL_DISK, "read single sector\n");
             seekDisk();
 
-            if (driveHandler[fdd.unit].read)
-                driveHandler[fdd.unit].read (diskSector);
+            if (fdd->driveHandler[fdd->unit].read)
+                fdd->driveHandler[fdd->unit].read (fdd->diskSector);
 
-            fdd.buffer = diskSector;
-            fdd.bufferPos = 0;
-            fdd.bufferLen = DISK_BYTES_PER_SECTOR;
+            fdd->buffer = fdd->diskSector;
+            fdd->bufferPos = 0;
+            fdd->bufferLen = DISK_BYTES_PER_SECTOR;
             break;
         case 0x90:
             printf ("TODO read multiple sector\n");
             break;
         case 0xA0:
             mprintf (LVL_DISK, "write single sector mark=%d\n", data&3);
-            fdd.buffer = diskSector;
-            fdd.bufferPos = 0;
-            fdd.bufferLen = DISK_BYTES_PER_SECTOR;
+            fdd->buffer = fdd->diskSector;
+            fdd->bufferPos = 0;
+            fdd->bufferLen = DISK_BYTES_PER_SECTOR;
             break;
         case 0xB0:
             printf ("TODO write multiple sector mark=%d\n", data&3);
             break;
         case 0xC0:
             mprintf (LVL_DISK, "read ID, tr=%d, side=%d, sec=%d\n",
-                     fdd.track, fdd.side, fdd.sector);
-            fdd.buffer = diskId;
-            diskId[0] = fdd.track;
-            diskId[1] = fdd.side;
-            diskId[2] = fdd.sector;
-            diskId[3] = 1; // statusRegister.sectorLengthCode;
-            diskId[4] = 0; // crc1
-            diskId[5] = 0; // crc2
-            fdd.bufferPos = 0;
-            fdd.bufferLen = 6;
+                     fdd->track, fdd->side, fdd->sector);
+            fdd->buffer = fdd->diskId;
+            fdd->diskId[0] = fdd->track;
+            fdd->diskId[1] = fdd->side;
+            fdd->diskId[2] = fdd->sector;
+            fdd->diskId[3] = 1; // statusRegister.sectorLengthCode;
+            fdd->diskId[4] = 0; // crc1
+            fdd->diskId[5] = 0; // crc2
+            fdd->bufferPos = 0;
+            fdd->bufferLen = 6;
             break;
         case 0xD0:
             /*   8 = issue interrupt now
@@ -278,47 +259,47 @@ void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
             break;
         case 0xF0:
             mprintf (LVL_DISK, "write track\n");
-            fdd.buffer = NULL; // We don't care about format data
-            fdd.status |= DISK_STATUS_DRQ;
+            fdd->buffer = NULL; // We don't care about format data
+            fdd->status |= DISK_STATUS_DRQ;
             break;
         }
         break;
     case 0xA:
         mprintf (LVL_DISK, "DSK - request track %02X\n", data);
-        fdd.track = data;
+        fdd->track = data;
         break;
     case 0xC:
         mprintf (LVL_DISK, "DSK - request sector %02X\n", data);
-        fdd.sector = data;
+        fdd->sector = data;
         break;
     case 0xE:
         /*  If we have a buffer then put the data into that otherwise put it in
          *  the data register.
          */
-        if (fdd.buffer)
+        if (fdd->buffer)
         {
             /*  For debug, we just output the first 4 bytes written */
-            // if (fdd.bufferPos<4)
+            // if (fdd->bufferPos<4)
                 mprintf (LVL_DISK, "DSK - write data [%02X]=%02X\n",
-                fdd.bufferPos,data);
+                fdd->bufferPos,data);
 
-            fdd.buffer[fdd.bufferPos++] = data;
+            fdd->buffer[fdd->bufferPos++] = data;
 
-            if (fdd.bufferPos == fdd.bufferLen)
+            if (fdd->bufferPos == fdd->bufferLen)
             {
                 mprintf (LVL_DISK, "DSK - write finished\n");
                 seekDisk();
 
-                if (driveHandler[fdd.unit].write)
-                    driveHandler[fdd.unit].write (diskSector);
+                if (fdd->driveHandler[fdd->unit].write)
+                    fdd->driveHandler[fdd->unit].write (fdd->diskSector);
 
-                fdd.bufferPos = 0;
-                fdd.buffer = NULL;
+                fdd->bufferPos = 0;
+                fdd->buffer = NULL;
             }
         }
         else
         {
-            fdd.data = data;
+            fdd->data = data;
         }
         break;
     default:
@@ -333,15 +314,19 @@ void fddWrite (uint16_t addr, uint16_t data, uint16_t size)
  */
 static bool fddSetStrobeMotor(int index, uint8_t state)
 {
+    FddState *fdd = &machine->fdd;
+
     mprintf(LVL_DISK, "DSK set strobe motor %d\n", state);
-    fdd.motorStrobe = state;
+    fdd->motorStrobe = state;
     return false;
 }
 
 static bool fddSetIgnoreIRQ(int index, uint8_t state)
 {
+    FddState *fdd = &machine->fdd;
+
     mprintf(LVL_DISK, "DSK set ignore IRQ %d\n", state);
-    fdd.ignoreIRQ = state;
+    fdd->ignoreIRQ = state;
     return false;
 }
 
@@ -356,6 +341,8 @@ static bool fddSetSignalHead(int index, uint8_t state)
  */
 static bool fddSetSelectDrive(int index, uint8_t state)
 {
+    FddState *fdd = &machine->fdd;
+
     index -= 0x883;
 
     if (index < 1 || index > DISK_DRIVE_COUNT)
@@ -365,21 +352,21 @@ static bool fddSetSelectDrive(int index, uint8_t state)
 
     if (state)
     {
-        if (fdd.unit != index)
+        if (fdd->unit != index)
         {
-            fdd.unit = index;
+            fdd->unit = index;
 
-            if (driveHandler[index].select)
-                driveHandler[index].select (driveHandler[index].name,
-                driveHandler[index].readOnly);
+            if (fdd->driveHandler[index].select)
+                fdd->driveHandler[index].select (fdd->driveHandler[index].name,
+                fdd->driveHandler[index].readOnly);
         }
     }
-    else if (index == fdd.unit)
+    else if (index == fdd->unit)
     {
-        if (driveHandler[index].deselect)
-            driveHandler[index].deselect ();
+        if (fdd->driveHandler[index].deselect)
+            fdd->driveHandler[index].deselect ();
 
-        fdd.unit=0;
+        fdd->unit=0;
         mprintf(LVL_DISK, "DSK drive %d deselected\n", index);
     }
     return false;
@@ -387,8 +374,10 @@ static bool fddSetSelectDrive(int index, uint8_t state)
 
 static bool fddSetSelectSide(int index, uint8_t state)
 {
-    fdd.side = state;
-    mprintf(LVL_DISK, "DSK set side %d\n", fdd.side);
+    FddState *fdd = &machine->fdd;
+
+    fdd->side = state;
+    mprintf(LVL_DISK, "DSK set side %d\n", fdd->side);
     return false;
 }
 
@@ -400,35 +389,42 @@ static uint8_t fddGetHLDPin (int index, uint8_t state)
 
 static uint8_t fddGetDriveSelected (int index, uint8_t state)
 {
+    FddState *fdd = &machine->fdd;
     int unit = index - 0x880;
     mprintf(LVL_DISK, "DSK test if unit %d active\n", unit);
-    return fdd.unit == unit;
+    return fdd->unit == unit;
 }
 
 static uint8_t fddGetMotorStrobeOn (int index, uint8_t state)
 {
-    mprintf(LVL_DISK, "DSK get motor strobe %d\n", fdd.motorStrobe);
-    return fdd.motorStrobe;
+    FddState *fdd = &machine->fdd;
+
+    mprintf(LVL_DISK, "DSK get motor strobe %d\n", fdd->motorStrobe);
+    return fdd->motorStrobe;
 }
 
 static uint8_t fddGetSide (int index, uint8_t state)
 {
-    mprintf(LVL_DISK, "DSK get side %d\n", fdd.side);
-    return fdd.side;
+    FddState *fdd = &machine->fdd;
+
+    mprintf(LVL_DISK, "DSK get side %d\n", fdd->side);
+    return fdd->side;
 }
 
 void fddRegisterHandler (int unit, fddHandler *handler)
 {
+    FddState *fdd = &machine->fdd;
+
     if (unit < 1 || unit > DISK_DRIVE_COUNT)
         halt ("invalid unit for handler");
 
-    driveHandler[unit] = *handler;
+    fdd->driveHandler[unit] = *handler;
     mprintf(LVL_DISK, "Handler registered for unit %d\n", unit);
 }
 
 void fddInit (void)
 {
-    cruOutputCallbackSet (0x880, memDeviceRomSelect);
+    memDeviceRegister (0x1100, 0x5FF0, 0x10, fddRead, fddWrite);
     cruOutputCallbackSet (0x881, fddSetStrobeMotor);
     cruOutputCallbackSet (0x882, fddSetIgnoreIRQ);
     cruOutputCallbackSet (0x883, fddSetSignalHead);
@@ -40,8 +40,8 @@ typedef struct
 }
 fddHandler;
 
-uint16_t fddRead (uint16_t addr, uint16_t size);
-void fddWrite (uint16_t addr, uint16_t data, uint16_t size);
+uint16_t fddRead (uint16_t addr, int size);
+void fddWrite (uint16_t addr, uint16_t data, int size);
 void fddLoad (int drive, char *name);
 void fddInit (void);
 void fddRegisterHandler (int drive, fddHandler *handler);
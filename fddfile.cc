@@ -29,30 +29,27 @@
 #include "trace.h"
 #include "fddfile.h"
 #include "fdd.h"
-
-/*  Maintain static state even though we have multiple drives.  This is ok
- *  because only one drive can be selected at a time */
-static FILE *diskFile;
+#include "machine.h"
 
 static void fileSeek (int sector)
 {
-    ASSERT (diskFile != NULL, "file not open in seek");
+    ASSERT (machine->fdd.diskFile != NULL, "file not open in seek");
     printf("XX seek %d\n", sector);
-    fseek (diskFile, sector * DISK_BYTES_PER_SECTOR, SEEK_SET);
+    fseek (machine->fdd.diskFile, sector * DISK_BYTES_PER_SECTOR, SEEK_SET);
 }
 
 static void fileRead (unsigned char *buffer)
 {
-    ASSERT (diskFile != NULL, "file not open in read");
-    int res = fread (buffer, 1, DISK_BYTES_PER_SECTOR, diskFile);
+    ASSERT (machine->fdd.diskFile != NULL, "file not open in read");
+    int res = fread (buffer, 1, DISK_BYTES_PER_SECTOR, machine->fdd.diskFile);
     printf("XX read %d\n", res);
 }
 
 static void fileWrite (unsigned char *buffer)
 {
-    ASSERT (diskFile != NULL, "file not open in write");
+    ASSERT (machine->fdd.diskFile != NULL, "file not open in write");
     /*  If the file was opened read only then write will fail quietly */
-    int res = fwrite (buffer, 1, DISK_BYTES_PER_SECTOR, diskFile);
+    int res = fwrite (buffer, 1, DISK_BYTES_PER_SECTOR, machine->fdd.diskFile);
     printf("XX write %d\n", res);
 }
 
@@ -60,17 +57,17 @@ static void fileSelect(const char *name, bool readOnly)
 {
     const char *mode = readOnly ? "r" : "r+";
 
-    ASSERT (diskFile == NULL, "already open");
-    diskFile = fopen (name, mode);
-    ASSERT (diskFile != NULL, "diskSelectDrive");
+    ASSERT (machine->fdd.diskFile == NULL, "already open");
+    machine->fdd.diskFile = fopen (name, mode);
+    ASSERT (machine->fdd.diskFile != NULL, "diskSelectDrive");
     printf ("Disk file %s selected\n", name);
 }
 
 static void fileDeselect(void)
 {
-    ASSERT (diskFile != NULL, "deselect not open");
-    fclose (diskFile);
-    diskFile = NULL;
+    ASSERT (machine->fdd.diskFile != NULL, "deselect not open");
+    fclose (machine->fdd.diskFile);
+    machine->fdd.diskFile = NULL;
 }
 
 void diskFileLoad (int drive, bool readOnly, const char *name)
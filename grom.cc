@@ -26,21 +26,22 @@
 #include "grom.h"
 #include "trace.h"
 #include "gpl.h"
+#include "machine.h"
 
 #define GROM_LEN        0x10000
+#define GROM_CHIP_SIZE  0x2000
 
-struct
+/*  Chips that haven't been loaded read as zero */
+static uint8_t gromByte (uint16_t addr)
 {
-    uint16_t addr;
-    uint8_t lowByteGet;
-    uint8_t lowByteSet;
-    uint8_t b[GROM_LEN];
+    uint8_t *chip = machine->grom.chip[addr / GROM_CHIP_SIZE];
+
+    return chip ? chip[addr % GROM_CHIP_SIZE] : 0;
 }
-gRom;
 
 void gromIntegrity (void)
 {
-    if (gRom.b[0x1bc] != 0xbe)
+    if (gromByte (0x1bc) != 0xbe)
     {
         halt ("GROM corruption\n");
     }
@@ -51,33 +52,33 @@ uint16_t gromRead (uint8_t *ptr, uint16_t addr, int size)
     switch (addr)
     {
     case 0:
-        gRom.lowByteGet = false;
-        gRom.lowByteSet = false;
+        machine->grom.lowByteGet = false;
+        machine->grom.lowByteSet = false;
 
         uint8_t result;
 
-        result = gRom.b[gRom.addr];
+        result = gromByte (machine->grom.addr);
 
         mprintf (LVL_GROM, "GROMRead: %04X : %02X\n",
-                 (unsigned) gRom.addr,
+                 (unsigned) machine->grom.addr,
                  (unsigned) result);
 
         //  TODO disabled for now.  GPL disassembly requires the CPU PC which is not available here
-        // gplDisassemble (gRom.addr, result);
-        gRom.addr++;
+        // gplDisassemble (machine->grom.addr, result);
+        machine->grom.addr++;
 
         return result;
     case 2:
-        if (gRom.lowByteGet)
+        if (machine->grom.lowByteGet)
         {
-            gRom.lowByteGet = false;
-            mprintf (LVL_GROM, "GROMAD addr get as %04X\n", gRom.addr+1);
-            return (gRom.addr+1) & 0xFF;
+            machine->grom.lowByteGet = false;
+            mprintf (LVL_GROM, "GROMAD addr get as %04X\n", machine->grom.addr+1);
+            return (machine->grom.addr+1) & 0xFF;
         }
 
-        gRom.lowByteGet = true;
+        machine->grom.lowByteGet = true;
         mprintf (LVL_GROM, "GROMAD lo byte Get\n");
-        return (gRom.addr+1) >> 8;
+        return (machine->grom.addr+1) >> 8;
     default:
         halt ("Strange GROM CPU addr\n");
         break;
@@ -97,17 +98,17 @@ void gromWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
     {
     case 2:
         mprintf (LVL_GROM, "GROMAD uint8_t write to 9C02\n");
-        if (gRom.lowByteSet)
+        if (machine->grom.lowByteSet)
         {
-            gRom.addr = (gRom.addr & 0xFF00) | data;
-            gRom.lowByteSet = false;
-            gRom.lowByteGet = false;
-            mprintf (LVL_GROM, "GROMAD addr set to %04X\n", gRom.addr);
+            machine->grom.addr = (machine->grom.addr & 0xFF00) | data;
+            machine->grom.lowByteSet = false;
+            machine->grom.lowByteGet = false;
+            mprintf (LVL_GROM, "GROMAD addr set to %04X\n", machine->grom.addr);
         }
         else
         {
-            gRom.addr = data << 8;
-            gRom.lowByteSet = true;
+            machine->grom.addr = data << 8;
+            machine->grom.lowByteSet = true;
             mprintf (LVL_GROM, "GROMAD lo byte Set to %x\n", data);
         }
         break;
@@ -120,12 +121,12 @@ void gromWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
 
 uint8_t gromData (int addr)
 {
-    return gRom.b[addr];
+    return gromByte (addr);
 }
 
 uint16_t gromAddr (void)
 {
-    return gRom.addr;
+    return machine->grom.addr;
 }
 
 void gromShowStatus (void)
@@ -133,39 +134,25 @@ void gromShowStatus (void)
     mprintf (LVL_GROM, "GROM\n");
     mprintf (LVL_GROM, "====\n");
 
-    mprintf (LVL_GROM, "addr        : %04X\n", gRom.addr);
-    mprintf (LVL_GROM, "half-ad-set : %d\n", gRom.lowByteSet);
-    mprintf (LVL_GROM, "half-ad-get : %d\n", gRom.lowByteGet);
+    mprintf (LVL_GROM, "addr        : %04X\n", machine->grom.addr);
+    mprintf (LVL_GROM, "half-ad-set : %d\n", machine->grom.lowByteSet);
+    mprintf (LVL_GROM, "half-ad-get : %d\n", machine->grom.lowByteGet);
 }
 
+/*  GROMs are read-only so the image of a file is shared by every machine that
+ *  loads it.  The file replaces the whole of each 8k GROM chip it covers.
+ */
 void gromLoad (char *file, uint16_t addr)
 {
-    FILE *fp;
-
-    if ((fp = fopen (file, "rb")) == NULL)
-    {
-        printf ("can't open %s\n", file);
-        exit (1);
-    }
-
-    fseek (fp, 0, SEEK_END);
-    unsigned len = ftell (fp);
-    fseek (fp, 0, SEEK_SET);
+    int first = addr / GROM_CHIP_SIZE;
+    int len;
+    uint8_t *data = machineImageLoad (file, addr % GROM_CHIP_SIZE,
+                                      GROM_LEN - first * GROM_CHIP_SIZE, &len);
 
     printf("%s %s %x-%x\n", __func__, file, addr, addr+len);
 
-    if (addr + len > GROM_LEN)
-    {
-        printf ("Grom end %04X\n", addr+len);
-        halt ("GROM too big");
-    }
-
-    if (fread (gRom.b + addr, sizeof (uint8_t), len, fp) != len)
-    {
-        halt ("GROM file read failure");
-    }
-
-    fclose (fp);
+    for (int i = first; i * GROM_CHIP_SIZE < addr + len; i++)
+        machine->grom.chip[i] = data + (i - first) * GROM_CHIP_SIZE;
 
     printf ("GROM load ok\n");
 }
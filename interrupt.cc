@@ -36,45 +36,23 @@
 #include "timer.h"
 #include "cassette.h"
 #include "ti994a.h"
-
-static struct
-{
-    int intActive[16];
-    int intDisabled[16];
-    bool timerMode;
-    int timer;
-    int timerSnapshot;
-}
-tms9901;
+#include "machine.h"
 
 /*  Return the highest priority interrupt pending */
 int interruptLevel (int mask)
 {
-    int i;
-    int level = -1;
-
     /*  Interrupts to the TMS9900 are hardwired to always generate interrupt
      *  level 1 regardless of what device generated the interrupt.  So if any
      *  level is > 0 and mask > 0, return level 1.
      */
 
-    if (mask == 0)
+    if (mask == 0 || machine->tms9901.pending == 0)
         return -1;
 
-    for (i = 0; i <= 16; i++)
-    {
-        if (tms9901.intActive[i])
-        {
-            mprintf (LVL_INTERRUPT, "TMS9901 interrupt %d active\n", i);
-            level = i;
-            break;
-        }
-    }
-
-    if (level >= 0)
-        return 1;
+    mprintf (LVL_INTERRUPT, "TMS9901 interrupt %d active\n",
+             __builtin_ctz (machine->tms9901.pending));
 
-    return -1;
+    return 1;
 }
 
 bool tms9901Interrupt (int index, uint8_t state)
@@ -82,14 +60,14 @@ bool tms9901Interrupt (int index, uint8_t state)
     /*  Set interrupt active for the each cru bit
      *  that is active low and not masked.
      */
-    if (!state && !tms9901.intDisabled[index])
+    if (!state && !machine->tms9901.intDisabled[index])
     {
         mprintf (LVL_INTERRUPT, "IRQ bit %d is low and enabled, raise interrupt\n", index);
-        tms9901.intActive[index] = 1;
+        machine->tms9901.pending |= 1 << index;
     }
     else
     {
-        tms9901.intActive[index] = 0;
+        machine->tms9901.pending &= ~(1 << index);
     }
 
     /*  Allow the bit state to be changed */
@@ -101,28 +79,29 @@ bool tms9901Interrupt (int index, uint8_t state)
  */
 int tms9901TimerToNsec (void)
 {
-    return 1000 * 64 * tms9901.timer / 3;
+    return 1000 * 64 * machine->tms9901.timer / 3;
 }
 
-/*  Do the reverse of the above conversion to convert a remaining value in
- *  nanseconds to a timer register value
- */
-int tms9901TimerFromNsec (int value)
+/*  The timer decrements once every 64 CPU clock cycles */
+static int tms9901TimerToCycles (void)
 {
-    return value * 3 / (1000 * 64);
+    return 64 * machine->tms9901.timer;
 }
 
-void tms9901Init(void)
+/*  Convert the cycles remaining on the timer to a timer register value */
+static int tms9901TimerFromCycles (int cycles)
 {
-    int i;
+    return cycles / 64;
+}
 
-    for (i = 0; i < 16; i++)
-        tms9901.intActive[i] = 0;
+void tms9901Init(void)
+{
+    machine->tms9901.pending = 0;
 }
 
 static void timerCallback (void)
 {
-    if (tms9901.intDisabled[IRQ_TIMER])
+    if (machine->tms9901.intDisabled[IRQ_TIMER])
     {
         mprintf (LVL_INTERRUPT, "TMS9901 timer expired, interrupt is disabled\n");
     }
@@ -137,24 +116,24 @@ static void timerCallback (void)
 /*  Return true because the value should not be stored */
 bool tms9901BitSet (int index, uint8_t state)
 {
-    if (tms9901.timerMode)
+    if (machine->tms9901.timerMode)
     {
         int bit = 1 << (index - 1);
         int newTimerValue = 0;
 
-        newTimerValue = tms9901.timer & ~bit;
+        newTimerValue = machine->tms9901.timer & ~bit;
 
         if (state)
             newTimerValue |= bit;
 
-        if (newTimerValue != tms9901.timer)
-            mprintf (LVL_INTERRUPT, "TMS9901 timer bit %d set to %d, timer set to %d\n", index, state, tms9901.timer);
+        if (newTimerValue != machine->tms9901.timer)
+            mprintf (LVL_INTERRUPT, "TMS9901 timer bit %d set to %d, timer set to %d\n", index, state, machine->tms9901.timer);
 
-        tms9901.timer = newTimerValue;
-        int nsec = tms9901TimerToNsec ();
-        timerStart (TIMER_TMS9901, nsec, timerCallback);
-        mprintf (LVL_INTERRUPT, "t-start %04X -> %d nsec\n", tms9901.timer, nsec);
-        int timer = tms9901TimerFromNsec (timerRemain (TIMER_TMS9901));
+        machine->tms9901.timer = newTimerValue;
+        int cycles = tms9901TimerToCycles ();
+        timerStart (TIMER_TMS9901, cycles, timerCallback);
+        mprintf (LVL_INTERRUPT, "t-start %04X -> %d cycles\n", machine->tms9901.timer, cycles);
+        int timer = tms9901TimerFromCycles (timerRemain (TIMER_TMS9901));
         mprintf (LVL_INTERRUPT, "TMS9901 timer remain %04X\n", timer);
 
         /* Don't allow the actual state of the bit to change */
@@ -165,7 +144,7 @@ bool tms9901BitSet (int index, uint8_t state)
         /* Interrupt mode.  Writing 1 enables an interrupt, 0 disables it */
         mprintf (LVL_INTERRUPT, "TMS9901 bit %d state %d interrupt is %s\n", index, state,
                 (state == 0) ? "disabled" : "enabled");
-        tms9901.intDisabled[index] = (state == 0);
+        machine->tms9901.intDisabled[index] = (state == 0);
 
         /* Set the input bit back to 1 to clear the interrupt condition.  This
          * doesn't seem to quite follow the TMS9901 documentaton, but is the
@@ -173,7 +152,7 @@ bool tms9901BitSet (int index, uint8_t state)
          */
         if (state != 0)
         {
-            tms9901.intActive[index] = 0;
+            machine->tms9901.pending &= ~(1 << index);
             cruBitInput (0, index, state);
         }
 
@@ -199,9 +178,9 @@ uint8_t tms9901BitGet (int index, uint8_t state)
 {
     /*  If we are in timer mode, then return the bit value of the remaining
      *  timer bit */
-    if (tms9901.timerMode)
+    if (machine->tms9901.timerMode)
     {
-        int timer = tms9901TimerFromNsec (timerRemain (TIMER_TMS9901));
+        int timer = tms9901TimerFromCycles (timerRemain (TIMER_TMS9901));
         int bit = 1 << (index - 1);
 
         mprintf (LVL_INTERRUPT, "TMS9901 timer remain %04X, return bit %d as %d\n", timer, bit,
@@ -213,20 +192,27 @@ uint8_t tms9901BitGet (int index, uint8_t state)
     return state;
 }
 
+/*  Return true if the timer is in clock mode where reads return the time
+ *  remaining */
+bool tms9901ClockMode (void)
+{
+    return machine->tms9901.timerMode;
+}
+
 /*  Write to bit 0 sets the mode.  Mode 0 is input/IRQ mode, mode 1 is timer
  *  mode
  */
 bool tms9901ModeSet (int index, uint8_t state)
 {
     /*  Take a snapshot of the current clock timer on entering timer mode.  TODO
-     *  this may have to read remaing time on a timerfd.
+     *  this may have to read the remaining time on the timer.
      */
-    if (!tms9901.timerMode && state)
-        tms9901.timerSnapshot = tms9901.timer;
+    if (!machine->tms9901.timerMode && state)
+        machine->tms9901.timerSnapshot = machine->tms9901.timer;
 
-    tms9901.timerMode = state ? true : false;
+    machine->tms9901.timerMode = state ? true : false;
 
-    if (tms9901.timerMode)
+    if (machine->tms9901.timerMode)
         mprintf (LVL_INTERRUPT, "TMS9901 clock mode set\n");
     else
         mprintf (LVL_INTERRUPT, "TMS9901 interrupt mode set\n");
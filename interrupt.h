@@ -38,6 +38,7 @@ void tms9901Init(void);
 bool tms9901BitSet (int index, uint8_t state);
 uint8_t tms9901BitGet (int index, uint8_t state);
 bool tms9901ModeSet (int index, uint8_t state);
+bool tms9901ClockMode (void);
 
 #endif
 
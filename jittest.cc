@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ *  Differential tests of the JIT.  The same code is run by one CPU in
+ *  interpret mode and another in JIT mode and the PC, WP, ST, cycle count and
+ *  all of memory, which includes the workspace registers, must be the same
+ *  afterwards.  The directed tests run each instruction in a loop over pairs
+ *  of awkward operand values so that it is compiled and then run natively
+ *  for most of them.  The random tests run random code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "cpu.h"
+
+#define OPERAND_ADDR    0xA000
+#define RESULT_ADDR     0xB000
+
+/*  Executions allowed before a test is assumed to have run away */
+#define MAX_STEPS       2000000
+
+/*  A CPU with 64k of memory.  Below >2000 is ROM.  The rest is RAM that
+ *  compiled code can access directly and, as in the console, only the ROM
+ *  and scratchpad have no wait states.  Random code can write illegal
+ *  opcodes over itself so halts are counted and execution carries on.
+ *
+ *  If banked is set, >6000->7FFF is instead one of two banks of ROM and a
+ *  write to >6000+2n selects bank n, as in a cartridge.
+ */
+class TestCPU : public TMS9900
+{
+public:
+    uint8_t mem[0x10000];
+    uint8_t banks[2][0x2000];
+    bool banked;
+    int bank;
+    int halts;
+private:
+    bool _inBank (uint16_t addr) { return banked && addr >= 0x6000 && addr < 0x8000; }
+    uint8_t *_data (uint16_t addr)
+    {
+        return _inBank (addr) ? &banks[bank][addr - 0x6000] : &mem[addr];
+    }
+    void _bankSelect (uint16_t addr)
+    {
+        bank = (addr >> 1) & 1;
+        memoryRemapped ();
+    }
+    uint16_t _memReadW (uint16_t addr)
+    {
+        uint8_t *p = _data (addr & ~1);
+        return (p[0] << 8) | p[1];
+    }
+    uint8_t _memReadB (uint16_t addr) { return *_data (addr); }
+    void _memWriteW (uint16_t addr, uint16_t data)
+    {
+        addr &= ~1;
+
+        if (_inBank (addr))
+            _bankSelect (addr);
+        else if (addr >= 0x2000)
+        {
+            mem[addr] = data >> 8;
+            mem[addr+1] = data & 0xff;
+        }
+    }
+    void _memWriteB (uint16_t addr, uint8_t data)
+    {
+        if (_inBank (addr))
+            _bankSelect (addr);
+        else if (addr >= 0x2000)
+            mem[addr] = data;
+    }
+    intptr_t _memBank (uint16_t addr) { return _inBank (addr) ? bank + 1 : 0; }
+    uint8_t *_memHostPtr (uint16_t addr)
+    {
+        return (addr >= 0x2000 && !_inBank (addr)) ? mem + addr : NULL;
+    }
+    int _memWait (uint16_t addr)
+    {
+        return (addr < 0x2000 || (addr >= 0x8000 && addr < 0x8400)) ? 0 : 4;
+    }
+    int _interruptLevel (int mask) { return -1; }
+    uint8_t _cruBitGet (uint16_t base, int8_t bitOffset) { return (base + bitOffset) & 1; }
+    uint16_t _cruMultiBitGet (uint16_t base, uint16_t offset) { return base ^ 0x5a5a; }
+    void _halt (const char *s) { halts++; }
+};
+
+/*  The same CPUs are used for every test as the block cache and JIT buffer
+ *  are never freed */
+static TestCPU *interp;
+static TestCPU *jit;
+static uint8_t image[0x10000];
+static uint8_t bankImage[2][0x2000];
+static bool banked;
+static int testsRun;
+static int testsFailed;
+
+/*  Load the image into both CPUs and boot them.  Run the JIT until it
+ *  reaches the end address, or for a number of instructions if end is -1,
+ *  and the interpreter for the same number of instructions.  Report whether
+ *  the state of the two is the same afterwards.
+ */
+static void run (const char *name, int end, int steps)
+{
+    memcpy (interp->mem, image, sizeof image);
+    memcpy (jit->mem, image, sizeof image);
+    memcpy (interp->banks, bankImage, sizeof bankImage);
+    memcpy (jit->banks, bankImage, sizeof bankImage);
+    interp->banked = jit->banked = banked;
+    interp->bank = jit->bank = 0;
+    interp->flushBlocks ();
+    jit->flushBlocks ();
+    interp->boot ();
+    jit->boot ();
+    interp->halts = 0;
+    jit->halts = 0;
+
+    uint64_t interpStart = interp->getCycles ();
+    uint64_t jitStart = jit->getCycles ();
+    int jitSteps = 0;
+
+    /*  A block is run as a whole so the JIT runs first and the interpreter
+     *  is stopped at the same instruction */
+    if (end >= 0)
+        steps = MAX_STEPS;
+
+    while (jitSteps < steps && jit->getPC () != end)
+        jitSteps += jit->executeBlock ();
+
+    for (int i = 0; i < jitSteps; i++)
+        interp->execute (interp->fetch ());
+
+    uint64_t interpCycles = interp->getCycles () - interpStart;
+    uint64_t jitCycles = jit->getCycles () - jitStart;
+    bool ok = true;
+
+    testsRun++;
+
+    if (end >= 0 && jit->getPC () != end)
+    {
+        printf ("# didn't reach end %04X after %d instructions\n", end, jitSteps);
+        ok = false;
+    }
+
+    if (interp->getPC () != jit->getPC () || interp->getWP () != jit->getWP () ||
+        interp->getST () != jit->getST () || interpCycles != jitCycles ||
+        interp->halts != jit->halts || interp->bank != jit->bank)
+    {
+        printf ("# interpret pc=%04X wp=%04X st=%04X cycles=%llu halts=%d bank=%d\n",
+                interp->getPC (), interp->getWP (), interp->getST (),
+                (unsigned long long) interpCycles, interp->halts, interp->bank);
+        printf ("# jit       pc=%04X wp=%04X st=%04X cycles=%llu halts=%d bank=%d\n",
+                jit->getPC (), jit->getWP (), jit->getST (),
+                (unsigned long long) jitCycles, jit->halts, jit->bank);
+        ok = false;
+    }
+
+    for (int i = 0; i < 0x10000; i += 2)
+    {
+        if (interp->mem[i] != jit->mem[i] || interp->mem[i+1] != jit->mem[i+1])
+        {
+            printf ("# @%04X interpret=%02X%02X jit=%02X%02X\n", i,
+                    interp->mem[i], interp->mem[i+1], jit->mem[i], jit->mem[i+1]);
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok)
+        testsFailed++;
+
+    printf ("%sok %d - %s\n", ok ? "" : "not ", testsRun, name);
+}
+
+/*  Where the workspace and code are for the directed tests.  In the second
+ *  every access to them has wait states, which compiled code must count.
+ */
+static const struct
+{
+    uint16_t wp;
+    uint16_t code;
+    const char *name;
+}
+places[] =
+{
+    { 0x8300, 0x0100, "" },
+    { 0xC000, 0xC100, " with wait states" }
+},
+*place;
+
+static int codeAddr;
+
+static void emit (uint16_t w)
+{
+    image[codeAddr++] = w >> 8;
+    image[codeAddr++] = w & 0xff;
+}
+
+/*  Operand values that are on the edges of the status bits */
+static const uint16_t operands[] =
+{
+    0x0000, 0x0001, 0x007F, 0x0080, 0x00FF, 0x0100, 0x7F00, 0x7FFF,
+    0x8000, 0x8001, 0x8080, 0xFF00, 0xFFFF, 0x5555, 0xAAAA, 0x1234
+};
+
+#define NOPERAND (sizeof (operands) / sizeof (operands[0]))
+
+/*  Jumps that end a block after each instruction under test */
+static const uint16_t jumps[] =
+{
+    0x1000, 0x1100, 0x1200, 0x1300, 0x1400, 0x1500,
+    0x1600, 0x1700, 0x1800, 0x1900, 0x1A00, 0x1B00
+};
+
+/*  Test an instruction, given by up to 3 words, with R1 and R2 loaded with
+ *  every pair of operand values.  R0 holds the value of R1 for shifts by
+ *  R0 and R5 the address of R1 for indirect source operands.  The resulting
+ *  R2, R3, status and whether a jump was taken are stored for each pair.
+ */
+static void testOp (const char *name, int words, uint16_t w0, uint16_t w1 = 0, uint16_t w2 = 0)
+{
+    uint16_t jump = jumps[testsRun % (sizeof (jumps) / sizeof (jumps[0]))];
+
+    memset (image, 0, sizeof image);
+
+    image[0] = place->wp >> 8;
+    image[1] = place->wp & 0xff;
+    image[2] = place->code >> 8;
+    image[3] = place->code & 0xff;
+
+    for (unsigned i = 0; i < NOPERAND * NOPERAND; i++)
+    {
+        uint16_t a = operands[i / NOPERAND];
+        uint16_t b = operands[i % NOPERAND];
+
+        image[OPERAND_ADDR + i * 4] = a >> 8;
+        image[OPERAND_ADDR + i * 4 + 1] = a & 0xff;
+        image[OPERAND_ADDR + i * 4 + 2] = b >> 8;
+        image[OPERAND_ADDR + i * 4 + 3] = b & 0xff;
+    }
+
+    codeAddr = place->code;
+    emit (0x0208); emit (OPERAND_ADDR);     // LI   R8,OPERAND_ADDR
+    emit (0x0209); emit (RESULT_ADDR);      // LI   R9,RESULT_ADDR
+    emit (0x0204); emit (NOPERAND * NOPERAND); // LI R4,count
+    emit (0x0205); emit (place->wp + 2);    // LI   R5,WP+2
+
+    int loop = codeAddr;
+
+    emit (0xC078);                          // MOV  *R8+,R1
+    emit (0xC0B8);                          // MOV  *R8+,R2
+    emit (0xC001);                          // MOV  R1,R0
+    emit (0x04C7);                          // CLR  R7
+
+    emit (w0);
+
+    if (words > 1)
+        emit (w1);
+
+    if (words > 2)
+        emit (w2);
+
+    emit (jump | 0x01);                     // Jcc  $+4
+    emit (0x0707);                          // SETO R7
+    emit (0x02C6);                          // STST R6
+    emit (0xCE42);                          // MOV  R2,*R9+
+    emit (0xCE43);                          // MOV  R3,*R9+
+    emit (0xCE46);                          // MOV  R6,*R9+
+    emit (0xCE47);                          // MOV  R7,*R9+
+    emit (0x0604);                          // DEC  R4
+    emit (0x1600 | (((loop - codeAddr - 2) >> 1) & 0xff)); // JNE loop
+
+    int end = codeAddr;
+    char s[60];
+
+    emit (0x10FF);                          // JMP  $
+
+    sprintf (s, "%s%s", name, place->name);
+    run (s, end, 0);
+}
+
+/*  Test the dual operand instructions with register, indirect source and
+ *  symbolic destination operands */
+static void testDual (const char *name, uint16_t op)
+{
+    char s[40];
+
+    sprintf (s, "%s R1,R2", name);
+    testOp (s, 1, op | 0x0081);
+    sprintf (s, "%s *R5,R2", name);
+    testOp (s, 1, op | 0x0095);
+    sprintf (s, "%s R1,@R2", name);
+    testOp (s, 2, op | 0x0801, place->wp + 4);
+}
+
+/*  Switch banks in the middle of a block.  The code after the switch must
+ *  come from the new bank, so the loop in bank 0 counts in R5 the times
+ *  bank 1 ran and in R3 the times its own code after the switch ran, which
+ *  should be never.  Bank 1 switches back to bank 0 at the start of the
+ *  loop's tail.
+ */
+static void testBankSwitch (void)
+{
+    static const uint16_t bank0[] =
+    {
+        0x0204, 0x0100,         //      LI   R4,>0100
+        0x0582,                 // loop INC  R2
+        0x04E0, 0x6002,         //      CLR  @>6002
+        0x0583,                 //      INC  R3
+        0x0583,                 //      INC  R3
+        0x0583,                 //      INC  R3
+        0x0604,                 //      DEC  R4
+        0x16F8,                 //      JNE  loop
+        0x10FF                  //      JMP  $
+    };
+    static const uint16_t bank1[] =
+    {
+        0x0585,                 // >600A INC R5
+        0x04E0, 0x6000          //       CLR @>6000
+    };
+
+    memset (image, 0, sizeof image);
+    image[0] = places[0].wp >> 8;
+    image[1] = places[0].wp & 0xff;
+    image[2] = 0x60;
+    image[3] = 0x00;
+
+    /*  Anything else run in bank 1 counts in R6 */
+    for (int i = 0; i < 0x2000; i += 2)
+    {
+        bankImage[0][i] = 0x05;
+        bankImage[0][i+1] = 0x83;
+        bankImage[1][i] = 0x05;
+        bankImage[1][i+1] = 0x86;
+    }
+
+    for (unsigned i = 0; i < sizeof (bank0) / sizeof (bank0[0]); i++)
+    {
+        bankImage[0][i*2] = bank0[i] >> 8;
+        bankImage[0][i*2+1] = bank0[i] & 0xff;
+    }
+
+    for (unsigned i = 0; i < sizeof (bank1) / sizeof (bank1[0]); i++)
+    {
+        bankImage[1][0xA + i*2] = bank1[i] >> 8;
+        bankImage[1][0xA + i*2+1] = bank1[i] & 0xff;
+    }
+
+    banked = true;
+    run ("bank switch within a block", 0x6014, 0);
+    banked = false;
+}
+
+/*  Random code that is mostly instructions with register operands so that
+ *  it is compiled, and the rest random words made legal */
+static uint32_t seed;
+
+static uint32_t rnd (void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static uint16_t randomInstruction (void)
+{
+    static const uint16_t imm[] = { 0x0200, 0x0220, 0x0240, 0x0260, 0x0280, 0x02A0, 0x02C0, 0x0300 };
+    int kind = rnd () % 100;
+
+    if (kind < 12)
+        return imm[rnd () % 8] | (rnd () & 0xF);
+
+    if (kind < 30)
+        return 0x0400 + (rnd () % 16) * 0x40 + (rnd () & 0x3F);
+
+    if (kind < 38)
+        return 0x0800 | (rnd () & 0x3FF);
+
+    if (kind < 55)
+        return 0x1000 | (rnd () & 0xFFF);
+
+    if (kind < 65)
+        return 0x2000 | (rnd () & 0x1FFF);
+
+    return 0x4000 + (rnd () % 0xC000);
+}
+
+static void testRandom (int n)
+{
+    char s[40];
+
+    seed = n;
+
+    for (int i = 0; i < 0x10000; i += 2)
+    {
+        uint16_t w = (rnd () % 4) ? randomInstruction () : rnd ();
+
+        /*  Replace illegal opcodes, IDLE, RSET and LWPI, which would move the
+         *  workspace anywhere */
+        if (w < 0x0200 || (w >= 0x02E0 && w < 0x0300) ||
+            (w >= 0x0320 && w < 0x0380) || (w >= 0x03A0 && w < 0x0400) ||
+            (w >= 0x0780 && w < 0x0800) || (w >= 0x0C00 && w < 0x1000) ||
+            (w >= 0x1C00 && w < 0x1D00))
+            w = 0x0200 | (w & 0xF);
+
+        image[i] = w >> 8;
+        image[i+1] = w & 0xff;
+    }
+
+    image[0] = places[0].wp >> 8;
+    image[1] = places[0].wp & 0xff;
+    image[2] = 0x00;
+    image[3] = 0x40;
+
+    sprintf (s, "random code seed %d", n);
+    run (s, -1, 300000);
+}
+
+static const struct
+{
+    const char *name;
+    uint16_t op;
+}
+duals[] =
+{
+    { "A", 0xA000 }, { "AB", 0xB000 }, { "S", 0x6000 }, { "SB", 0x7000 },
+    { "C", 0x8000 }, { "CB", 0x9000 }, { "MOV", 0xC000 }, { "MOVB", 0xD000 },
+    { "SOC", 0xE000 }, { "SOCB", 0xF000 }, { "SZC", 0x4000 }, { "SZCB", 0x5000 }
+},
+singles[] =
+{
+    { "NEG", 0x0502 }, { "ABS", 0x0742 }, { "INV", 0x0542 }, { "INC", 0x0582 },
+    { "INCT", 0x05C2 }, { "DEC", 0x0602 }, { "DECT", 0x0642 }, { "SWPB", 0x06C2 },
+    { "CLR", 0x04C2 }, { "SETO", 0x0702 }, { "XOR", 0x2881 }, { "COC", 0x2081 },
+    { "CZC", 0x2481 }, { "MPY", 0x3881 }, { "DIV", 0x3C81 }
+},
+shifts[] =
+{
+    { "SLA", 0x0A02 }, { "SRA", 0x0802 }, { "SRL", 0x0902 }, { "SRC", 0x0B02 }
+},
+immediates[] =
+{
+    { "LI", 0x0202 }, { "AI", 0x0222 }, { "ANDI", 0x0242 }, { "ORI", 0x0262 },
+    { "CI", 0x0282 }
+};
+
+int main (void)
+{
+    char s[40];
+
+    interp = new TestCPU;
+    jit = new TestCPU;
+    jit->setExecMode (EXEC_JIT);
+
+    if (jit->getExecMode () != EXEC_JIT)
+    {
+        printf ("1..0 # SKIP no JIT on this host\n");
+        return 0;
+    }
+
+    int directed = sizeof (duals) / sizeof (duals[0]) * 3 +
+                   sizeof (singles) / sizeof (singles[0]) +
+                   sizeof (shifts) / sizeof (shifts[0]) * 4 +
+                   sizeof (immediates) / sizeof (immediates[0]) * 4;
+
+    printf ("1..%d\n", directed * (int) (sizeof (places) / sizeof (places[0])) + 9);
+
+    for (place = places; place < places + sizeof (places) / sizeof (places[0]); place++)
+    {
+        for (unsigned i = 0; i < sizeof (duals) / sizeof (duals[0]); i++)
+            testDual (duals[i].name, duals[i].op);
+
+        for (unsigned i = 0; i < sizeof (singles) / sizeof (singles[0]); i++)
+            testOp (singles[i].name, 1, singles[i].op);
+
+        /*  A count of 0 shifts by R0 */
+        for (unsigned i = 0; i < sizeof (shifts) / sizeof (shifts[0]); i++)
+        {
+            static const int counts[] = { 0, 1, 7, 15 };
+
+            for (int j = 0; j < 4; j++)
+            {
+                sprintf (s, "%s R2,%d", shifts[i].name, counts[j]);
+                testOp (s, 1, shifts[i].op | (counts[j] << 4));
+            }
+        }
+
+        for (unsigned i = 0; i < sizeof (immediates) / sizeof (immediates[0]); i++)
+        {
+            static const uint16_t values[] = { 0x0000, 0x0001, 0x8000, 0xFFFF };
+
+            for (int j = 0; j < 4; j++)
+            {
+                sprintf (s, "%s R2,>%04X", immediates[i].name, values[j]);
+                testOp (s, 2, immediates[i].op, values[j]);
+            }
+        }
+    }
+
+    testBankSwitch ();
+
+    for (int i = 1; i <= 8; i++)
+        testRandom (i);
+
+    return testsFailed ? 1 : 0;
+}
@@ -33,13 +33,12 @@
 
 #include "trace.h"
 #include "kbd.h"
+#include "machine.h"
 #include "cru.h"
+#include "timer.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
-static int kbdFd;
-static char kbdDevice[256];
-
 /*
  *  This table is just used to create debug output.  It contains a string
  *  representation of the keys being pressed.
@@ -102,24 +101,17 @@ keyExtended[] =
     {  81, 3, 6, 2, 6}   // numpad 3 = j1 down+right
 };
 
-/*  Maintain a current and previous table of key states.  The lastState table is
- *  only used to reduce debug output.
- */
-static int keyState[KBD_ROW][KBD_COL];
-static int lastState[KBD_ROW][KBD_COL];
-static bool alphaLock;
-
 static void kbdReopen (void)
 {
-    if (kbdFd != -1)
-        close (kbdFd);
+    if (machine->kbd.fd != -1)
+        close (machine->kbd.fd);
 
-    kbdFd = open (kbdDevice, O_RDONLY);
+    machine->kbd.fd = open (machine->kbd.device, O_RDONLY);
 
-    if (kbdFd == -1)
+    if (machine->kbd.fd == -1)
     {
         mprintf (LVL_KBD, "%s failed to open device %s error %s\n", __func__,
-              kbdDevice, strerror (errno));
+              machine->kbd.device, strerror (errno));
         halt("check keyboard input device");
     }
 }
@@ -140,7 +132,7 @@ static void decodeEvent (struct input_event ev)
                              ev.code,
                              ev.value == 0 ? "UP" : "DOWN",
                              keyMap[i][j], i, j);
-                    keyState[i][j] = ev.value;
+                    machine->kbd.keyState[i][j] = ev.value;
                     mapped = true;
                 }
 
@@ -167,8 +159,8 @@ static void decodeEvent (struct input_event ev)
 
                     mprintf (LVL_KBD, "\n");
 
-                    keyState[e->row1][e->col1] = ev.value;
-                    keyState[e->row2][e->col2] = ev.value;
+                    machine->kbd.keyState[e->row1][e->col1] = ev.value;
+                    machine->kbd.keyState[e->row2][e->col2] = ev.value;
                     mapped = true;
                 }
             }
@@ -177,7 +169,7 @@ static void decodeEvent (struct input_event ev)
         /* Hash key, code 43, toggles alpha lock */
         if (!mapped && ev.code == 43 && ev.value != 0)
         {
-            alphaLock = !alphaLock;
+            machine->kbd.alphaLock = !machine->kbd.alphaLock;
             mapped = true;
         }
 
@@ -187,8 +179,6 @@ static void decodeEvent (struct input_event ev)
     }
 }
 
-static int kbdColumn;
-
 /*  4 column CRU bits consisting of 3 keyboard selects and 1 alphalock */
 bool kbdColumnUpdate (int index, uint8_t value)
 {
@@ -198,39 +188,41 @@ bool kbdColumnUpdate (int index, uint8_t value)
         halt ("bad KBD col");
     }
 
+    KbdState *k = &machine->kbd;
+
     index -= 18;
     int bit = 1 << index;
 
-    kbdColumn &= ~bit;
+    k->column &= ~bit;
 
     if (value)
-        kbdColumn |= bit;
+        k->column |= bit;
 
     int row;
-    int col = kbdColumn & 7;
+    int col = k->column & 7;
 
-    // mprintf (LVL_KBD, "KBD scan col %d\n", kbdColumn);
+    // mprintf (LVL_KBD, "KBD scan col %d\n", k->column);
 
     for (row = 0; row < KBD_COL; row++)
     {
-        int bit = keyState[row][col] ? 0 : 1;
+        int bit = k->keyState[row][col] ? 0 : 1;
 
-        if (keyState[row][col] != lastState[row][col])
+        if (k->keyState[row][col] != k->lastState[row][col])
         {
-            mprintf (LVL_KBD, "%s scan row/col %d/%d = %d\n", __func__, row, col, keyState[row][col]);
-            lastState[row][col] = keyState[row][col];
+            mprintf (LVL_KBD, "%s scan row/col %d/%d = %d\n", __func__, row, col, k->keyState[row][col]);
+            k->lastState[row][col] = k->keyState[row][col];
         }
 
         /* If alpha-lock column selected, row is 4 and alpha-lock is on, then
          * pull line low */
-        if ((kbdColumn & 0x8) == 0 && row == 4 && alphaLock)
+        if ((k->column & 0x8) == 0 && row == 4 && k->alphaLock)
         {
             bit = 0;
-            printf("ix=%d alpha=%s\n", index, alphaLock?"Y":"N");
+            printf("ix=%d alpha=%s\n", index, k->alphaLock?"Y":"N");
         }
 
         // if (!bit)
-        //     mprintf (LVL_KBD, "KBD col %d, row %d active\n", kbdColumn, row);
+        //     mprintf (LVL_KBD, "KBD col %d, row %d active\n", k->column, row);
 
         cruBitInput (0, 3+row, bit);
     }
@@ -283,8 +275,8 @@ void kbdFindInputDevice (void)
     {
         if (!strncmp (tok, "event", 5))
         {
-            sprintf (kbdDevice, "/dev/input/%s", tok);
-            printf ("Found kbd input dev %s\n", kbdDevice);
+            sprintf (machine->kbd.device, "/dev/input/%s", tok);
+            printf ("Found kbd input dev %s\n", machine->kbd.device);
             found = true;
         }
 
@@ -295,16 +287,100 @@ void kbdFindInputDevice (void)
         halt ("Can't find keyboard");
 }
 
+/*  Find a key by its name in the key map.  Space is named SPACE.
+ */
+static bool kbdKeyFind (const char *name, int *row, int *col)
+{
+    if (!strcmp (name, "SPACE"))
+        name = " ";
+
+    for (int i = 0; i < KBD_ROW; i++)
+        for (int j = 0; j < KBD_COL; j++)
+            if (keyMap[i][j] && keyMap[i][j][0] && !strcmp (keyMap[i][j], name))
+            {
+                *row = i;
+                *col = j;
+                return true;
+            }
+
+    return false;
+}
+
+/*  Read the next event from the key script.  Each line is the time in msec of
+ *  emulated time since power on, a key name from the key map and down or up.
+ *  Lines starting with # are comments.  The script is closed at the end.
+ */
+static void kbdScriptNext (void)
+{
+    KbdState *k = &machine->kbd;
+    char line[80];
+    char key[16];
+    char action[8];
+    int msec;
+
+    while (fgets (line, sizeof line, k->script))
+    {
+        if (line[0] == '#' || sscanf (line, "%d %15s %7s", &msec, key, action) != 3)
+            continue;
+
+        if (!kbdKeyFind (key, &k->scriptRow, &k->scriptCol))
+        {
+            printf ("Unknown key '%s' in key script\n", key);
+            continue;
+        }
+
+        k->scriptCycles = (uint64_t) msec * (TIMER_CLOCK_HZ / 1000);
+        k->scriptState = !strcmp (action, "down");
+        return;
+    }
+
+    fclose (k->script);
+    k->script = NULL;
+}
+
+/*  Read key events from a script instead of an input device.  Returns false if
+ *  the script can't be opened.
+ */
+bool kbdScript (const char *file)
+{
+    KbdState *k = &machine->kbd;
+
+    if (k->script)
+        fclose (k->script);
+
+    if ((k->script = fopen (file, "r")) == NULL)
+    {
+        printf ("Failed to open key script %s\n", file);
+        return false;
+    }
+
+    kbdScriptNext ();
+    return true;
+}
+
 void kbdPoll (void)
 {
+    KbdState *k = &machine->kbd;
     struct input_event ev;
     struct pollfd pfds[2];
     int n;
     int ret;
 
+    /*  Apply any scripted events that are due */
+    while (k->script && k->scriptCycles <= machine->timer.cycles)
+    {
+        mprintf (LVL_KBD, "KBD script %s %s\n", keyMap[k->scriptRow][k->scriptCol],
+                 k->scriptState ? "DOWN" : "UP");
+        k->keyState[k->scriptRow][k->scriptCol] = k->scriptState;
+        kbdScriptNext ();
+    }
+
+    if (k->fd == -1)
+        return;
+
     pfds[0].fd = 0;
     pfds[0].events = POLLIN;
-    pfds[1].fd = kbdFd;
+    pfds[1].fd = k->fd;
     pfds[1].events = POLLIN;
     ret = poll(pfds, 2, 0);
 
@@ -314,12 +390,12 @@ void kbdPoll (void)
     if (!(pfds[1].revents & POLLIN))
         return;
 
-    n = read (kbdFd, &ev, sizeof (ev));
+    n = read (k->fd, &ev, sizeof (ev));
 
     if (n < 0)
     {
         mprintf (LVL_KBD, "problem reading from device %s: %s\n",
-                kbdDevice, strerror (errno));
+                k->device, strerror (errno));
         kbdReopen ();
         return;
     }
@@ -336,36 +412,44 @@ void kbdPoll (void)
 
 int kbdGet (int row, int col)
 {
-    if (keyState[row][col] != lastState[row][col])
+    KbdState *k = &machine->kbd;
+
+    if (k->keyState[row][col] != k->lastState[row][col])
     {
-        mprintf (LVL_KBD, "%s scan row/col %d/%d = %d\n", __func__, row, col, keyState[row][col]);
-        lastState[row][col] = keyState[row][col];
+        mprintf (LVL_KBD, "%s scan row/col %d/%d = %d\n", __func__, row, col, k->keyState[row][col]);
+        k->lastState[row][col] = k->keyState[row][col];
     }
 
-    return keyState[row][col];
+    return k->keyState[row][col];
 }
 
 void kbdClose (void)
 {
-    if (kbdFd != -1)
+    if (machine->kbd.fd != -1)
     {
         mprintf (LVL_KBD, "%s closing\n", __func__);
-        close (kbdFd);
-        kbdFd = -1;
+        close (machine->kbd.fd);
+        machine->kbd.fd = -1;
+    }
+
+    if (machine->kbd.script)
+    {
+        fclose (machine->kbd.script);
+        machine->kbd.script = NULL;
     }
 }
 
 void kbdOpen (const char *device)
 {
     if (device)
-        strcpy (kbdDevice, device);
+        strcpy (machine->kbd.device, device);
     else
         kbdFindInputDevice ();
 
-    kbdFd = -1;
+    machine->kbd.fd = -1;
     kbdReopen ();
 
-    mprintf (LVL_KBD, "%s dev %s opened as fd %d\n", __func__, kbdDevice, kbdFd);
+    mprintf (LVL_KBD, "%s dev %s opened as fd %d\n", __func__, machine->kbd.device, machine->kbd.fd);
 
 }
 
@@ -376,6 +460,7 @@ int main (int argc, char *argv[])
     const char *device = "/dev/input/event7";
     
     outputLevel = LVL_KBD;
+    machineSelect (machineCreate ());
 
     if (argc > 1)
         device = argv[1];
@@ -32,6 +32,7 @@ void kbdPoll (void);
 int kbdGet (int row, int col);
 void kbdClose (void);
 void kbdOpen (const char *device);
+bool kbdScript (const char *file);
 bool kbdColumnUpdate (int index, uint8_t value);
 bool kbdAlphaLock (int index, uint8_t value);
 
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ *  Creates and selects machines, and loads the ROM and GROM images they share.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "trace.h"
+#include "sound.h"
+#include "cartridge.h"
+#include "machine.h"
+
+#define IMAGE_CHIP_SIZE 0x2000
+
+thread_local Machine *machine;
+
+/*  Images are never freed as any machine may still be using them */
+typedef struct _image
+{
+    char *file;
+    int offset;
+    int len;
+    uint8_t *data;
+    struct _image *next;
+}
+image;
+
+static image *images;
+static pthread_mutex_t imageMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*  Allocate a powered off machine.  The caller must select it on the thread
+ *  that is to run it.
+ */
+Machine *machineCreate (void)
+{
+    Machine *m = new Machine ();
+
+    m->cart.minimemRam = m->cart.ram;
+    m->fdd.sectorsPerTrack = 9;
+    m->fdd.tracksPerSide = 40;
+    m->kbd.fd = -1;
+    m->timer.next = UINT64_MAX;
+    m->timer.throttle = true;
+    m->sound.latchedData = -1;
+    pthread_mutex_init (&m->sound.auxMutex, NULL);
+
+    return m;
+}
+
+void machineDestroy (Machine *m)
+{
+    Machine *current = machine;
+
+    /*  Stop anything still running on behalf of the machine */
+    machine = m;
+    soundClose ();
+    kbdClose ();
+    cartridgeClose ();
+
+    if (m->fdd.diskFile)
+        fclose (m->fdd.diskFile);
+
+    machine = (current == m) ? NULL : current;
+
+    pthread_mutex_destroy (&m->sound.auxMutex);
+    delete m;
+}
+
+/*  Select the machine that the calling thread runs */
+void machineSelect (Machine *m)
+{
+    machine = m;
+}
+
+/*  Return a read-only image holding a ROM or GROM file.  The file is placed
+ *  offset bytes into a zero filled image of whole 8k chips and must end
+ *  within max bytes of the start.  The length of the file is returned in len.
+ *  A file is only read once, later loads of it at the same offset by any
+ *  machine get the same image.
+ */
+uint8_t *machineImageLoad (const char *file, int offset, int max, int *len)
+{
+    pthread_mutex_lock (&imageMutex);
+
+    image *i;
+
+    for (i = images; i; i = i->next)
+        if (i->offset == offset && !strcmp (i->file, file))
+            break;
+
+    if (!i)
+    {
+        FILE *fp;
+
+        if ((fp = fopen (file, "rb")) == NULL)
+        {
+            printf ("can't open ROM file '%s'\n", file);
+            halt ("image load");
+        }
+
+        fseek (fp, 0, SEEK_END);
+        int fileLen = ftell (fp);
+        fseek (fp, 0, SEEK_SET);
+
+        if (offset + fileLen > max)
+        {
+            printf ("%s file len %d too big for offset %04X\n", __func__, fileLen, offset);
+            halt ("image too big");
+        }
+
+        int size = (offset + fileLen + IMAGE_CHIP_SIZE - 1) & ~(IMAGE_CHIP_SIZE - 1);
+
+        i = (image*) calloc (1, sizeof (image));
+
+        if (!i || (i->data = (uint8_t*) calloc (size ? size : IMAGE_CHIP_SIZE, 1)) == NULL)
+            halt ("image allocate");
+
+        if ((int) fread (i->data + offset, 1, fileLen, fp) != fileLen)
+        {
+            printf ("%s read failed\n", file);
+            halt ("image read");
+        }
+
+        fclose (fp);
+
+        i->file = strdup (file);
+        i->offset = offset;
+        i->len = fileLen;
+        i->next = images;
+        images = i;
+    }
+
+    pthread_mutex_unlock (&imageMutex);
+
+    *len = i->len;
+    return i->data;
+}
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __MACHINE_H
+#define __MACHINE_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "cassette.h"
+#include "fdd.h"
+#include "kbd.h"
+#include "sound.h"
+
+/*  State of one emulated console.  Everything a running console can change
+ *  lives here so that several consoles can run in one process, each on its own
+ *  thread.  The modules that emulate the hardware work on the machine selected
+ *  for the calling thread.  Read-only ROM and GROM images aren't part of a
+ *  machine, they are loaded once and shared by every machine that uses them.
+ */
+
+#define BANKS_DEVICE    16
+#define BANKS_CARTRIDGE 64 // Up to 512KiB banked cartridge ROM
+#define DEVICE_WINDOWS  16
+
+/*  Flat map of the address space in 256 byte pages.  Pages of plain memory
+ *  have host pointers to the start of the page for direct reads and writes.
+ *  If a pointer is NULL, the access goes through the handler for the memory
+ *  mapped there.
+ */
+typedef struct
+{
+    uint8_t *read;
+    uint8_t *write;
+}
+MemPage;
+
+/*  A window of memory mapped I/O in a device ROM */
+typedef struct
+{
+    uint16_t addr;
+    uint16_t size;
+    uint16_t (*read) (uint16_t addr, int size);
+    void (*write) (uint16_t addr, uint16_t data, int size);
+}
+memDeviceWindow;
+
+typedef struct _memMap
+{
+    int addr;
+    int mask;
+    struct _memMap *submap;
+    int bits;
+    unsigned char *data;
+    uint16_t (*readHandler)(uint8_t* ptr, uint16_t addr, int size);
+    void (*writeHandler)(uint8_t* ptr, uint16_t addr, uint16_t value, int size);
+}
+memMap;
+
+typedef struct
+{
+    MemPage page[0x100];
+    memMap mapMmio[8];
+    memMap mapCart[2];
+    memMap mapExpn[8];
+    memMap mapMain[8];
+    unsigned char ram[0x8000];
+    unsigned char scratch[0x100];
+    unsigned char romCartridge[BANKS_CARTRIDGE][0x2000];
+    unsigned char *romConsole;
+    unsigned char *romDevice[BANKS_DEVICE];
+    unsigned char *mmapRegion;
+    int deviceSelected;
+    int deviceMapped;   // Device ROM bank mapped at >4000
+
+    /*  Memory mapped I/O windows registered by devices in their ROM space, and
+     *  for each device which window, if any, is in each 256 byte page */
+    memDeviceWindow deviceWindow[DEVICE_WINDOWS];
+    int deviceWindowCount;
+    memDeviceWindow *deviceMmio[BANKS_DEVICE][0x20];
+
+    /*  Number of watches on each word and on each page.  Pages with a watch
+     *  are written through memWrite so that writes to watched words can be
+     *  flagged.
+     */
+    uint8_t watchWordCount[0x8000];
+    uint16_t watchPageCount[0x100];
+    bool watchHit;
+    void (*remapCallback) (void *arg);
+    void *remapArg;
+}
+MemState;
+
+#define SAMS_PAGES      256
+
+typedef struct
+{
+    uint8_t memory[SAMS_PAGES][0x1000];
+    uint8_t reg[16];
+    bool mapping;
+}
+SamsState;
+
+typedef struct
+{
+    uint8_t *image;
+    int len;
+    int mapper;
+
+    /*  How the image was allocated, CART_IMAGE_*, so that it can be released
+     *  when it is replaced */
+    int imageAlloc;
+
+    /*  Lower 4k for the MBX mapper, a copy of the start of the image with RAM
+     *  at >6C00.  Also used as the RAM for minimem unless it is mapped to a
+     *  file */
+    uint8_t low[0x1000];
+    uint8_t ram[0x1000];
+    uint8_t *minimemRam;
+}
+CartState;
+
+#define VDP_MAX_ADDR    0x8002
+#define VDP_XSIZE       256
+#define VDP_YSIZE       192
+#define VDP_NAMES       960     // Name table entries in text mode
+#define VDP_GROUPS      768     // 8 byte pattern or colour groups in bitmap mode
+
+typedef struct
+{
+    uint16_t addr;
+    int cmdInProg;
+    int mode;
+    uint8_t reg[8];
+    uint8_t cmd;
+    uint8_t st;
+    uint8_t ram[VDP_MAX_ADDR];
+    bool graphics;  // Drawing to the display window
+
+    /*  Changes since the display was last drawn.  Name table entries and 8
+     *  byte groups of the pattern and colour tables that have been written
+     *  and register changes, which change everything.  dirty is set by any
+     *  of them and by writes to the sprite tables.
+     */
+    bool nameDirty[VDP_NAMES];
+    bool patternDirty[VDP_GROUPS];
+    bool colourDirty[VDP_GROUPS];
+    bool allDirty;
+    bool dirty;
+
+    /*  Characters as last drawn, lines that had sprites drawn on them and the
+     *  colours of each line as last output to the framebuffer */
+    uint8_t tiles[VDP_YSIZE][VDP_XSIZE];
+    bool spriteLine[VDP_YSIZE];
+    uint8_t screen[VDP_YSIZE][VDP_XSIZE];
+}
+VdpState;
+
+/*  GROM is addressed in 8k chips, each pointing into a shared image */
+#define GROM_CHIPS      8
+
+typedef struct
+{
+    uint16_t addr;
+    uint8_t lowByteGet;
+    uint8_t lowByteSet;
+    uint8_t *chip[GROM_CHIPS];
+}
+GromState;
+
+#define MAX_CRU_BIT     4096
+
+typedef struct
+{
+    uint8_t state;
+
+    /*  All pins power up as inputs.  Outputting a value to a pin changes it to
+     *  an output until the next reset.  The last value output is kept even if
+     *  the output callback absorbs it.
+     */
+    bool isOutput;
+    uint8_t output;
+
+    /*  Define an input callback to be called when an entity external to the
+     *  CPU modifies a CRU bit.  The callback should return true if the change
+     *  is to be accepted.
+     */
+    bool (*inputCallback) (int index, uint8_t state);
+
+    /*  Define a callback to be called when software tries to modify a bit.
+     *  The callback should return true if it has absorbed the change and the
+     *  bit should not be modified or false is the change should be stored.
+     */
+    bool (*outputCallback) (int index, uint8_t state);
+
+    /*  Define a read callback that is called when software reads a bit.  The
+     *  current state of the bit is passed as a parameter. The read function
+     *  may accept this value and return it, or over-ride it with its own value
+     *  and return that instead.
+     */
+    uint8_t (*readCallback) (int index, uint8_t state);
+}
+CruBit;
+
+typedef struct
+{
+    CruBit bit[MAX_CRU_BIT];
+
+    /*  Count of outputs that changed a bit from the last value output to it */
+    uint32_t outputChanges;
+}
+CruState;
+
+typedef struct
+{
+    int intDisabled[16];
+    bool timerMode;
+    int timer;
+    int timerSnapshot;
+
+    /*  Bitmask of interrupt inputs that are active and enabled.  Kept up to
+     *  date as inputs and enables change so the CPU only needs to test it
+     *  after each instruction.
+     */
+    uint16_t pending;
+}
+Tms9901State;
+
+#define MAX_TIMERS 4
+
+typedef struct
+{
+    uint64_t when;
+    int cycles;
+    void (*callback) (void);
+    bool running;
+}
+TimerEvent;
+
+typedef struct
+{
+    TimerEvent event[MAX_TIMERS];
+    uint64_t cycles;
+    uint64_t next;
+
+    /*  Binary heap of running timer indices, soonest first */
+    int heap[MAX_TIMERS];
+    int heapCount;
+    int heapPos[MAX_TIMERS];
+
+    bool throttle;
+    uint64_t throttleBaseNsec;
+    uint64_t throttleBaseCycles;
+}
+TimerState;
+
+typedef struct
+{
+    uint8_t command;
+    uint8_t data;
+    uint8_t sector;
+    uint8_t track;
+    uint8_t unit;
+    uint8_t side;
+    uint8_t *buffer;
+    int bufferLen;
+    int bufferPos;
+    uint8_t status;
+    bool direction; // true = inward
+    bool ignoreIRQ;
+    bool motorStrobe;
+    uint8_t diskId[6];
+    uint8_t diskSector[DISK_BYTES_PER_SECTOR];
+    int sectorsPerTrack;
+    int tracksPerSide;
+
+    /*  Declare one extra drive handler as drives are numbered 1 to 3 and 0
+     *  means no drive selected */
+    fddHandler driveHandler[DISK_DRIVE_COUNT+1];
+
+    /*  Sector dump file of the selected drive.  Only one drive can be selected
+     *  at a time */
+    FILE *diskFile;
+}
+FddState;
+
+typedef struct
+{
+    int fd;
+    char device[256];
+
+    /*  Maintain a current and previous table of key states.  The lastState
+     *  table is only used to reduce debug output.
+     */
+    int keyState[KBD_ROW][KBD_COL];
+    int lastState[KBD_ROW][KBD_COL];
+    bool alphaLock;
+    int column;
+
+    /*  Key script and the next event read from it */
+    FILE *script;
+    uint64_t scriptCycles;
+    int scriptRow;
+    int scriptCol;
+    int scriptState;
+}
+KbdState;
+
+#define SOUND_AUX_FIFO  (441*50) // 50 lots of 10 msec at 44,100Hz
+
+typedef struct
+{
+    int requestedPeriod;
+    int period;
+    int shift;
+    double angle;
+    int counter;
+    int requestedAmplitude;
+    int amplitude;
+    int whiteNoise;
+    int useTone3Freq;
+}
+toneInfo;
+
+typedef struct
+{
+    toneInfo tones[4];
+    int latchedData;
+
+    /*  Auxilliary samples, written by the CPU thread and read by the audio
+     *  thread */
+    short aux[SOUND_AUX_FIFO];
+    int auxHead;
+    int auxTail;
+    pthread_mutex_t auxMutex;
+
+    /*  Sink being played to and its handle, eg. a pulse audio stream */
+    const soundSink *sink;
+    void *sinkHandle;
+    bool threadRunning;
+    pthread_t thread;
+}
+SoundState;
+
+typedef struct
+{
+    MemState mem;
+    SamsState sams;
+    CartState cart;
+    VdpState vdp;
+    GromState grom;
+    CruState cru;
+    Tms9901State tms9901;
+    TimerState timer;
+    FddState fdd;
+    KbdState kbd;
+    SoundState sound;
+    Cassette cassette;
+}
+Machine;
+
+/*  The machine the calling thread is running */
+extern thread_local Machine *machine;
+
+Machine *machineCreate (void);
+void machineDestroy (Machine *m);
+void machineSelect (Machine *m);
+uint8_t *machineImageLoad (const char *file, int offset, int max, int *len);
+
+#endif
@@ -37,42 +37,30 @@
 #include "grom.h"
 #include "vdp.h"
 #include "speech.h"
-#include "fdd.h"
-#include "sams.h"
+#include "cru.h"
+#include "cartridge.h"
 
-typedef struct _memMap
-{
-    int addr;
-    int mask;
-    struct _memMap *submap;
-    int bits;
-    unsigned char *data;
-    uint16_t (*readHandler)(uint8_t* ptr, uint16_t addr, int size);
-    void (*writeHandler)(uint8_t* ptr, uint16_t addr, uint16_t value, int size);
-}
-memMap;
-
-unsigned char ram[0x8000];
-unsigned char romConsole[0x2000];
-unsigned char romDevice[BANKS_DEVICE][0x2000];
-unsigned char romCartridge[BANKS_CARTRIDGE][0x2000];
-unsigned char scratch[0x100];
-static unsigned char *mmapRegion;
-static int deviceSelected;
+/*  An empty ROM for device banks and the console ROM until one is loaded */
+static unsigned char romEmpty[0x2000];
 
 static uint16_t dataRead (uint8_t *data, uint16_t addr, int size);
 static void dataWrite (uint8_t *data, uint16_t addr, uint16_t value, int size);
 static uint16_t invalidRead (uint8_t *data, uint16_t addr, int size);
 static void invalidWrite (uint8_t *data, uint16_t addr, uint16_t value, int size);
-static void mmapWrite (uint8_t *data, uint16_t addr, uint16_t value, int size);
-static void bankSelect (uint8_t *data, uint16_t addr, uint16_t value, int size);
+static void cartWriteLow (uint8_t *data, uint16_t addr, uint16_t value, int size);
+static void cartWriteHigh (uint8_t *data, uint16_t addr, uint16_t value, int size);
 uint16_t deviceRead (uint8_t *ptr, uint16_t addr, int size);
 void deviceWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size);
+static void memPageMap (int first, int last);
+
+/*  The memory map of every machine is copied from these by memInit, which
+ *  points the entries for memory and submaps into the machine.
+ */
 
 /*  Memory mapped I/O region.  0x2000 in size with 0x400 byte pages */
-memMap mapMmio[] =
+static const memMap mapMmio[] =
 {
-    { 0x8000, 0x00FF, NULL, 0, scratch, dataRead, dataWrite }, // Scratch pad RAM
+    { 0x8000, 0x00FF, NULL, 0, NULL   , dataRead, dataWrite }, // Scratch pad RAM
     { 0x8400, 0x00FF, NULL, 0, NULL   , soundRead, soundWrite }, // Sound device
     { 0x8800, 0x0003, NULL, 0, NULL   , vdpRead, invalidWrite }, // VDP Read
     { 0x8C00, 0x0003, NULL, 0, NULL   , invalidRead, vdpWrite }, // VDP Write
@@ -82,46 +70,63 @@ memMap mapMmio[] =
     { 0x9C00, 0x0003, NULL, 0, NULL   , invalidRead, gromWrite }, // GROM Write
 };
 
-/*  Cartridge area.  Split into two 4k blocks for minimem */
-memMap mapCart[] =
+/*  Cartridge area.  Split into two 4k blocks which are mapped by the cartridge
+ *  mapper */
+static const memMap mapCart[] =
 {
-    { 0x6000, 0x0FFF, NULL, 0, romCartridge[0], dataRead, bankSelect }, // Cartridge ROM
-    { 0x7000, 0x0FFF, NULL, 0, &romCartridge[0][0x1000], dataRead, mmapWrite }, // Cartridge ROM
+    { 0x6000, 0x0FFF, NULL, 0, NULL, dataRead, cartWriteLow }, // Cartridge ROM
+    { 0x7000, 0x0FFF, NULL, 0, NULL, dataRead, cartWriteHigh }, // Cartridge ROM
+};
+
+/*  32k expansion RAM in 4k pages so that the SAMS card can remap each one.
+ *  Pages are >2000, >3000 then >A000 thru >F000.
+ */
+static const memMap mapExpn[] =
+{
+    { 0x2000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0x3000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0xA000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0xB000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0xC000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0xD000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0xE000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite },
+    { 0xF000, 0x0FFF, NULL, 0, NULL, dataRead, dataWrite }
 };
 
 /*  Main memory map in 8k pages */
-memMap mapMain[] =
+static const memMap mapMain[] =
 {
-    { 0x0000, 0x1FFF, NULL,     0, romConsole, dataRead, invalidWrite }, // Console ROM
-    { 0x2000, 0x1FFF, NULL,     0, &ram[0x0000], dataRead, dataWrite }, // 32k Expn low
-    { 0x4000, 0x1FFF, NULL,     0, romDevice[0], deviceRead, deviceWrite }, // Device ROM (selected by CRU)
-    { 0x6000, 0x1FFF, mapCart, 12, NULL, NULL, NULL }, // Cartridge ROM
-    { 0x8000, 0x1FFF, mapMmio, 10, NULL, NULL, NULL }, // MMIO + scratchpad
-    { 0xA000, 0x1FFF, NULL,     0, &ram[0x2000], dataRead, dataWrite }, //
-    { 0xC000, 0x1FFF, NULL,     0, &ram[0x4000], dataRead, dataWrite }, // + 32k expn high
-    { 0xE000, 0x1FFF, NULL,     0, &ram[0x6000], dataRead, dataWrite }  //
+    { 0x0000, 0x1FFF, NULL, 0, NULL, dataRead, invalidWrite }, // Console ROM
+    { 0x2000, 0x1FFF, NULL, 12, NULL, NULL, NULL }, // 32k Expn low
+    { 0x4000, 0x1FFF, NULL, 0, NULL, deviceRead, deviceWrite }, // Device ROM (selected by CRU)
+    { 0x6000, 0x1FFF, NULL, 12, NULL, NULL, NULL }, // Cartridge ROM
+    { 0x8000, 0x1FFF, NULL, 10, NULL, NULL, NULL }, // MMIO + scratchpad
+    { 0xA000, 0x1FFF, NULL, 12, NULL, NULL, NULL }, //
+    { 0xC000, 0x1FFF, NULL, 12, NULL, NULL, NULL }, // + 32k expn high
+    { 0xE000, 0x1FFF, NULL, 12, NULL, NULL, NULL }  //
 };
 
 /*  Read a device ROM.  Some devices have memory mapped I/O in their ROM address
- *  space.  TODO add a process for devices to register this MMIO
+ *  space which they register with memDeviceRegister.
  */
 uint16_t deviceRead (uint8_t *ptr, uint16_t addr, int size)
 {
-    if (deviceSelected == 1 && (addr&0x1FF0)==0x1FF0)
-        return fddRead (addr&0xF, size);
+    MemState *m = &machine->mem;
+    memDeviceWindow *w = m->deviceMmio[m->deviceMapped][addr >> 8];
+
+    if (w && addr - w->addr < w->size)
+        return w->read (addr - w->addr, size);
 
     return dataRead (ptr, addr, size);
 }
 
 void deviceWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
 {
-    if (deviceSelected == 1 && (addr&0x1FF0)==0x1FF0)
-        fddWrite (addr&0xF, data, size);
-    else if (deviceSelected == 14) // SAMS card - paging TODO
-    {
-        printf ("SAMS write %04X to %04X\n", data, addr);
-        dataWrite (ptr, addr, data, size);
-    }
+    MemState *m = &machine->mem;
+    memDeviceWindow *w = m->deviceMmio[m->deviceMapped][addr >> 8];
+
+    if (w && addr - w->addr < w->size)
+        w->write (addr - w->addr, data, size);
     else
         invalidWrite (ptr, addr, data, size);
 }
@@ -165,76 +170,82 @@ static void invalidWrite (uint8_t *data, uint16_t addr, uint16_t value, int size
     printf ("ignore Invalid Write %04X to %04X\n", value, addr);
 }
 
-static void mmapWrite (uint8_t *data, uint16_t addr, uint16_t value, int size)
+/*  Writes to cartridge ROM are passed to the mapper to select banks */
+static void cartWriteLow (uint8_t *data, uint16_t addr, uint16_t value, int size)
 {
-    if (!mmapRegion)
-    {
-        printf ("Invalid Write unmapped %04X to %04X\n", value, addr);
-        halt ("invalid write");
-    }
-
-    dataWrite (mmapRegion, addr, value, size);
+    cartridgeWrite (addr, value, size);
 }
 
-/*  Select ROM in a cartridge with multiple ROMs.  This is crude for now and
- *  just follows the EB scheme where a write to address >6002 selects the second
- *  ROM.  Addr is relative to 0x6000
- */
-static void bankSelect (uint8_t *data, uint16_t addr, uint16_t value, int size)
+static void cartWriteHigh (uint8_t *data, uint16_t addr, uint16_t value, int size)
 {
-
-    /*  Extended basic writes to addresses 0x0000 and 0x0002.  Pacman writes to
-     *  0x001C and 0x001E.  Can't find a standard way to select cartridge ROMs
-     *  so just checking the least significant 2 bits to cover these two caes.
-     *
-     *  for ghostbusters, looks like also writes to any even addr 0-0x20 so just
-     *  use that for now.  Will need new load commands in time or check extn.
-     */
-    #if 0
-    if ((addr & 3) == 2)
-        mapMain[3].data = romCartridge[1];
-    else
-        mapMain[3].data = romCartridge[0];
-    #endif
-    // int bank = (addr & 0x1E)>>1;
-    int bank = (addr & 0x7E)>>1;
-    mapMain[3].data = romCartridge[bank];
-
-    /*  TODO hack to over-ride minimum submap.  Fix this with options */
-    mapMain[3].submap = NULL;
-    mapMain[3].readHandler = dataRead;
-    mapMain[3].writeHandler = bankSelect;
-    // mapCart[0].data = romCartridge[bank];
-    // mapCart[1].data = &romCartridge[bank][0x1000];
-
-    mprintf (LVL_CONSOLE, "Bank Write %04X to %04X, bank=%d=%p Data=%02X %02X\n",
-             value, addr, bank,
-             mapMain[3].data,
-             mapMain[3].data[0], mapMain[3].data[1]);
+    cartridgeWrite (addr + 0x1000, value, size);
 }
 
 bool memDeviceRomSelect (int index, uint8_t state)
 {
+    MemState *m = &machine->mem;
+
     /*  Devices are selected through CRU bits >1000 thru >1F00.  Divided by 2 is
      *  >800 thru >F80.  We convert this to 0-15
      */
-    deviceSelected = (index & 0x780) >> 7;
+    m->deviceSelected = (index & 0x780) >> 7;
 
-    mprintf (LVL_CONSOLE, "Select device ROM %d state %d\n", deviceSelected, state);
+    mprintf (LVL_CONSOLE, "Select device ROM %d state %d\n", m->deviceSelected, state);
 
     /*  For now, assume device 0 means no device */
-    if (state == 0)
-        mapMain[2].data = romDevice[0];
-    else
-        mapMain[2].data = romDevice[deviceSelected];
+    m->deviceMapped = state ? m->deviceSelected : 0;
+    m->mapMain[2].data = m->romDevice[m->deviceMapped];
+
+    memPageMap (0x40, 0x5F);
 
     /*  Allow the bit state to be changed */
     return false;
 }
 
+/*  Register a device at CRU base cruBase (>1100 thru >1F00) with a window of
+ *  memory mapped I/O from addr to addr+size-1 in its ROM space at >4000.
+ *  Accesses to the window while the device is selected are passed to the
+ *  handlers with the offset into the window.  Setting CRU bit 0 of the device
+ *  selects it and clearing it deselects it.  Device 0 at >1000 is taken to
+ *  mean no device is selected so can't have a window.
+ */
+void memDeviceRegister (uint16_t cruBase, uint16_t addr, uint16_t size,
+                        uint16_t (*read) (uint16_t addr, int size),
+                        void (*write) (uint16_t addr, uint16_t data, int size))
+{
+    MemState *m = &machine->mem;
+    int index = cruBase >> 1;
+    int device = (index & 0x780) >> 7;
+
+    if (cruBase < 0x1100 || cruBase > 0x1F00 || addr < 0x4000 ||
+        addr + size > 0x6000 || m->deviceWindowCount == DEVICE_WINDOWS)
+    {
+        printf ("CRU base %04X addr %04X size %04X\n", cruBase, addr, size);
+        halt ("invalid device registration");
+    }
+
+    memDeviceWindow *w = &m->deviceWindow[m->deviceWindowCount++];
+
+    w->addr = addr - 0x4000;
+    w->size = size;
+    w->read = read;
+    w->write = write;
+
+    for (int page = w->addr >> 8; page <= (w->addr + size - 1) >> 8; page++)
+    {
+        if (m->deviceMmio[device][page])
+            halt ("device MMIO windows overlap");
+
+        m->deviceMmio[device][page] = w;
+    }
+
+    cruOutputCallbackSet (index, memDeviceRomSelect);
+    memPageMap (0x40, 0x5F);
+}
+
 static memMap *memMapEntry (int addr)
 {
-    memMap *m = &mapMain[addr>>13];
+    memMap *m = &machine->mem.mapMain[addr>>13];
 
     while (1)
     {
@@ -248,6 +259,145 @@ static memMap *memMapEntry (int addr)
     return m;
 }
 
+/*  Update the page table entries for a range of pages from the memory map.
+ *  Pages that are read or written by the plain data handlers get a host
+ *  pointer to the memory so that they can be accessed directly.  Must be
+ *  called for any pages whose mapping is changed.
+ */
+static void memPageMap (int first, int last)
+{
+    MemState *mem = &machine->mem;
+
+    for (int page = first; page <= last; page++)
+    {
+        uint16_t addr = page << 8;
+        memMap *p = memMapEntry (addr);
+        uint8_t *data = p->data ? p->data + (addr & p->mask) : NULL;
+        MemPage *m = &mem->page[page];
+
+        m->read = NULL;
+        m->write = NULL;
+
+        /*  Pages of device ROM holding memory mapped I/O can't be read directly
+         */
+        if (p->readHandler == dataRead ||
+            (p->readHandler == deviceRead && !mem->deviceMmio[mem->deviceMapped][page & 0x1F]))
+            m->read = data;
+
+        if (p->writeHandler == dataWrite && !mem->watchPageCount[page])
+            m->write = data;
+    }
+
+    if (mem->remapCallback)
+        mem->remapCallback (mem->remapArg);
+}
+
+/*  Build the memory map of the selected machine from the templates */
+void memInit (void)
+{
+    MemState *m = &machine->mem;
+
+    memcpy (m->mapMmio, mapMmio, sizeof (mapMmio));
+    memcpy (m->mapCart, mapCart, sizeof (mapCart));
+    memcpy (m->mapExpn, mapExpn, sizeof (mapExpn));
+    memcpy (m->mapMain, mapMain, sizeof (mapMain));
+
+    if (!m->romConsole)
+        m->romConsole = romEmpty;
+
+    for (int i = 0; i < BANKS_DEVICE; i++)
+        if (!m->romDevice[i])
+            m->romDevice[i] = romEmpty;
+
+    m->mapMmio[0].data = m->scratch;
+    m->mapCart[0].data = m->romCartridge[0];
+    m->mapCart[1].data = &m->romCartridge[0][0x1000];
+
+    for (int i = 0; i < 8; i++)
+        m->mapExpn[i].data = &m->ram[i * 0x1000];
+
+    m->mapMain[0].data = m->romConsole;
+    m->mapMain[1].submap = &m->mapExpn[0];
+    m->mapMain[2].data = m->romDevice[0];
+    m->mapMain[3].submap = m->mapCart;
+    m->mapMain[4].submap = m->mapMmio;
+    m->mapMain[5].submap = &m->mapExpn[2];
+    m->mapMain[6].submap = &m->mapExpn[4];
+    m->mapMain[7].submap = &m->mapExpn[6];
+
+    memPageMap (0x00, 0xFF);
+}
+
+/*  Set a function to be called whenever the memory mapped at any address
+ *  changes */
+void memRemapCallbackSet (void (*callback) (void *arg), void *arg)
+{
+    machine->mem.remapCallback = callback;
+    machine->mem.remapArg = arg;
+}
+
+/*  Map a 4k page of host memory into the 32k expansion area at addr.  Only the
+ *  page table entries for the 4k page are updated, the memory isn't copied.
+ */
+void memExpansionMap (uint16_t addr, uint8_t *data)
+{
+    memMap *p = memMapEntry (addr);
+
+    if (p->readHandler != dataRead || p->writeHandler != dataWrite)
+        halt ("map into non-RAM address");
+
+    p->data = data;
+    memPageMap ((addr >> 8) & 0xF0, (addr >> 8) | 0x0F);
+}
+
+/*  Map 4k of host memory into the cartridge area at addr.  If ram is false,
+ *  writes are passed to the cartridge mapper.
+ */
+void memCartridgeMap (uint16_t addr, uint8_t *data, bool ram)
+{
+    memMap *p = &machine->mem.mapCart[(addr >> 12) & 1];
+
+    p->data = data;
+
+    if (ram)
+        p->writeHandler = dataWrite;
+    else
+        p->writeHandler = (addr & 0x1000) ? cartWriteHigh : cartWriteLow;
+
+    memPageMap ((addr >> 8) & 0xF0, (addr >> 8) | 0x0F);
+}
+
+/*  Return an identifier for the memory currently mapped at an address.  This
+ *  changes whenever a different bank is selected so that the CPU can discard
+ *  any code it has cached from the old bank.  Memory mapped I/O can't hold code
+ *  so return -1 for it.
+ */
+intptr_t memBank (uint16_t addr)
+{
+    uint8_t *data = machine->mem.page[addr >> 8].read;
+
+    if (!data)
+        return -1;
+
+    return (intptr_t) data;
+}
+
+/*  Return a host pointer to the byte at addr if it is plain RAM that can be
+ *  read and written directly without going through a handler, or NULL.
+ */
+uint8_t *memHostPtr (uint16_t addr)
+{
+    MemPage *m = &machine->mem.page[addr >> 8];
+
+    if (!m->read || m->read != m->write)
+        return NULL;
+
+    return m->read + (addr & 0xFF);
+}
+
+/*  Access memory through the handler for the address.  Used for pages that
+ *  can't be accessed directly.
+ */
 uint16_t memRead(uint16_t addr, int size)
 {
     memMap *p = memMapEntry (addr);
@@ -256,28 +406,68 @@ uint16_t memRead(uint16_t addr, int size)
 
 void memWrite(uint16_t addr, uint16_t data, int size)
 {
+    MemState *m = &machine->mem;
     memMap *p = memMapEntry (addr);
     p->writeHandler (p->data, addr & p->mask, data, size);
-}
 
-uint16_t memReadB(uint16_t addr)
-{
-    return memRead (addr, 1);
+    if (m->watchPageCount[addr >> 8] && m->watchWordCount[addr >> 1])
+        m->watchHit = true;
 }
 
-void memWriteB(uint16_t addr, uint8_t data)
+/*  Add or remove a watch on the word at addr.  The watch hit flag of the
+ *  machine is set whenever the word is written.
+ */
+void memWatchAdd (uint16_t addr)
 {
-    return memWrite (addr, data, 1);
+    machine->mem.watchWordCount[addr >> 1]++;
+
+    if (machine->mem.watchPageCount[addr >> 8]++ == 0)
+        memPageMap (addr >> 8, addr >> 8);
 }
 
-uint16_t memReadW(uint16_t addr)
+void memWatchRemove (uint16_t addr)
 {
-    return memRead (addr, 2);
+    if (!machine->mem.watchWordCount[addr >> 1])
+        return;
+
+    machine->mem.watchWordCount[addr >> 1]--;
+
+    if (--machine->mem.watchPageCount[addr >> 8] == 0)
+        memPageMap (addr >> 8, addr >> 8);
 }
 
-void memWriteW(uint16_t addr, uint16_t data)
+/*  The console ROM and device ROMs are read-only so one image of each file is
+ *  shared by every machine that loads it */
+static int memRomLoad (char *file, uint16_t addr, int bank)
 {
-    return memWrite (addr, data, 2);
+    MemState *m = &machine->mem;
+    int len;
+    uint8_t *data = machineImageLoad (file, 0, ROM_FILE_SIZE, &len);
+
+    printf("%s %s %x %x %d\n", __func__, file, addr, len, bank);
+
+    if (addr == 0x0000)
+    {
+        m->romConsole = data;
+        m->mapMain[0].data = data;
+        memPageMap (0x00, 0x1F);
+    }
+    else
+    {
+        if (bank < 0 || bank >= BANKS_DEVICE)
+            halt ("invalid device ROM bank");
+
+        m->romDevice[bank] = data;
+
+        /*  Replace the bank in the map if it is selected */
+        if (bank == m->deviceMapped)
+        {
+            m->mapMain[2].data = data;
+            memPageMap (0x40, 0x5F);
+        }
+    }
+
+    return len;
 }
 
 /*  Load a file into memory.  If loading to 0x6000 and the file is larger than
@@ -287,6 +477,9 @@ int memLoad (char *file, uint16_t addr, int bank)
 {
     FILE *fp;
 
+    if (addr == 0x0000 || addr == 0x4000)
+        return memRomLoad (file, addr, bank);
+
     if ((fp = fopen (file, "rb")) == NULL)
     {
         printf ("can't open ROM bin file '%s'\n", file);
@@ -305,13 +498,8 @@ int memLoad (char *file, uint16_t addr, int bank)
 
     if (addr == 0x6000)
     {
-        data = romCartridge[bank];
-        max = BANKS_CARTRIDGE * 8192;
-    }
-    else if (addr == 0x4000)
-    {
-        data = romDevice[bank];
-        max = 8192;
+        data = machine->mem.romCartridge[bank];
+        max = (BANKS_CARTRIDGE - bank) * 8192;
     }
     else
     {
@@ -345,14 +533,30 @@ int memLoad (char *file, uint16_t addr, int bank)
         if (addr == 0x6000)
         {
             printf ("Cart bank %d=%p read %d bytes\n", bank,
-                    romCartridge[bank], got);
-            data = romCartridge[++bank];
+                    machine->mem.romCartridge[bank], got);
+            data = machine->mem.romCartridge[++bank];
         }
         else
             data += got;
     }
 
     fclose (fp);
+
+    /*  The image covers the banks loaded so far, including those from earlier
+     *  loads, so that a small cartridge wraps round its own banks */
+    if (addr == 0x6000)
+    {
+        int imageLen = bank * 8192;
+
+        if (machine->cart.image == machine->mem.romCartridge[0] &&
+            machine->cart.len > imageLen)
+            imageLen = machine->cart.len;
+
+        if (imageLen)
+            cartridgeImageSet (machine->mem.romCartridge[0], imageLen,
+                               CART_IMAGE_STATIC);
+    }
+
     return count;
 }
 
@@ -365,7 +569,7 @@ void memMapFile (const char *name, uint16_t addr, uint16_t size)
         halt ("unsupported mmap address");
     }
 
-    if (mmapRegion)
+    if (machine->mem.mmapRegion)
         halt ("mmap already mapped");
 
     int fd = open (name, O_RDWR);
@@ -376,29 +580,29 @@ void memMapFile (const char *name, uint16_t addr, uint16_t size)
         halt ("open failure");
     }
 
-    mmapRegion = (unsigned char*) mmap (NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    machine->mem.mmapRegion = (unsigned char*) mmap (NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
 
-    if (!mmapRegion)
+    if (!machine->mem.mmapRegion)
     {
         printf ("mmap failed to map %s len %d\n", name, size);
         halt ("mmap failure");
     }
 
     close (fd);
-    mapCart[1].data = mmapRegion;
+    cartridgeMinimemSet (machine->mem.mmapRegion);
     printf ("%s mapped\n", name);
 }
 
 void memCopy (uint8_t *copy, uint16_t addr, int bank)
 {
-    memMap *map = &mapMain[addr>>13];
+    memMap *map = memMapEntry (addr);
     uint8_t *data = map->data;
 
     if (addr == 0x6000 && bank == 1)
-        data = romCartridge[bank];
+        data = machine->mem.romCartridge[bank];
 
     if (addr == 0x4000)
-        data = romDevice[bank];
+        data = machine->mem.romDevice[bank];
 
     memcpy (data, copy, ROM_FILE_SIZE);
 }
@@ -415,9 +619,9 @@ void memPrintScratchMemory (uint16_t addr, int len)
         for (j = i; j < i + 16 && j < addr+len; j += 2)
         {
             if (len == 1)
-                printf ("%02X   ", scratch[j+1]);
+                printf ("%02X   ", machine->mem.scratch[j+1]);
             else
-                printf ("%02X%02X ", scratch[j], scratch[j+1]);
+                printf ("%02X%02X ", machine->mem.scratch[j], machine->mem.scratch[j+1]);
         }
 
         for (; j < i + 16; j += 2)
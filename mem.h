@@ -24,23 +24,92 @@
 #define __MEM_H
 
 #include "cpu.h"
+#include "machine.h"
 
 #define ROM_FILE_SIZE   0x2000
 
-#define BANKS_DEVICE    16
-#define BANKS_CARTRIDGE 64 // Up to 512KiB banked cartridge ROM
-
 uint16_t memRead(uint16_t addr, int size);
 void memWrite(uint16_t addr, uint16_t data, int size);
-uint16_t memReadW(uint16_t addr);
-void memWriteW(uint16_t addr, uint16_t data);
-uint16_t memReadB(uint16_t addr);
-void memWriteB(uint16_t addr, uint8_t data);
+void memInit (void);
+void memRemapCallbackSet (void (*callback) (void *arg), void *arg);
+void memExpansionMap (uint16_t addr, uint8_t *data);
+void memCartridgeMap (uint16_t addr, uint8_t *data, bool ram);
+void memWatchAdd (uint16_t addr);
+void memWatchRemove (uint16_t addr);
+void memDeviceRegister (uint16_t cruBase, uint16_t addr, uint16_t size,
+                        uint16_t (*read) (uint16_t addr, int size),
+                        void (*write) (uint16_t addr, uint16_t data, int size));
 int memLoad (char *file, uint16_t addr, int bank);
 void memMapFile (const char *name, uint16_t addr, uint16_t size);
 void memCopy (uint8_t *copy, uint16_t addr, int bank);
 void memPrintScratchMemory (uint16_t addr, int len);
 bool memDeviceRomSelect (int index, uint8_t state);
+intptr_t memBank (uint16_t addr);
+uint8_t *memHostPtr (uint16_t addr);
+
+/*  Wait states added by the multiplexer that splits each access to the 8-bit
+ *  memory bus into two byte accesses.  Only the console ROM and scratchpad
+ *  are on the 16-bit bus.
+ */
+#define MEM_WAIT_STATES 4
+
+static inline int memWaitStates (uint16_t addr)
+{
+    if (addr < 0x2000 || (addr >= 0x8000 && addr < 0x8400))
+        return 0;
+
+    return MEM_WAIT_STATES;
+}
+
+/*  Word accesses are always rounded down to a word boundary */
+static inline uint16_t memReadW(uint16_t addr)
+{
+    uint8_t *data = machine->mem.page[addr >> 8].read;
+
+    if (!data)
+        return memRead (addr, 2);
+
+    addr &= 0xFE;
+    return (data[addr] << 8) | data[addr + 1];
+}
+
+static inline void memWriteW(uint16_t addr, uint16_t value)
+{
+    uint8_t *data = machine->mem.page[addr >> 8].write;
+
+    if (!data)
+    {
+        memWrite (addr, value, 2);
+        return;
+    }
+
+    addr &= 0xFE;
+    data[addr] = value >> 8;
+    data[addr + 1] = value & 0xFF;
+}
+
+static inline uint16_t memReadB(uint16_t addr)
+{
+    uint8_t *data = machine->mem.page[addr >> 8].read;
+
+    if (!data)
+        return memRead (addr, 1);
+
+    return data[addr & 0xFF];
+}
+
+static inline void memWriteB(uint16_t addr, uint8_t value)
+{
+    uint8_t *data = machine->mem.page[addr >> 8].write;
+
+    if (!data)
+    {
+        memWrite (addr, value, 1);
+        return;
+    }
+
+    data[addr & 0xFF] = value;
+}
 
 #endif
 
@@ -43,6 +43,9 @@ int main (int argc, char *argv[])
         exit (1);
     }
 
+    machineSelect (machineCreate ());
+    memInit ();
+
     int len = memLoad (argv[1], addr, 0);
 
     if (argc > 3)
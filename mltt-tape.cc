@@ -40,6 +40,7 @@ using namespace std;
 #include "types.h"
 #include "wav.h"
 #include "cassette.h"
+#include "machine.h"
 #include "parse.h"
 #include "files.h"
 #include "tibasic.h"
@@ -420,6 +421,9 @@ int main (int argc, char *argv[])
     bool showRaw = false;
     bool tifiles = false;
 
+    /*  The cassette mixes its audio into the sound of the selected machine */
+    machineSelect (machineCreate ());
+
     while ((c = getopt(argc, argv, "c:e:vrwtz")) != -1)
     {
         switch (c)
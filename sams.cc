@@ -21,14 +21,85 @@
  */
 
 /*
- *  SuperAMS card emulator TODO
+ *  SuperAMS card emulator.  Provides up to 1M of RAM in 4k pages.  The card is
+ *  at CRU >1E00.  Bit 0 enables the mapper registers at >4000 thru >401F and
+ *  bit 1 switches from pass mode to mapping mode.  Each register holds the
+ *  page mapped into the corresponding 4k of the address space.  Only the 32k
+ *  expansion areas >2000 thru >3FFF and >A000 thru >FFFF are remapped.
  */
 
+#include <stdio.h>
+
+#include "types.h"
+#include "trace.h"
 #include "mem.h"
 #include "cru.h"
+#include "sams.h"
 
-void samsInit (void)
+#define SAMS_CRU_BASE   0x1E00
+
+static bool samsExpansion (int reg)
+{
+    return reg == 2 || reg == 3 || reg >= 10;
+}
+
+/*  Map the page for a register into the address space.  In pass mode each 4k
+ *  of the address space maps to the page with the same number.
+ */
+static void samsPageMap (int reg)
+{
+    if (!samsExpansion (reg))
+        return;
+
+    int page = machine->sams.mapping ? machine->sams.reg[reg] : reg;
+
+    memExpansionMap (reg << 12, machine->sams.memory[page]);
+}
+
+uint16_t samsRegisterRead (uint16_t addr, int size)
+{
+    uint8_t page = machine->sams.reg[(addr >> 1) & 0xF];
+
+    if (size == 2)
+        return (page << 8) | page;
+
+    return page;
+}
+
+/*  The page number is in the most significant byte of the register */
+void samsRegisterWrite (uint16_t addr, uint16_t data, int size)
 {
-    cruOutputCallbackSet (0xf00, memDeviceRomSelect);
+    int reg = (addr >> 1) & 0xF;
+
+    if (size == 2)
+        data >>= 8;
+    else if (addr & 1)
+        return;
+
+    machine->sams.reg[reg] = data;
+    mprintf (LVL_CONSOLE, "SAMS register %d page %02X\n", reg, data);
+
+    if (machine->sams.mapping)
+        samsPageMap (reg);
 }
 
+static bool samsModeSet (int index, uint8_t state)
+{
+    machine->sams.mapping = state;
+
+    for (int i = 0; i < 16; i++)
+        samsPageMap (i);
+
+    return false;
+}
+
+void samsInit (void)
+{
+    for (int i = 0; i < 16; i++)
+        machine->sams.reg[i] = i;
+
+    memDeviceRegister (SAMS_CRU_BASE, 0x4000, 0x20, samsRegisterRead, samsRegisterWrite);
+    cruOutputCallbackSet ((SAMS_CRU_BASE >> 1) + 1, samsModeSet);
+
+    samsModeSet ((SAMS_CRU_BASE >> 1) + 1, 0);
+}
@@ -24,6 +24,8 @@
 #define __SAMS_H
 
 void samsInit (void);
+uint16_t samsRegisterRead (uint16_t addr, int size);
+void samsRegisterWrite (uint16_t addr, uint16_t data, int size);
 
 #endif
 
@@ -22,7 +22,7 @@
 
 /*
  *  Emulate audio from the TMS9919 chip by generating samples and playing them
- *  through pulse audio.  Audio tones 1 thru 3 are straightforward but periodic
+ *  through a sound sink such as pulse audio.  Audio tones 1 thru 3 are straightforward but periodic
  *  and white noise are not as easy.  This guide has some useful info :
  *  https://www.smspower.org/Development/SN76489
  */
@@ -33,22 +33,20 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <pulse/simple.h>
 
 #include "types.h"
 #include "sound.h"
 #include "trace.h"
 #include "status.h"
+#include "machine.h"
+#include "timer.h"
+#include "wav.h"
 
 /*  The TMS9919 / SN76489 is designed to be clocked at this frequency.  We need
  *  this value to translate into audio frequencies.
  */
 #define CLOCK_FREQUENCY 111861
 
-/*  The frequency at which we are playing samples to pulse audio
- */
-#define AUDIO_FREQUENCY 44100
-
 /* At 44,100Hz we need to generate 882 samples per call as we are called every
  * 20msec.
  */
@@ -64,34 +62,12 @@
  *  to be played.  This is typically the cassette sound but could be anything.
  *  Only one source is supported though.
  */
-#define AUX_SAMPLE_FIFO (SAMPLE_COUNT*50)
+#define AUX_SAMPLE_FIFO SOUND_AUX_FIFO
 #define AUX_AMPLITUDE 8191
 
-typedef struct
-{
-    int requestedPeriod;
-    int period;
-    int shift;
-    double angle;
-    int counter;
-    int requestedAmplitude;
-    int amplitude;
-    int whiteNoise;
-    int useTone3Freq;
-}
-toneInfo;
-
-static short soundAux[AUX_SAMPLE_FIFO];
-static int soundAuxHead;
-static int soundAuxTail;
-
-static toneInfo tones[4];
-
 /*  XNOR truth table */
 int xnor[4] = { 1, 0, 0, 1 };
 
-static pthread_mutex_t soundAuxMutex = PTHREAD_MUTEX_INITIALIZER;
-
 static short generateTone (toneInfo *tone, bool noise)
 {
     short sample;
@@ -170,33 +146,35 @@ static short generateSample (void)
 
     /*  Generate data for each tone generator, index 3 is the noise generator */
     for (i = 0; i < 4; i++)
-        sample += generateTone (&tones[i], i == 3);
+        sample += generateTone (&machine->sound.tones[i], i == 3);
 
     return sample;
 }
 
-/*  Every 10 msec, generate data to feed pulse audio device using a combination
- *  from currently active tone and noise generators.
+/*  Every 10 msec, generate data to feed the sound sink using a combination
+ *  from currently active tone and noise generators.  Returns false if there is
+ *  nothing to play.
  */
-static bool soundUpdate (pa_simple *pulseAudioHandle)
+static bool soundUpdate (int16_t *sampleData)
 {
+    SoundState *snd = &machine->sound;
     int i;
     bool anyActive = false;
     bool auxAvailable = false;
 
     for (i = 0; i < 4; i++)
     {
-        anyActive = updateActiveToneGenerators (&tones[i]) || anyActive;
+        anyActive = updateActiveToneGenerators (&snd->tones[i]) || anyActive;
         
         /* Max amplitude of any channel is 8191 so we divide by 82 to give a
          * rough percentage for readibility 
          */
-        statusSoundUpdate (i, tones[i].amplitude / 82, tones[i].period);
+        statusSoundUpdate (i, snd->tones[i].amplitude / 82, snd->tones[i].period);
     }
 
-    pthread_mutex_lock (&soundAuxMutex);
-    int auxSampleCount = (AUX_SAMPLE_FIFO + soundAuxHead - soundAuxTail) % AUX_SAMPLE_FIFO;
-    pthread_mutex_unlock (&soundAuxMutex);
+    pthread_mutex_lock (&snd->auxMutex);
+    int auxSampleCount = (AUX_SAMPLE_FIFO + snd->auxHead - snd->auxTail) % AUX_SAMPLE_FIFO;
+    pthread_mutex_unlock (&snd->auxMutex);
 
     if (auxSampleCount >= SAMPLE_COUNT)
         auxAvailable = true;
@@ -206,20 +184,19 @@ static bool soundUpdate (pa_simple *pulseAudioHandle)
         return false;
     }
 
-    /*  Create an array of samples to play to pulse audio.    The values are
-     *  signed 16-bit so for one channels we have 2 bytes for sample.
+    /*  Fill the array of samples to play.  The values are signed 16-bit so
+     *  for one channels we have 2 bytes for sample.
      */
-    int16_t sampleData[SAMPLE_COUNT];
-    pthread_mutex_lock (&soundAuxMutex);
+    pthread_mutex_lock (&snd->auxMutex);
     for (i = 0; i < SAMPLE_COUNT; i++)
     {
         int16_t sample;
 
         if (auxAvailable)
         {
-            sample = soundAux[soundAuxTail];
-            soundAuxTail++;
-            soundAuxTail %= AUX_SAMPLE_FIFO;
+            sample = snd->aux[snd->auxTail];
+            snd->auxTail++;
+            snd->auxTail %= AUX_SAMPLE_FIFO;
         }
         else
             sample = generateSample ();
@@ -227,72 +204,170 @@ static bool soundUpdate (pa_simple *pulseAudioHandle)
         sampleData[i] = sample;
     }
 
-    pthread_mutex_unlock (&soundAuxMutex);
-    pa_simple_write (pulseAudioHandle, sampleData, 2*SAMPLE_COUNT, NULL);
+    pthread_mutex_unlock (&snd->auxMutex);
 
     return true;
 }
 
-static bool soundThreadRunning = false;
-static pthread_t audioThread;
-
+/*  Real time sinks block until they are ready for more samples so are fed by
+ *  an audio thread.  The thread plays the sound of the machine that started
+ *  it.
+ */
 static void *soundThread (void *arg)
 {
-    pa_simple *pulseAudioHandle = (pa_simple*) arg;
+    int16_t sampleData[SAMPLE_COUNT];
 
-    while (soundThreadRunning)
+    machineSelect ((Machine*) arg);
+
+    while (machine->sound.threadRunning)
     {
-        if (!soundUpdate (pulseAudioHandle))
+        if (soundUpdate (sampleData))
+            machine->sound.sink->write (sampleData, SAMPLE_COUNT);
+        else
             usleep (10000);
     }
 
     return NULL;
 }
 
+/*  Other sinks are fed every 10 msec of virtual time, with silence when
+ *  nothing is playing so that they stay in step with the emulation.
+ */
+static void soundTimer (void)
+{
+    int16_t sampleData[SAMPLE_COUNT];
+
+    if (!soundUpdate (sampleData))
+        memset (sampleData, 0, sizeof sampleData);
+
+    machine->sound.sink->write (sampleData, SAMPLE_COUNT);
+}
+
 /*  Add a sample to the auxilliary sample queue.  Since this may come from a
  *  different thread we apply a lock before manipulating head and tail pointers
  */
 void soundAuxData (int16_t sample)
 {
-    pthread_mutex_lock (&soundAuxMutex);
-    soundAux[soundAuxHead++] = sample;
-    soundAuxHead %= AUX_SAMPLE_FIFO;
-    pthread_mutex_unlock (&soundAuxMutex);
+    SoundState *snd = &machine->sound;
+
+    pthread_mutex_lock (&snd->auxMutex);
+    snd->aux[snd->auxHead++] = sample;
+    snd->auxHead %= AUX_SAMPLE_FIFO;
+    pthread_mutex_unlock (&snd->auxMutex);
+}
+
+/*  The file sink writes a 16-bit mono WAV file */
+static bool fileOpen (const char *name)
+{
+    WavFile *wav = new WavFile;
+
+    if (!name || !wav->openWrite (name, 16))
+    {
+        delete wav;
+        return false;
+    }
+
+    machine->sound.sinkHandle = wav;
+    return true;
+}
+
+static void fileWrite (const int16_t *samples, int count)
+{
+    WavFile *wav = (WavFile*) machine->sound.sinkHandle;
+
+    for (int i = 0; i < count; i++)
+        wav->writeSample (samples[i]);
 }
 
-void soundInit (void)
+static void fileClose (void)
 {
-    pa_simple *pulseAudioHandle;
-    static pa_sample_spec pulseAudioSpec;
-
-    pulseAudioSpec.format = PA_SAMPLE_S16NE;
-    pulseAudioSpec.channels = 1;
-    pulseAudioSpec.rate = AUDIO_FREQUENCY;
-
-    pulseAudioHandle = pa_simple_new(NULL,               // Use the default server.
-                      "TI99",           // Our application's name.
-                      PA_STREAM_PLAYBACK,
-                      NULL,               // Use the default device.
-                      "Games",            // Description of our stream.
-                      &pulseAudioSpec,                // Our sample format.
-                      NULL,               // Use default channel map
-                      NULL,               // Use default buffering attributes.
-                      NULL               // Ignore error code.
-                      );
-
-    if (pulseAudioHandle == NULL)
-        halt ("pulse audio handle");
-
-    soundThreadRunning = true;
-
-    if (pthread_create (&audioThread, NULL, soundThread, pulseAudioHandle) != 0)
+    WavFile *wav = (WavFile*) machine->sound.sinkHandle;
+
+    wav->close ();
+    delete wav;
+}
+
+soundSink soundSinkFile = { "file", false, fileOpen, fileWrite, fileClose };
+
+/*  The null sink discards sound, so nothing is generated */
+soundSink soundSinkNull = { "null", false, NULL, NULL, NULL };
+
+#define MAX_SINKS   4
+
+static soundSink *sinks[MAX_SINKS];
+static int sinkCount;
+
+/*  Make a sink available to soundInit.  The first registered is the default.
+ */
+void soundSinkRegister (soundSink *sink)
+{
+    if (sinkCount == MAX_SINKS)
+        halt ("too many sound sinks");
+
+    sinks[sinkCount++] = sink;
+}
+
+/*  Start playing sound to the named sink, or the default sink if name is
+ *  NULL.  arg is passed to the sink, eg. the file to write.  Returns false if
+ *  there is no such sink or it can't be opened.
+ */
+bool soundInit (const char *name, const char *arg)
+{
+    SoundState *snd = &machine->sound;
+    soundSink *sink = NULL;
+
+    if (snd->sink)
+    {
+        printf ("Sound already enabled on %s sink\n", snd->sink->name);
+        return true;
+    }
+
+    for (int i = 0; i < sinkCount && !sink; i++)
+        if (!name || !strcmp (sinks[i]->name, name))
+            sink = sinks[i];
+
+    if (!sink || (sink->open && !sink->open (arg)))
+        return false;
+
+    snd->sink = sink;
+
+    if (!sink->write)
+        return true;
+
+    if (!sink->realTime)
+    {
+        timerStart (TIMER_SOUND, TIMER_CLOCK_HZ / 100, soundTimer);
+        return true;
+    }
+
+    snd->threadRunning = true;
+
+    if (pthread_create (&snd->thread, NULL, soundThread, machine) != 0)
         halt ("create sound thread");
+
+    return true;
 }
 
 void soundClose (void)
 {
-    soundThreadRunning = false;
-    pthread_join (audioThread, NULL);
+    SoundState *snd = &machine->sound;
+
+    if (!snd->sink)
+        return;
+
+    if (snd->threadRunning)
+    {
+        snd->threadRunning = false;
+        pthread_join (snd->thread, NULL);
+    }
+    else if (snd->sink->write)
+        timerStop (TIMER_SOUND);
+
+    if (snd->sink->close)
+        snd->sink->close ();
+
+    snd->sink = NULL;
+    snd->sinkHandle = NULL;
 }
 
 uint16_t soundRead (uint8_t *ptr, uint16_t addr, int size)
@@ -302,61 +377,61 @@ uint16_t soundRead (uint8_t *ptr, uint16_t addr, int size)
 
 void soundWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
 {
-    static int latchedData = -1;
+    SoundState *snd = &machine->sound;
     int channel;
 
     if ((data & 0x90) == 0x90)
     {
         channel = (data & 0x60) >> 5;
-        tones[channel].requestedAmplitude = SAMPLE_AMPLITUDE * (0x0f - (data & 0x0f));
-        mprintf (LVL_SOUND, "tone 0 requestedAmplitude set to %d\n", tones[channel].requestedAmplitude);
+        snd->tones[channel].requestedAmplitude = SAMPLE_AMPLITUDE * (0x0f - (data & 0x0f));
+        mprintf (LVL_SOUND, "tone 0 requestedAmplitude set to %d\n", snd->tones[channel].requestedAmplitude);
         return;
     }
 
     /*  Frequency change for tone 1, 2 and 3 are 2-byte commands so latch the
      *  byte and return
      */
-    if (latchedData == -1 && (data & 0x80) == 0x80 && (data & 0xE0) != 0xE0)
+    if (snd->latchedData == -1 && (data & 0x80) == 0x80 && (data & 0xE0) != 0xE0)
     {
-        latchedData = data;
+        snd->latchedData = data;
         return;
     }
 
-    if (latchedData == -1)
+    if (snd->latchedData == -1)
         mprintf (LVL_SOUND, "SOUND data=%02X", data);
     else
-        mprintf (LVL_SOUND, "SOUND data=%02X,%02X", latchedData, data);
+        mprintf (LVL_SOUND, "SOUND data=%02X,%02X", snd->latchedData, data);
 
     if ((data & 0xF0) == 0xE0)
     {
-        tones[3].shift = 0x8000;
-        tones[3].whiteNoise = (data & 0x04) != 0;
+        snd->tones[3].shift = 0x8000;
+        snd->tones[3].whiteNoise = (data & 0x04) != 0;
 
         if ((data & 0x03) == 0x03)
-            tones[3].useTone3Freq = 1;
+            snd->tones[3].useTone3Freq = 1;
         else
         {
-            tones[3].useTone3Freq = 0;
-            tones[3].period = AUDIO_FREQUENCY / (1748 * (3 - (data & 0x03)));
+            snd->tones[3].useTone3Freq = 0;
+            snd->tones[3].period = AUDIO_FREQUENCY / (1748 * (3 - (data & 0x03)));
         }
 
-        mprintf (LVL_SOUND, " noise period=%d\n", tones[3].period);
+        mprintf (LVL_SOUND, " noise period=%d\n", snd->tones[3].period);
         return;
     }
 
-    channel = (latchedData & 0x60) >> 5;
+    channel = (snd->latchedData & 0x60) >> 5;
 
-    toneInfo *tone = &tones[channel];
-    data = (data << 4) | (latchedData & 0x0f);
-    latchedData = -1;
+    toneInfo *tone = &snd->tones[channel];
+    data = (data << 4) | (snd->latchedData & 0x0f);
+    snd->latchedData = -1;
     mprintf(LVL_SOUND, " freqdata=%d\n", data);
     tone->requestedPeriod = data * AUDIO_FREQUENCY / CLOCK_FREQUENCY;
     mprintf (LVL_SOUND, "tone %d set to [freq %%d], period %d\n", channel,
     tone->requestedPeriod);
 
-    if (channel == 2 && tones[3].useTone3Freq)
+    if (channel == 2 && snd->tones[3].useTone3Freq)
     {
-        tones[3].requestedPeriod = tone->requestedPeriod;
+        snd->tones[3].requestedPeriod = tone->requestedPeriod;
     }
 }
 
@@ -26,7 +26,32 @@
 // #include "cpu.h"
 #include "types.h"
 
-void soundInit (void);
+/*  The frequency at which we are playing samples to the sound sink
+ */
+#define AUDIO_FREQUENCY 44100
+
+/*  A sound sink plays or stores 16-bit mono samples.  Real time sinks are fed
+ *  by an audio thread and may block in write until they are ready for more.
+ *  Others are fed every 10 msec of virtual time.  A sink without write discards
+ *  sound.  open and close may be NULL.
+ */
+typedef struct
+{
+    const char *name;
+    bool realTime;
+    bool (*open) (const char *arg);
+    void (*write) (const int16_t *samples, int count);
+    void (*close) (void);
+}
+soundSink;
+
+extern soundSink soundSinkPulse;
+extern soundSink soundSinkFile;
+extern soundSink soundSinkNull;
+
+void soundSinkRegister (soundSink *sink);
+bool soundInit (const char *sink, const char *arg);
+void soundClose (void);
 uint16_t soundRead (uint8_t *ptr, uint16_t addr, int size);
 void soundWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size);
 void soundAuxData (int16_t sample);
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ *  Sound sink that plays samples through pulse audio.
+ */
+
+#include <stdio.h>
+#include <pulse/simple.h>
+
+#include "types.h"
+#include "sound.h"
+#include "trace.h"
+#include "machine.h"
+
+static bool pulseOpen (const char *arg)
+{
+    pa_simple *pulseAudioHandle;
+    static pa_sample_spec pulseAudioSpec;
+
+    pulseAudioSpec.format = PA_SAMPLE_S16NE;
+    pulseAudioSpec.channels = 1;
+    pulseAudioSpec.rate = AUDIO_FREQUENCY;
+
+    pulseAudioHandle = pa_simple_new(NULL,               // Use the default server.
+                      "TI99",           // Our application's name.
+                      PA_STREAM_PLAYBACK,
+                      NULL,               // Use the default device.
+                      "Games",            // Description of our stream.
+                      &pulseAudioSpec,                // Our sample format.
+                      NULL,               // Use default channel map
+                      NULL,               // Use default buffering attributes.
+                      NULL               // Ignore error code.
+                      );
+
+    if (pulseAudioHandle == NULL)
+        halt ("pulse audio handle");
+
+    machine->sound.sinkHandle = pulseAudioHandle;
+    return true;
+}
+
+static void pulseWrite (const int16_t *samples, int count)
+{
+    pa_simple_write ((pa_simple*) machine->sound.sinkHandle, samples,
+                     count * sizeof (int16_t), NULL);
+}
+
+static void pulseClose (void)
+{
+    pa_simple_free ((pa_simple*) machine->sound.sinkHandle);
+}
+
+soundSink soundSinkPulse = { "pulse", true, pulseOpen, pulseWrite, pulseClose };
@@ -36,6 +36,7 @@
 
 #include "types.h"
 #include "cpu.h"
+#include "cpucore.h"
 #include "mem.h"
 #include "sound.h"
 #include "speech.h"
@@ -55,6 +56,9 @@
 #include "fdd.h"
 #include "ti994a.h"
 
+#define IDLE_MAX_CYCLES 20000   // Longest iteration of an idle loop
+#define IDLE_MAX_VISITS 64      // Visits to a loop head before giving up on it
+
 /*  Show the contents of the scratchpad memory either in abbreviated or detailed
  *  form.  If the param is false, just a hex dump is shown.  If true, each value
  *  is presented on a separate line with a description
@@ -82,79 +86,330 @@ void TI994A::showScratchPad (bool showGplUsage)
     printf ("\n");
 }
 
-void TI994A::run (int instPerInterrupt)
+/*  Check whether anything is enabled that needs the instrumented run loop.
+ *  Disassembly is the only trace output generated by the CPU itself.
+ */
+bool TI994A::_debugActive (void)
+{
+    return (outputLevel & LVL_UNASM) != 0 ||
+           breakPointCount () > 0 ||
+           watchCount () > 0 ||
+           conditionCount () > 0;
+}
+
+TI994A::TI994A ()
+{
+    _machine = NULL;
+    _runFlag = false;
+    _fastPath = false;
+    _cyclesPaced = 0;
+    _idleEnable = true;
+    _idleLastPc = 0;
+    _idlePc = 0;
+    _idleActive = false;
+    _idleSeen = 0;
+    _idleVisits = 0;
+    _idleNext = 0;
+    _idleWrites = 0;
+    _idleRejectNext = 0;
+    memset (_idleHistory, 0, sizeof _idleHistory);
+    memset (_idleRejected, 0, sizeof _idleRejected);
+}
+
+/*  Called after executing one or more instructions to advance virtual time
+ *  by the CPU cycles they took.  Returns true at the end of a time slice once
+ *  any events that are due have run and input has been polled.
+ */
+bool TI994A::_pace (void)
+{
+    uint64_t cycles = getCycles ();
+    int elapsed = cycles - _cyclesPaced;
+
+    _cyclesPaced = cycles;
+
+    if (!timerAdvance (elapsed))
+    {
+        /*  There is no need to spin in an idle loop, just skip straight to
+         *  the next event */
+        if (!_idle ())
+            return false;
+
+        timerSkip ();
+    }
+
+    kbdPoll ();
+    timerExpire ();
+
+    /*  Events change device state that idle loops may be waiting on */
+    _idleForget ();
+
+    return true;
+}
+
+/*  Hash the state an idle loop could depend on.  Device state that can only
+ *  change through a side effect or an event isn't included.  Reading the VDP
+ *  data port moves the VDP address on, so that and the address latch are.
+ *  Scratchpad is read directly rather than through the page table as pages
+ *  with watches on them aren't mapped for direct access.
+ */
+uint64_t TI994A::_idleHash (void)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint16_t regs[] = { getPC (), getWP (), getST (), gromAddr (),
+                        _machine->vdp.addr, (uint16_t) _machine->vdp.cmdInProg };
+
+    for (unsigned i = 0; i < sizeof regs / sizeof regs[0]; i++)
+        hash = (hash ^ regs[i]) * 1099511628211ULL;
+
+    /*  Registers that aren't in memory are read through the bus when used,
+     *  so writes to them count as side effects.  Reading them here could
+     *  have side effects of its own.
+     */
+    for (int i = 0; i < 32; i++)
+    {
+        uint16_t addr = getWP () + i;
+
+        if (_machine->mem.page[addr >> 8].read)
+            hash = (hash ^ memReadB (addr)) * 1099511628211ULL;
+    }
+
+    for (int i = 0; i < 0x100; i++)
+        hash = (hash ^ _machine->mem.scratch[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+/*  Forget the visits to the current loop head */
+void TI994A::_idleForget (void)
+{
+    for (int i = 0; i < IDLE_HISTORY; i++)
+        _idleHistory[i].hash = 0;
+}
+
+/*  Called after executing one or more instructions to check whether the CPU
+ *  is in an idle loop.  A loop is idle if the CPU returns to its head with
+ *  the same state as on an earlier visit, with no side effects in between
+ *  other than reading devices.  Nothing can change until the next event, so
+ *  there is no need to keep running it.  The head of a loop is any address
+ *  reached by going backwards.  If a loop head isn't revisited within
+ *  IDLE_MAX_CYCLES or doesn't repeat within IDLE_MAX_VISITS, another is
+ *  chosen.  Loops that didn't repeat are remembered so that they aren't
+ *  chosen again straight away.
+ */
+bool TI994A::_idle (void)
 {
-    static int count;
+    uint16_t pc = getPC ();
+    bool backward = (pc <= _idleLastPc);
+    uint64_t cycles = getCycles ();
+
+    _idleLastPc = pc;
+
+    if (!_idleEnable)
+        return false;
+
+    if (_idleActive && pc == _idlePc)
+    {
+        IdleVisit v = { _idleHash (), cycles, _idleWrites + _machine->cru.outputChanges };
+
+        _idleSeen = cycles;
 
+        for (int i = 0; i < IDLE_HISTORY; i++)
+        {
+            IdleVisit *h = &_idleHistory[i];
+
+            if (h->hash == v.hash && h->effects == v.effects &&
+                cycles - h->cycles <= IDLE_MAX_CYCLES &&
+                !tms9901ClockMode ())
+            {
+                _idleVisits = 0;
+                return true;
+            }
+        }
+
+        _idleHistory[_idleNext] = v;
+        _idleNext = (_idleNext + 1) % IDLE_HISTORY;
+
+        if (++_idleVisits > IDLE_MAX_VISITS)
+        {
+            _idleRejected[_idleRejectNext] = pc;
+            _idleRejectNext = (_idleRejectNext + 1) % IDLE_HISTORY;
+            _idleActive = false;
+        }
+
+        return false;
+    }
+
+    if (!backward || (_idleActive && cycles - _idleSeen <= IDLE_MAX_CYCLES))
+        return false;
+
+    for (int i = 0; i < IDLE_HISTORY; i++)
+        if (_idleRejected[i] == pc)
+            return false;
+
+    _idleActive = true;
+    _idlePc = pc;
+    _idleSeen = cycles;
+    _idleVisits = 0;
+    _idleForget ();
+
+    /*  The first visit is the one just made */
+    _idleHistory[0].hash = _idleHash ();
+    _idleHistory[0].cycles = cycles;
+    _idleHistory[0].effects = _idleWrites + _machine->cru.outputChanges;
+    _idleNext = 1;
+
+    return false;
+}
+
+/*  Run until stopped on the calling thread.  The fast loop is used unless the debugger has
+ *  enabled something that must see every instruction.  Each loop checks at
+ *  the end of every time slice whether the other should take over.
+ */
+void TI994A::run (void)
+{
+    machineSelect (_machine);
     _runFlag = true;
+    _cyclesPaced = getCycles ();
     printf("enter run loop\n");
 
-    while (_runFlag &&
-           !breakPointHit (getPC()) &&
-           !conditionTrue ())
+    while (_runFlag)
     {
-        uint16_t opcode = fetch ();
-        bool shouldBlock = false;
-
-        /*  Check if the instruction we are about to execute is >10FF, which is
-         *  an infinite loop.  It is used to wait for an interrupt during
-         *  cassette operations.  There is no need to actually spin, just go
-         *  straight to a blocking read on the interrupt timer.
-         */
-        if (opcode == 0x10FF)
+        if (_debugActive ())
+            _runDebug ();
+        else
+            _runFast ();
+    }
+}
+
+/*  Instrumented run loop.  Breakpoints and conditions are checked before
+ *  each instruction and disassembly is output after it.  Watches and
+ *  conditions on memory are only checked after a write to a location they
+ *  watch.
+ */
+void TI994A::_runDebug (void)
+{
+    /*  Cached blocks are executed as a whole so can't be used if there are
+     *  breakpoints, watches or conditions which must be checked after every
+     *  instruction to stop or report at the PC where they hit.
+     */
+    bool breaks = (breakPointCount () > 0);
+    bool condCpu = (conditionCpuCount () > 0);
+    bool useBlocks = (getExecMode () != EXEC_INTERPRET && !breaks &&
+                      !watchCount () && !conditionCount ());
+    bool condHit = conditionTrue (this, true);
+
+    /*  The disassembly hooks are turned off as in the fast loop unless
+     *  disassembly is being output */
+    _fastPath = (outputLevel & LVL_UNASM) == 0;
+    _machine->mem.watchHit = false;
+
+    while (_runFlag)
+    {
+        if ((breaks && breakPointHit (getPC())) || condHit)
         {
-            shouldBlock = true;
+            _runFlag = false;
+            break;
         }
 
-        /*  To approximate execution speed at around 10 clock cycles per
-         *  instruction with a 3MHz clock, we expect to execute about 2000
-         *  instructions per VDP interrupt so do a blocking timer read once
-         *  count reaches this value.
-         *
-         *  TODO : trick, LIMI 2 is the main GPL loop but won't mess up cassette
-         *  ops.  Will this work with munchman and other ROM games?
-         *
-         *  Messes up frogger, TODO
-         */
-        // if (cpu.getIntMask() == 2 && count >= instPerInterrupt)
-        if (count >= instPerInterrupt)
+        if (useBlocks)
+            executeBlock ();
+        else
+            execute (fetch ());
+
+        if (outputLevel & LVL_UNASM)
         {
-            shouldBlock = true;
-            count -= instPerInterrupt;
+            mprintf (LVL_UNASM, unasm.getOutput().c_str());
+            unasm.clearOutput();
         }
 
-        if (shouldBlock)
+        if (_machine->mem.watchHit)
         {
-            kbdPoll ();
-            timerPoll ();
+            _machine->mem.watchHit = false;
+            watchShow();
+            condHit = conditionTrue (this, true);
         }
+        else if (condCpu)
+            condHit = conditionTrue (this, false);
 
-        execute (opcode);
-        mprintf (LVL_UNASM, unasm.getOutput().c_str());
-        unasm.clearOutput();
-        count++;
+        if (_pace () && !_debugActive ())
+            break;
+    }
 
-        watchShow();
+    _fastPath = false;
+}
+
+/*  Run loop used when nothing is being traced or checked.  The disassembly
+ *  hooks are turned off so the CPU does nothing but execute instructions.
+ */
+void TI994A::_runFast (void)
+{
+    bool useBlocks = (getExecMode () != EXEC_INTERPRET);
+
+    _fastPath = true;
+
+    while (_runFlag)
+    {
+        if (useBlocks)
+            executeBlock ();
+        else
+            execute (fetch ());
+
+        if (_pace () && _debugActive ())
+            break;
     }
 
-    _runFlag = false;
+    _fastPath = false;
 }
 
 bool TI994A::_interrupt (int index, uint8_t state)
 {
     if (index == IRQ_TIMER)
-        _cassette.timerExpired (tms9901TimerToNsec ());
+        machine->cassette.timerExpired (tms9901TimerToNsec ());
 
     return tms9901Interrupt (index, state);
 }
 
+/*  Called by the memory map when a bank switch changes the memory at an
+ *  address so that the workspace pointer can be refreshed */
+void TI994A::_memRemapped (void *arg)
+{
+    ((TI994A*) arg)->memoryRemapped ();
+}
+
+/*  The cassette is part of the machine running on the calling thread */
+bool TI994A::_cassetteMotor (int index, uint8_t state)
+{
+    return machine->cassette.motor (index, state);
+}
+
+bool TI994A::_cassetteAudioGate (int index, uint8_t state)
+{
+    return machine->cassette.audioGate (index, state);
+}
+
+bool TI994A::_cassetteTapeOutput (int index, uint8_t state)
+{
+    return machine->cassette.tapeOutput (index, state);
+}
+
+uint8_t TI994A::_cassetteTapeInput (int index, uint8_t state)
+{
+    return machine->cassette.tapeInput (index, state);
+}
+
+/*  Create the machine and select it for the calling thread so that it can be
+ *  configured before it is run */
 void TI994A::init (void)
 {
+    _machine = machineCreate ();
+    machineSelect (_machine);
+    memInit ();
+    memRemapCallbackSet (_memRemapped, this);
     tms9901Init ();
     timerInit ();
 
-    /*  Start a 20-msec (20,000,000 nanosec == 50Hz) recurring timer to generate video interrupts */
-    timerStart (TIMER_VDP, 20000000, vdpRefresh);
+    /*  Start a 20-msec (60,000 cycle == 50Hz) recurring timer to generate video interrupts */
+    timerStart (TIMER_VDP, TIMER_CLOCK_HZ / 50, vdpRefresh);
 
     int i;
 
@@ -179,15 +434,19 @@ void TI994A::init (void)
     for (i = 18; i <= 21; i++)
         cruOutputCallbackSet (i, kbdColumnUpdate);
 
-    cruOutputCallbackSet (22, _cassette.motor);
-    cruOutputCallbackSet (23, _cassette.motor);
-    cruOutputCallbackSet (24, _cassette.audioGate);
-    cruOutputCallbackSet (25, _cassette.tapeOutput);
-    cruReadCallbackSet (27, _cassette.tapeInput);
+    cruOutputCallbackSet (22, _cassetteMotor);
+    cruOutputCallbackSet (23, _cassetteMotor);
+    cruOutputCallbackSet (24, _cassetteAudioGate);
+    cruOutputCallbackSet (25, _cassetteTapeOutput);
+    cruReadCallbackSet (27, _cassetteTapeInput);
 }
 
 void TI994A::close (void)
 {
     timerClose ();
+    machineDestroy (_machine);
+    _machine = NULL;
 }
 
+/*  Instantiate the CPU core for the console bus */
+template class TMS9900Core<TI994A>;
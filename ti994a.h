@@ -23,8 +23,6 @@
 #ifndef __TI994A_H
 #define __TI994A_H
 
-#include <stdarg.h>
-
 #include "cassette.h"
 #include "cpu.h"
 #include "mem.h"
@@ -32,50 +30,113 @@
 #include "cru.h"
 #include "interrupt.h"
 
-class TI994A:public TMS9900
+#define IDLE_HISTORY    8       // Visits to a loop head remembered
+
+/*  A visit to the head of a loop that may be idle.  The hash covers the CPU
+ *  state, workspace, scratchpad and GROM address.  effects is the count of
+ *  side effects seen up to the visit.
+ */
+typedef struct
+{
+    uint64_t hash;
+    uint64_t cycles;
+    uint32_t effects;
+}
+IdleVisit;
+
+/*  The console binds its bus to the CPU core at compile time so that memory,
+ *  CRU and disassembly hooks are inlined into the instruction handlers */
+class TI994A:public TMS9900Core<TI994A>
 {
+    friend class TMS9900Core<TI994A>;
 public:
     //TMS9900 cpu;
     Unasm unasm;
-    void run (int instPerInterrupt);
+    TI994A ();
+    void run (void);
     void init (void);
     void close (void);
     void showScratchPad (bool showGplUsage);
     // void timerInterrupt (void);
     void clearRunFlag () { _runFlag = false; }
+    void idleSkip (bool enable) { _idleEnable = enable; }
     // void unasmOutputUncovered (bool flag) { _unasm.outputUncovered (flag); }
     // void unasmReadText (const char *textFile) { _unasm.readText (textFile); }
 private:
-    static Cassette _cassette;
+    Machine *_machine;
     bool _runFlag;
+    bool _fastPath;
+    uint64_t _cyclesPaced;
+    bool _debugActive (void);
+    bool _pace (void);
+
+    /*  Idle loop detection */
+    bool _idleEnable;
+    uint16_t _idleLastPc;
+    uint16_t _idlePc;
+    bool _idleActive;
+    uint64_t _idleSeen;
+    int _idleVisits;
+    int _idleNext;
+    uint32_t _idleWrites;
+    IdleVisit _idleHistory[IDLE_HISTORY];
+    uint16_t _idleRejected[IDLE_HISTORY];
+    int _idleRejectNext;
+    bool _idle (void);
+    uint64_t _idleHash (void);
+    void _idleForget (void);
+
+    /*  Writes to scratchpad and the GROM address are part of the idle loop
+     *  state rather than side effects */
+    void _idleWrite (uint16_t addr)
+    {
+        if ((addr & 0xFC00) != 0x8000 && (addr & 0xFC02) != 0x9C02)
+            _idleWrites++;
+    }
+
+    void _runDebug (void);
+    void _runFast (void);
     uint16_t _memReadW (uint16_t addr) { return memReadW (addr); }
     uint8_t _memReadB (uint16_t addr) { return memReadB (addr); }
-    void _memWriteW (uint16_t addr, uint16_t data) { memWriteW (addr, data); }
-    void _memWriteB (uint16_t addr, uint8_t data) { memWriteB (addr, data); }
+    void _memWriteW (uint16_t addr, uint16_t data) { _idleWrite (addr); memWriteW (addr, data); }
+    void _memWriteB (uint16_t addr, uint8_t data) { _idleWrite (addr); memWriteB (addr, data); }
+    intptr_t _memBank (uint16_t addr) { return memBank (addr); }
+    uint8_t *_memHostPtr (uint16_t addr) { return memHostPtr (addr); }
+    int _memWait (uint16_t addr) { return memWaitStates (addr); }
 
-    void _unasmPostExec (const char *fmt, ...)
+    /*  Disassembly is turned off in the fast run loop.  Post exec is a
+     *  template rather than varargs so that it inlines to just the test.
+     */
+    template <typename... Args>
+    void _unasmPostExec (const char *fmt, Args... args)
     {
-        va_list ap;
-
-        va_start (ap, fmt);
-        unasm.vPostExec (fmt, ap);
-        va_end (ap);
+        if (!_fastPath)
+            unasm.postExec (fmt, args...);
     }
 
     uint16_t _unasmPreExec (uint16_t pc, uint16_t data, uint16_t type, uint16_t opcode)
-    { return unasm.preExec (pc, data, type, opcode ); }
-    void _unasmEndLine (void) { unasm.endLine(); }
+    { return _fastPath ? 0 : unasm.preExec (pc, data, type, opcode ); }
+    void _unasmEndLine (void) { if (!_fastPath) unasm.endLine(); }
+    bool _unasmActive (void) { return !_fastPath && unasm.active(); }
 
     void _cruBitOutput (uint16_t base, uint16_t offset, uint8_t state) { cruBitOutput (base, offset, state); }
     void _cruMultiBitSet (uint16_t base, uint16_t data, int nBits) { cruMultiBitSet (base, data, nBits); }
     uint16_t _cruMultiBitGet (uint16_t base, uint16_t offset) { return cruMultiBitGet (base, offset); }
     uint8_t _cruBitGet (uint16_t base, int8_t bitOffset) { return cruBitGet (base, bitOffset); }
 
-    int _interruptLevel (int mask) { return interruptLevel (mask); }
+    /*  Only look for the interrupt level if one is pending and enabled */
+    int _interruptLevel (int mask) { return (mask && _machine->tms9901.pending) ? interruptLevel (mask) : -1; }
 
     /*  Methods using legacy C callbacks must be declared static */
     static bool _interrupt (int index, uint8_t state);
+    static void _memRemapped (void *arg);
+    static bool _cassetteMotor (int index, uint8_t state);
+    static bool _cassetteAudioGate (int index, uint8_t state);
+    static bool _cassetteTapeOutput (int index, uint8_t state);
+    static uint8_t _cassetteTapeInput (int index, uint8_t state);
 };
 
+extern template class TMS9900Core<TI994A>;
+
 #endif
 
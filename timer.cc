@@ -20,13 +20,19 @@
  * SOFTWARE.
  */
 
+/*
+ *  Schedules events in virtual time measured in CPU clock cycles.  The run
+ *  loop advances virtual time as it executes instructions and runs any events
+ *  that have become due.  Events are kept in a priority queue ordered by the
+ *  time they are due.  Keeping in step with real time is optional and is done
+ *  by sleeping before running events if virtual time is ahead of the wall
+ *  clock.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/timerfd.h>
-#include <poll.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <time.h>
 #include <errno.h>
 
 #include "trace.h"
@@ -34,147 +40,224 @@
 
 #define NSEC_PER_SEC            1000000000 // 1 billion nanosecs in a second
 
-struct _timers
+/*  If real time gets further behind than this, for example after sitting at
+ *  the console prompt, catch up instead of running flat out to make it up */
+#define THROTTLE_MAX_LAG_NSEC   100000000
+
+static bool heapBefore (TimerState *t, int a, int b)
 {
-    int fd;
-    int nsec;
-    void (*callback) (void);
-    bool running;
+    return t->event[t->heap[a]].when < t->event[t->heap[b]].when;
 }
-timers[MAX_TIMERS];
 
-static void timespecSet (struct timespec *ts, int nsec)
+static void heapSwap (TimerState *t, int a, int b)
 {
-    ts->tv_sec = nsec / NSEC_PER_SEC;
-    ts->tv_nsec = (nsec % NSEC_PER_SEC);
+    int i = t->heap[a];
+
+    t->heap[a] = t->heap[b];
+    t->heap[b] = i;
+    t->heapPos[t->heap[a]] = a;
+    t->heapPos[t->heap[b]] = b;
 }
 
-static int timespecGet (struct timespec *ts)
+static void heapUp (TimerState *t, int pos)
 {
-    return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+    while (pos > 0 && heapBefore (t, pos, (pos - 1) / 2))
+    {
+        heapSwap (t, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
 }
 
-static void timerReset (int index, int nsec)
+static void heapDown (TimerState *t, int pos)
 {
-    struct itimerspec startval;
+    while (1)
+    {
+        int first = pos;
+        int left = pos * 2 + 1;
+        int right = left + 1;
 
-    timespecSet (&startval.it_value, nsec);
-    timespecSet (&startval.it_interval, nsec);
+        if (left < t->heapCount && heapBefore (t, left, first))
+            first = left;
 
-    if (timerfd_settime(timers[index].fd, /* TFD_TIMER_ABSTIME */ 0, &startval, NULL) == -1)
-    {
-        perror ("timer");
-        halt("timerfd_settime");
+        if (right < t->heapCount && heapBefore (t, right, first))
+            first = right;
+
+        if (first == pos)
+            break;
+
+        heapSwap (t, pos, first);
+        pos = first;
     }
 }
 
-/*  Start a count down timer.  If a timer is already running, it is reset.
- *  Passing a value of 0 for microsends stops the timer.
- */
-void timerStart (int index, int nsec, void (*callback)(void))
+static void heapRemove (TimerState *t, int index)
 {
-    if (index < 0 || index >= MAX_TIMERS)
-        halt ("bad timer index");
+    int pos = t->heapPos[index];
 
-    timers[index].callback = callback;
-    timers[index].nsec = nsec;
+    heapSwap (t, pos, --t->heapCount);
 
-    timers[index].running = (nsec>0) ? true : false;
+    if (pos < t->heapCount)
+    {
+        heapUp (t, pos);
+        heapDown (t, pos);
+    }
+}
 
-    timerReset (index, nsec);
-    mprintf (LVL_INTERRUPT, "Timer %d running with interval %d nsec\n",
-             index, nsec);
+static void timerNextUpdate (TimerState *t)
+{
+    t->next = t->heapCount ? t->event[t->heap[0]].when : UINT64_MAX;
 }
 
-void timerStop (int index)
+static uint64_t wallNsec (void)
 {
-    timerReset (index, 0);
-    mprintf (LVL_INTERRUPT, "Timer %d stopped\n");
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
 }
 
-int timerRemain (int index)
+/*  Sleep until real time catches up with virtual time */
+static void timerThrottleSleep (TimerState *t)
 {
-    struct itimerspec remain;
+    uint64_t target = t->throttleBaseNsec +
+                      (t->cycles - t->throttleBaseCycles) * NSEC_PER_SEC / TIMER_CLOCK_HZ;
+    uint64_t now = wallNsec ();
 
-    if (timerfd_gettime(timers[index].fd, &remain) == -1)
+    if (now > target + THROTTLE_MAX_LAG_NSEC)
     {
-        perror ("timer");
-        halt("timerfd_gettime");
+        t->throttleBaseNsec = now;
+        t->throttleBaseCycles = t->cycles;
+        return;
     }
 
-    return timespecGet (&remain.it_value);
+    if (now >= target)
+        return;
+
+    struct timespec ts;
+
+    ts.tv_sec = target / NSEC_PER_SEC;
+    ts.tv_nsec = target % NSEC_PER_SEC;
+
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
 }
 
-/*  Do a blocking read on the timers.  This synchronises the system at 50Hz or a
- *  lower value if specified.  This function used to poll and the main function
- *  used to sleep but it's easier just to do a blocking read
+/*  Start a recurring timer that expires every cycles CPU cycles.  If the
+ *  timer is already running, it is reset.  Passing a value of 0 for cycles
+ *  stops the timer.
  */
-void timerPoll (void)
+void timerStart (int index, int cycles, void (*callback)(void))
 {
-    struct pollfd pfds[MAX_TIMERS];
-    int i;
+    TimerState *t = &machine->timer;
+
+    if (index < 0 || index >= MAX_TIMERS)
+        halt ("bad timer index");
+
+    if (t->event[index].running)
+        heapRemove (t, index);
 
-    for (i = 0; i < MAX_TIMERS; i++)
+    t->event[index].callback = callback;
+    t->event[index].cycles = cycles;
+    t->event[index].running = (cycles>0) ? true : false;
+
+    if (t->event[index].running)
     {
-        pfds[i].fd = timers[i].fd;
-        pfds[i].events = POLLIN;
-        pfds[i].revents = 0;
+        t->event[index].when = t->cycles + cycles;
+        t->heap[t->heapCount] = index;
+        t->heapPos[index] = t->heapCount;
+        heapUp (t, t->heapCount++);
     }
 
-    int expired;
-
-    expired = poll(pfds, MAX_TIMERS, -1);
+    timerNextUpdate (t);
+    mprintf (LVL_INTERRUPT, "Timer %d running with interval %d cycles\n",
+             index, cycles);
+}
 
-    if (expired == 0)
-        return;
+void timerStop (int index)
+{
+    TimerState *t = &machine->timer;
 
-    if (expired < 0)
+    if (t->event[index].running)
     {
-        printf ("Problem polling timers\n");
-        perror ("poll");
-        return;
+        heapRemove (t, index);
+        t->event[index].running = false;
+        timerNextUpdate (t);
     }
 
-    for (i = 0; i < MAX_TIMERS; i++)
+    mprintf (LVL_INTERRUPT, "Timer %d stopped\n", index);
+}
+
+/*  Return the number of cycles until a timer next expires */
+int timerRemain (int index)
+{
+    TimerState *t = &machine->timer;
+
+    if (!t->event[index].running)
+        return 0;
+
+    return t->event[index].when - t->cycles;
+}
+
+/*  Run all events that are due.  Each is rescheduled before its callback is
+ *  called so that the callback may restart or stop it.
+ */
+void timerExpire (void)
+{
+    TimerState *t = &machine->timer;
+
+    if (t->throttle)
+        timerThrottleSleep (t);
+
+    while (t->heapCount && t->event[t->heap[0]].when <= t->cycles)
     {
-        if ((pfds[i].revents & POLLIN) != 0)
-        {
-            u_int64_t data;
-            int n = read (timers[i].fd, &data, sizeof (data));
+        int index = t->heap[0];
 
-            if (n != sizeof(data))
-                halt("read");
+        t->event[index].when += t->event[index].cycles;
+        heapDown (t, 0);
 
-            break;
-        }
+        if (t->event[index].callback)
+            t->event[index].callback ();
     }
-    if (i == MAX_TIMERS)
-        halt ("timer expired, but none are pollable");
 
-    if (timers[i].callback)
-        timers[i].callback ();
+    timerNextUpdate (t);
+}
+
+/*  Advance virtual time to the next event, used when the CPU is waiting for
+ *  an interrupt and there is nothing to do until then */
+void timerSkip (void)
+{
+    TimerState *t = &machine->timer;
+
+    if (t->next != UINT64_MAX && t->cycles < t->next)
+        t->cycles = t->next;
+}
+
+/*  Select whether virtual time is kept in step with real time */
+void timerThrottle (bool enable)
+{
+    TimerState *t = &machine->timer;
+
+    t->throttle = enable;
+    t->throttleBaseNsec = wallNsec ();
+    t->throttleBaseCycles = t->cycles;
 }
 
 void timerInit (void)
 {
+    TimerState *t = &machine->timer;
+
+    t->cycles = 0;
+    t->heapCount = 0;
+    t->next = UINT64_MAX;
+
     for (int i = 0; i < MAX_TIMERS; i++)
-    {
-        timers[i].fd = timerfd_create (CLOCK_MONOTONIC, 0);
+        t->event[i].running = false;
 
-        if (timers[i].fd == -1)
-            halt("timerfd_create");
-    }
+    timerThrottle (t->throttle);
 }
 
 void timerClose (void)
 {
     for (int i = 0; i < MAX_TIMERS; i++)
-    {
-        if (timers[i].fd != -1)
-        {
-            close (timers[i].fd);
-            timers[i].fd = -1;
-        }
-    }
+        timerStop (i);
 }
-
@@ -24,18 +24,34 @@
 #define __TIMER_H
 
 #include "types.h"
+#include "machine.h"
 
-#define MAX_TIMERS 2
+/*  Virtual time is counted in cycles of the 3MHz CPU clock */
+#define TIMER_CLOCK_HZ  3000000
 
 #define TIMER_VDP 0
 #define TIMER_TMS9901 1
+#define TIMER_SOUND 2
+#define TIMER_GO 3
 
-void timerStart (int index, int nsec, void (*callback)(void));
+void timerStart (int index, int cycles, void (*callback)(void));
 void timerStop (int index);
 int timerRemain (int index);
-void timerPoll (void);
+void timerExpire (void);
+void timerSkip (void);
+void timerThrottle (bool enable);
 void timerInit (void);
 void timerClose (void);
 
-#endif
+/*  Advance virtual time by a number of cycles.  Returns true if an event is
+ *  due and timerExpire should be called.
+ */
+static inline bool timerAdvance (int cycles)
+{
+    TimerState *t = &machine->timer;
 
+    t->cycles += cycles;
+    return t->cycles >= t->next;
+}
+
+#endif
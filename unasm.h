@@ -38,6 +38,7 @@ public:
     void vPostExec (const char *fmt, va_list ap);
     void postExec (const char *fmt, ...);
     void endLine (void);
+    bool active (void) { return !_skipCurrent; }
     std::string getOutput() { return _output; }
     void clearOutput () { _output = ""; }
     void outputUncovered (bool state);
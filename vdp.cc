@@ -27,8 +27,6 @@
 #include <string.h>
 #include <math.h>
 #include <unistd.h>
-#include <GL/glut.h>
-#include <GL/gl.h>
 
 #include "types.h"
 #include "vdp.h"
@@ -37,62 +35,68 @@
 #include "trace.h"
 #include "status.h"
 #include "interrupt.h"
+#include "machine.h"
 
 #define VDP_READ 1
 #define VDP_WRITE 2
 
-#define VDP_BITMAP_MODE     (vdp.reg[0] & 0x02)
-#define VDP_EXTERNAL        (vdp.reg[0] & 0x01)
+#define VDP_BITMAP_MODE     (machine->vdp.reg[0] & 0x02)
+#define VDP_EXTERNAL        (machine->vdp.reg[0] & 0x01)
 
-#define VDP_16K             (vdp.reg[1] & 0x80)
-#define VDP_SCRN_ENABLE     (vdp.reg[1] & 0x40) // Ignored for now
-#define VDP_INT_ENABLE      (vdp.reg[1] & 0x20)
-#define VDP_TEXT_MODE       (vdp.reg[1] & 0x10)
-#define VDP_MULTI_MODE      (vdp.reg[1] & 0x08)
-#define VDP_SPRITESIZE      (vdp.reg[1] & 0x02)
-#define VDP_SPRITEMAG       (vdp.reg[1] & 0x01)
+#define VDP_16K             (machine->vdp.reg[1] & 0x80)
+#define VDP_SCRN_ENABLE     (machine->vdp.reg[1] & 0x40)
+#define VDP_INT_ENABLE      (machine->vdp.reg[1] & 0x20)
+#define VDP_TEXT_MODE       (machine->vdp.reg[1] & 0x10)
+#define VDP_MULTI_MODE      (machine->vdp.reg[1] & 0x08)
+#define VDP_SPRITESIZE      (machine->vdp.reg[1] & 0x02)
+#define VDP_SPRITEMAG       (machine->vdp.reg[1] & 0x01)
 
 // FF=>x3c00, 06=>x1800
-#define VDP_SCRN_IMGTAB     ((vdp.reg[2] & 0x0F) << 10)
+#define VDP_SCRN_IMGTAB     ((machine->vdp.reg[2] & 0x0F) << 10)
 
-#define VDP_GR_COLTAB_ADDR  (vdp.reg[3] << 6)
+#define VDP_GR_COLTAB_ADDR  (machine->vdp.reg[3] << 6)
 
-#define VDP_GR_CHARPAT_TAB  ((vdp.reg[4] & 0x07) << 11)
+#define VDP_GR_CHARPAT_TAB  ((machine->vdp.reg[4] & 0x07) << 11)
 
 // FF=>addr=x2000, size=x1fff
-#define VDP_BM_COLTAB_ADDR  ((vdp.reg[3] & 0x80) << 6)
-#define VDP_BM_COLTAB_SIZE  (((vdp.reg[3] & 0x7F) << 6) | 0x3F)
+#define VDP_BM_COLTAB_ADDR  ((machine->vdp.reg[3] & 0x80) << 6)
+#define VDP_BM_COLTAB_SIZE  (((machine->vdp.reg[3] & 0x7F) << 6) | 0x3F)
 
 // 03=>tab=0,size=x1fff
-#define VDP_BM_CHARPAT_TAB  ((vdp.reg[4] & 0x04) << 11)
-#define VDP_BM_CHARPAT_SIZE (((vdp.reg[4] & 0x03) << 11) | 0x7ff)
+#define VDP_BM_CHARPAT_TAB  ((machine->vdp.reg[4] & 0x04) << 11)
+#define VDP_BM_CHARPAT_SIZE (((machine->vdp.reg[4] & 0x03) << 11) | 0x7ff)
 
-#define VDP_SPRITEATTR_TAB  ((vdp.reg[5] & 0x7F) << 7)
+#define VDP_SPRITEATTR_TAB  ((machine->vdp.reg[5] & 0x7F) << 7)
 
-#define VDP_SPRITEPAT_TAB   ((vdp.reg[6] & 0x07) << 11)
+#define VDP_SPRITEPAT_TAB   ((machine->vdp.reg[6] & 0x07) << 11)
 
-#define VDP_FG_COLOUR       ((vdp.reg[7] & 0xf0) >> 4)
-#define VDP_BG_COLOUR       (vdp.reg[7] & 0x0f)
+#define VDP_FG_COLOUR       ((machine->vdp.reg[7] & 0xf0) >> 4)
+#define VDP_BG_COLOUR       (machine->vdp.reg[7] & 0x0f)
 
 #define VDP_VERT_RETRACE        0x80
 #define VDP_SPRITE_LINE         0x40
 #define VDP_SPRITE_COINC        0x20
 
-#define MAX_ADDR 0x8002
-
 #define VDP_STATUS_PANE_WIDTH 32
 
-#define VDP_XSIZE 256
-#define VDP_YSIZE 192
-
-/* Values take from https://en.wikipedia.org/wiki/TMS9918 */
-static struct
+/*  The framebuffer holds the screen at its native resolution with 4 bytes per
+ *  pixel.  The first 3 bytes of each pixel are r, g, b respectively and the
+ *  4th is not used.  Scaling it up to the window size is left to the display.
+ *  The status pane is drawn unscaled into a separate buffer whose size
+ *  depends on the pixel magnification factor so it is allocated at runtime.
+ *  There is one display window, only the machine that opened it draws to it.
+ */
+static struct _frameBuffer
 {
-   int r;
-   int g;
-   int b;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t unused;
 }
-colours[16] =
+frameBuffer[VDP_YSIZE][VDP_XSIZE], *statusBuffer;
+
+/* Values take from https://en.wikipedia.org/wiki/TMS9918 */
+static const struct _frameBuffer colours[16] =
 {
     {0x00, 0x00, 0x00}, // Transparent
     {0x00, 0x00, 0x00}, // blank
@@ -112,65 +116,47 @@ colours[16] =
     {0xff, 0xff, 0xff}  // white
 };
 
-struct
-{
-    uint16_t addr;
-    int cmdInProg;
-    int mode;
-    uint8_t reg[8];
-    uint8_t cmd;
-    uint8_t st;
-    uint8_t ram[MAX_ADDR];
-    bool graphics;
-}
-vdp;
-
-static uint8_t vdpScreen[VDP_XSIZE][VDP_YSIZE];
-static bool vdpSpriteCoinc[VDP_XSIZE][VDP_YSIZE];
-static int vdpSpritesPerLine[VDP_YSIZE];
-static bool vdpInitialised = false;
-static bool vdpRefreshNeeded = false;
-static bool vdpModeChanged = false;
-static bool vdpSpritesEnabled = false;
-
-/*  The framebuffer is a 2D array of pixels with 4 bytes per pixel.  The first 3
- *  bytes of each pixel are r, g, b respectively and the 4th is not
- *  used.  The framebuffer is increased in size by the pixel magnification
- *  factor and also if a status pane is displayed.  Since these are
- *  configurable, the framebuffer is allocated at runtime.
+/*  For each pattern byte, a mask with 0xFF in each of the 8 pixels whose bit
+ *  is set, leftmost pixel from the most significant bit.  Used to expand 8
+ *  pixels of a pattern at a time.
  */
-static struct _frameBuffer
-{
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-    uint8_t unused;
-}
-*frameBuffer;
+static uint64_t expandMask[256];
 
-static int frameBufferXSize;
-static int frameBufferYSize;
-static int frameBufferScale;
+#define EXPAND_BYTES    0x0101010101010101ULL
 
-static inline struct _frameBuffer* pixel (int x, int y)
-{
-    return &frameBuffer[y*frameBufferXSize+x];
-}
+static int statusBufferXSize;
+static int statusBufferYSize;
+
+/*  The memory display leaves frames in the framebuffer, which can be saved with
+ *  vdpFrameSave */
+vdpDisplay vdpDisplayMemory = { "memory", NULL, NULL };
+
+#define MAX_DISPLAYS    4
+
+static vdpDisplay *displays[MAX_DISPLAYS];
+static int displayCount;
+static vdpDisplay *display;
 
 static void vdpScreenUpdate (void)
 {
-    glDrawPixels (frameBufferXSize, frameBufferYSize, GL_RGBA, GL_UNSIGNED_BYTE, frameBuffer);
-    glutSwapBuffers();
+    if (display->show)
+        display->show ((uint8_t*) frameBuffer, (uint8_t*) statusBuffer);
 }
 
 int vdpReadStatus (void)
 {
-    return vdp.st;
+    return machine->vdp.st;
 }
 
 int vdpReadRegister (int reg)
 {
-    return vdp.reg[reg];
+    return machine->vdp.reg[reg];
+}
+
+/*  Read VDP memory without changing the VDP address */
+uint8_t vdpData (int addr)
+{
+    return machine->vdp.ram[addr & 0x3FFF];
 }
 
 uint16_t vdpRead (uint8_t *ptr, uint16_t addr, int size)
@@ -185,19 +171,19 @@ uint16_t vdpRead (uint8_t *ptr, uint16_t addr, int size)
     switch (addr)
     {
     case 0:
-        if (vdp.addr >= MAX_ADDR)
+        if (machine->vdp.addr >= VDP_MAX_ADDR)
         {
-            printf ("VDP read %04X out of range", vdp.addr);
+            printf ("VDP read %04X out of range", machine->vdp.addr);
             halt ("VDP read out of range");
         }
 
-        vdp.cmdInProg = 0;
-        return vdp.ram[vdp.addr++];
+        machine->vdp.cmdInProg = 0;
+        return machine->vdp.ram[machine->vdp.addr++];
     case 2:
-        vdp.cmdInProg = 0;
-        mprintf (LVL_VDP, "VDP read status %02X\n", vdp.st);
-        ret = vdp.st;
-        vdp.st &= 0x1f; // Read resets status bits
+        machine->vdp.cmdInProg = 0;
+        mprintf (LVL_VDP, "VDP read status %02X\n", machine->vdp.st);
+        ret = machine->vdp.st;
+        machine->vdp.st &= 0x1f; // Read resets status bits
         return ret;
     default:
         printf ("addr=%04X\n", addr);
@@ -208,6 +194,56 @@ uint16_t vdpRead (uint8_t *ptr, uint16_t addr, int size)
     return 0;
 }
 
+/*  Record the parts of the display that a write to VDP RAM changes by mapping
+ *  the address through the table bases.  Tables may overlap.
+ */
+static void vdpMarkDirty (int addr)
+{
+    VdpState *v = &machine->vdp;
+    int offset;
+
+    offset = addr - VDP_SCRN_IMGTAB;
+
+    if (offset >= 0 && offset < (VDP_TEXT_MODE ? 960 : 768))
+        v->nameDirty[offset] = v->dirty = true;
+
+    if (VDP_BITMAP_MODE)
+    {
+        offset = addr - VDP_BM_CHARPAT_TAB;
+
+        if (offset >= 0 && offset < VDP_GROUPS * 8)
+            v->patternDirty[offset >> 3] = v->dirty = true;
+
+        offset = addr - VDP_BM_COLTAB_ADDR;
+
+        if (offset >= 0 && offset < VDP_GROUPS * 8)
+            v->colourDirty[offset >> 3] = v->dirty = true;
+    }
+    else
+    {
+        offset = addr - VDP_GR_CHARPAT_TAB;
+
+        if (offset >= 0 && offset < 0x800)
+            v->patternDirty[offset >> 3] = v->dirty = true;
+
+        offset = addr - VDP_GR_COLTAB_ADDR;
+
+        if (offset >= 0 && offset < 0x20)
+            v->colourDirty[offset] = v->dirty = true;
+    }
+
+    /*  Lines with sprites are always drawn again */
+    offset = addr - VDP_SPRITEATTR_TAB;
+
+    if (offset >= 0 && offset < 0x80)
+        v->dirty = true;
+
+    offset = addr - VDP_SPRITEPAT_TAB;
+
+    if (offset >= 0 && offset < 0x800)
+        v->dirty = true;
+}
+
 void vdpWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
 {
     uint8_t reg;
@@ -220,41 +256,23 @@ void vdpWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
     switch (addr)
     {
     case 0:
-        if (vdp.addr >= MAX_ADDR)
+        if (machine->vdp.addr >= VDP_MAX_ADDR)
         {
             halt ("VDP write out of range");
         }
 
-        vdp.cmdInProg = 0;
+        machine->vdp.cmdInProg = 0;
 
-        if (vdp.addr > 0x3FFF)
+        if (machine->vdp.addr > 0x3FFF)
         {
             halt ("VDP memory out of range");
         }
 
-        mprintf (LVL_VDP, "GROM: %04X VDP: %02X -> [%04X] ", gromAddr(), data, vdp.addr);
+        mprintf (LVL_VDP, "GROM: %04X VDP: %02X -> [%04X] ", gromAddr(), data, machine->vdp.addr);
 
-        if (VDP_BITMAP_MODE)
-        {
-            #if 0  // TODO
-            if ((vdp.addr >= VDP_GR_COLTAB_ADDR && vdp.addr < VDP_GR_COLTAB_ADDR + 0x20) ||
-                (vdp.addr >= VDP_SCRN_IMGTAB && vdp.addr < VDP_SCRN_IMGTAB + 0x300) ||
-                (vdp.addr >= VDP_GR_CHARPAT_TAB && vdp.addr < VDP_GR_CHARPAT_TAB + 0x800) ||
-                (vdp.addr >= VDP_SPRITEATTR_TAB && vdp.addr < VDP_SPRITEATTR_TAB + 0x80) ||
-                (vdp.addr >= VDP_SPRITEPAT_TAB && vdp.addr < VDP_SPRITEPAT_TAB + 0x400))
-            #endif
-                vdpRefreshNeeded = true;
-        }else
-        {
-            if ((vdp.addr >= VDP_GR_COLTAB_ADDR && vdp.addr < VDP_GR_COLTAB_ADDR + 0x20) ||
-                (vdp.addr >= VDP_SCRN_IMGTAB && vdp.addr < VDP_SCRN_IMGTAB + 0x300) ||
-                (vdp.addr >= VDP_GR_CHARPAT_TAB && vdp.addr < VDP_GR_CHARPAT_TAB + 0x800) ||
-                (vdp.addr >= VDP_SPRITEATTR_TAB && vdp.addr < VDP_SPRITEATTR_TAB + 0x80) ||
-                (vdp.addr >= VDP_SPRITEPAT_TAB && vdp.addr < VDP_SPRITEPAT_TAB + 0x400))
-                vdpRefreshNeeded = true;
-        }
+        vdpMarkDirty (machine->vdp.addr);
 
-        vdp.ram[vdp.addr++] = data;
+        machine->vdp.ram[machine->vdp.addr++] = data;
 
         int i;
 
@@ -266,39 +284,40 @@ void vdpWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
         mprintf (LVL_VDP, "\n");
         break;
     case 2:
-        if (vdp.cmdInProg)
+        if (machine->vdp.cmdInProg)
         {
             switch (data >> 6)
             {
             case 0:
-                vdp.mode = VDP_READ;
-                vdp.addr = ((data & 0x3F) << 8) | vdp.cmd;
+                machine->vdp.mode = VDP_READ;
+                machine->vdp.addr = ((data & 0x3F) << 8) | machine->vdp.cmd;
                 break;
 
             case 1:
-                vdp.mode = VDP_WRITE;
-                vdp.addr = ((data & 0x3F) << 8) | vdp.cmd;
+                machine->vdp.mode = VDP_WRITE;
+                machine->vdp.addr = ((data & 0x3F) << 8) | machine->vdp.cmd;
                 break;
 
             case 2:
                 reg = data & 7;
-                vdp.mode = 0;
+                machine->vdp.mode = 0;
 
-                if (reg == 1 && vdp.reg[reg] != vdp.cmd)
-                    vdpModeChanged = true;
+                /*  Registers select the mode, table bases and colours so a
+                 *  change to any of them may change the whole display */
+                if (machine->vdp.reg[reg] != machine->vdp.cmd)
+                    machine->vdp.allDirty = machine->vdp.dirty = true;
 
-                vdp.reg[reg] = vdp.cmd;
-                mprintf (LVL_VDP, "VDP R%d=%02X\n", reg, vdp.cmd);
-                vdpRefreshNeeded = true;
+                machine->vdp.reg[reg] = machine->vdp.cmd;
+                mprintf (LVL_VDP, "VDP R%d=%02X\n", reg, machine->vdp.cmd);
                 break;
             }
         }
         else
         {
-            vdp.cmd = data;
+            machine->vdp.cmd = data;
         }
 
-        vdp.cmdInProg = !vdp.cmdInProg;
+        machine->vdp.cmdInProg = !machine->vdp.cmdInProg;
         break;
     default:
         halt ("VDP invalid address");
@@ -306,355 +325,434 @@ void vdpWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size)
     }
 }
 
-void vdpInitGraphics (bool statusPane, int scale)
+/*  Make a display available to vdpInitGraphics.  The first registered is the
+ *  default.
+ */
+void vdpDisplayRegister (vdpDisplay *d)
 {
-    int argc=1;
-    char *argv[] = { (char*)"foo" };
-    glutInit(&argc, argv);
-    glutInitWindowPosition(10,10);
-    glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
+    if (displayCount == MAX_DISPLAYS)
+        halt ("too many displays");
 
-    frameBufferXSize = (VDP_XSIZE * scale) + (statusPane ? VDP_STATUS_PANE_WIDTH * 8 : 0);
-    frameBufferYSize = VDP_YSIZE * scale;
-    frameBufferScale = scale;
+    displays[displayCount++] = d;
+}
+
+/*  Open the named display, or the default display if name is NULL, to show
+ *  the screen scaled up by scale and optionally the status pane.  Returns
+ *  false if there is no such display.
+ */
+bool vdpInitGraphics (const char *name, bool statusPane, int scale)
+{
+    if (display)
+    {
+        printf ("Video already enabled on %s display\n", display->name);
+        return true;
+    }
+
+    for (int i = 0; i < displayCount && !display; i++)
+        if (!name || !strcmp (displays[i]->name, name))
+            display = displays[i];
+
+    if (!display)
+        return false;
 
     if (statusPane)
-        statusPaneInit (VDP_STATUS_PANE_WIDTH * 8, frameBufferYSize,
-                        VDP_XSIZE * scale);
+    {
+        statusBufferXSize = VDP_STATUS_PANE_WIDTH * 8;
+        statusBufferYSize = VDP_YSIZE * scale;
+        statusBuffer = (struct _frameBuffer*) calloc (statusBufferXSize * statusBufferYSize,
+                                                      sizeof (struct _frameBuffer));
 
-    frameBuffer = (struct _frameBuffer*) calloc (frameBufferXSize * frameBufferYSize,
-                          sizeof (struct _frameBuffer));
+        if (statusBuffer == NULL)
+            halt ("allocated status pane buffer");
 
-    if (frameBuffer == NULL)
-        halt ("allocated frame buffer");
+        statusPaneInit (statusBufferXSize, statusBufferYSize, 0);
+    }
 
-    printf ("FB size is %d x %d\n", frameBufferXSize, frameBufferYSize);
-    glutInitWindowSize(frameBufferXSize, frameBufferYSize);
-    glutCreateWindow("TI-99 emulator v" VERSION);
+    printf ("FB size is %d x %d scaled by %d on %s display\n", VDP_XSIZE, VDP_YSIZE,
+            scale, display->name);
 
-    vdpInitialised = true;
-}
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t pixels[8];
 
-/*  Raw plot, doesn't do any scaling, expects absolute coords */
-void vdpPlotRaw (int x, int y, int col)
-{
-    y = frameBufferYSize - y - 1;
+        for (int j = 0; j < 8; j++)
+            pixels[j] = (i & (0x80 >> j)) ? 0xFF : 0x00;
 
-    pixel (x, y)->r = colours[col].r;
-    pixel (x, y)->g = colours[col].g;
-    pixel (x, y)->b = colours[col].b;
+        memcpy (&expandMask[i], pixels, 8);
+    }
+
+    if (display->open)
+        display->open (scale, statusBufferXSize, statusBufferYSize);
+
+    machine->vdp.graphics = true;
+    machine->vdp.allDirty = machine->vdp.dirty = true;
+    return true;
 }
 
-/*  Scaling plot, scales up x and y and draws a square of pixels */
-static void vdpPlot (int x, int y, int col)
+/*  Save the screen as a binary PPM image at its native resolution */
+bool vdpFrameSave (const char *file)
 {
-    int i, j;
+    FILE *fp;
 
-    if (x < 0 || y < 0 || 
-        x >= VDP_XSIZE || 
-        y >= VDP_YSIZE)
+    if (!display)
     {
-        // halt ("VDP coords out of range\n");
-        return;
+        printf ("Video is not enabled\n");
+        return false;
+    }
+
+    if ((fp = fopen (file, "wb")) == NULL)
+    {
+        printf ("Failed to open %s for write\n", file);
+        return false;
     }
 
-    /*  Col 0 is transparent, use global background */
-    if (col == 0)
-        col = VDP_BG_COLOUR;
+    fprintf (fp, "P6\n%d %d\n255\n", VDP_XSIZE, VDP_YSIZE);
 
-    if (vdpScreen[x][y] == col)
+    for (int y = 0; y < VDP_YSIZE; y++)
+        for (int x = 0; x < VDP_XSIZE; x++)
+            fwrite (&frameBuffer[y][x], 3, 1, fp);
+
+    fclose (fp);
+    return true;
+}
+
+/*  Raw plot into the status pane, expects absolute coords */
+void vdpPlotRaw (int x, int y, int col)
+{
+    statusBuffer[y*statusBufferXSize+x] = colours[col];
+}
+
+/*  Copy a line of colours to the framebuffer if it has changed since it was
+ *  last output */
+static void vdpLineOutput (int y, const uint8_t *line)
+{
+    if (!memcmp (machine->vdp.screen[y], line, VDP_XSIZE))
         return;
 
-    vdpScreen[x][y] = col;
+    memcpy (machine->vdp.screen[y], line, VDP_XSIZE);
 
-    /*  Draw a square block of pixels of size (scale x scale) */
-    for (i = 0; i < frameBufferScale; i++)
-        for (j = 0; j < frameBufferScale; j++)
-            vdpPlotRaw (x*frameBufferScale+i, y*frameBufferScale+j, col);
+    for (int x = 0; x < VDP_XSIZE; x++)
+        frameBuffer[y][x] = colours[line[x]];
 }
 
-/*  Draw an 8x8 character on screen.  cx and cy are the column (0 to 31) and row
- *  (0 to 23).  ch is the character index (0 to 255).  Values are multiplied by
- *  8 (<< 3) to convert to pixel coords.  bits is 6 or 8 for text or graphics.
+/*  Draw the 8 lines of the character ch at column cx and row cy of the screen
+ *  into the tile layer.  Each character is 8 pixels wide, or 6 in text mode.
+ *  Colour 0 is transparent so shows the background.
  */
-static void vdpDrawChar (int cx, int cy, int bits, int ch)
+static void vdpTileDraw (int cx, int cy, int ch)
 {
-    int x, y;
+    int bits = VDP_TEXT_MODE ? 6 : 8;
+    uint8_t *ram = machine->vdp.ram;
 
-    for (y = 0; y < 8; y++)
+    for (int row = 0; row < 8; row++)
     {
-        int charpat;
-        int colpat;
+        uint8_t *line = &machine->vdp.tiles[(cy << 3) + row][cx * bits];
+        int pattern;
+        int colour;
 
-        if (VDP_BITMAP_MODE)
+        if (VDP_TEXT_MODE)
+        {
+            pattern = ram[VDP_GR_CHARPAT_TAB + (ch << 3) + row];
+            colour = machine->vdp.reg[7];
+        }
+        else if (VDP_BITMAP_MODE)
         {
-            /*  In bitmap mode the screen is divided vertically into thirds.  Each
-             *  third has its own char set.  Each character set is 0x800 (1<<11) in
-             *  size.
+            /*  In bitmap mode the screen is divided vertically into thirds.
+             *  Each third has its own char set.  Each character set is 0x800
+             *  (1<<11) in size.
              */
-            int addr = (ch << 3) + ((cy >> 3) << 11) + y;
-            // charpat = VDP_BM_CHARPAT_TAB + (ch << 3) + ((cy >> 3) << 11) + y;
-            // colpat = VDP_BM_COLTAB_ADDR + (ch << 3) + ((cy >> 3) << 11) + y;
-            charpat = VDP_BM_CHARPAT_TAB + (addr & VDP_BM_COLTAB_SIZE);
-            colpat = VDP_BM_COLTAB_ADDR + (addr & VDP_BM_COLTAB_SIZE);
+            int addr = (ch << 3) + ((cy >> 3) << 11) + row;
+            pattern = ram[VDP_BM_CHARPAT_TAB + (addr & VDP_BM_CHARPAT_SIZE)];
+            colour = ram[VDP_BM_COLTAB_ADDR + (addr & VDP_BM_COLTAB_SIZE)];
         }
         else
         {
-            charpat = VDP_GR_CHARPAT_TAB + (ch << 3) + y;
-            colpat = VDP_GR_COLTAB_ADDR + (ch >> 3);
+            pattern = ram[VDP_GR_CHARPAT_TAB + (ch << 3) + row];
+            colour = ram[VDP_GR_COLTAB_ADDR + (ch >> 3)];
         }
 
-        int data = vdp.ram[charpat];
-        int colour;
-
-        if (VDP_TEXT_MODE)
-            colour = vdp.reg[7];
-        else
-            colour = vdp.ram[colpat];
+        uint64_t fg = (colour >> 4) ? (colour >> 4) : VDP_BG_COLOUR;
+        uint64_t bg = (colour & 0x0F) ? (colour & 0x0F) : VDP_BG_COLOUR;
+        uint64_t mask = expandMask[pattern];
+        uint64_t pixels = (mask & (fg * EXPAND_BYTES)) | (~mask & (bg * EXPAND_BYTES));
 
-        for (x = cx * bits; x < (cx+1) * bits; x++)
-        {
-            vdpPlot (x, (cy << 3) + y,
-                     (data & 0x80) ? (colour >> 4) : (colour & 0x0F));
-            data <<= 1;
-        }
+        memcpy (line, &pixels, bits);
     }
 }
 
-static bool maxSpritesPerLine (int y, int sprite)
+/*  Redraw the characters whose name, pattern or colour has changed into the
+ *  tile layer and mark the lines they are on.  In text mode the 16 pixels to
+ *  the right of the 40 columns are the background colour.
+ */
+static void vdpTilesUpdate (bool *lineDirty)
 {
-    if (y < 0 || y >= VDP_YSIZE)
-        return false;
+    VdpState *v = &machine->vdp;
+    int columns = VDP_TEXT_MODE ? 40 : 32;
 
-    vdpSpritesPerLine[y]++;
-    // printf("per line %d=%d\n", y, vdpSpritesPerLine[y]);
-
-    // mprintf (LVL_VDP, "per line %d = %d\n", y, vdpSpritesPerLine[y]);
-    /*  If this is the fifth sprite on this line, record its number and set the
-     *  5 per line flag.  If higher than the fifth then just don't draw it
-     *  but don't record any details*/
-    if (vdpSpritesPerLine[y] == 5)
+    for (int cy = 0; cy < 24; cy++)
     {
-        mprintf (LVL_VDP, "sprite %d is 5th on line %d\n", sprite, y);
-        vdp.st = (vdp.st & 0xe0) | sprite;
-        vdp.st |= VDP_SPRITE_LINE;
-        return true;
-    }
-    else if (vdpSpritesPerLine[y] > 5)
-        return true;
+        bool rowDirty = false;
 
-    return false;
-}
+        for (int cx = 0; cx < columns; cx++)
+        {
+            int n = cy * columns + cx;
+            int ch = v->ram[VDP_SCRN_IMGTAB + n];
+            int pattern = ch;
+            int colour = ch >> 3;
 
-static void vdpDrawByte (int data, int x, int y, int col, int sprite)
-{
-    int i;
+            if (VDP_BITMAP_MODE)
+            {
+                int addr = (ch << 3) + ((cy >> 3) << 11);
+                pattern = (addr & VDP_BM_CHARPAT_SIZE) >> 3;
+                colour = (addr & VDP_BM_COLTAB_SIZE) >> 3;
+            }
 
-    for (i = 0; i < 8; i++)
-    {
-        if (data & 0x80)
-        {
-            if (x+i < 0 || y < 0 || 
-                x+i >= VDP_XSIZE || 
-                y >= VDP_YSIZE)
+            if (v->allDirty || v->nameDirty[n] || v->patternDirty[pattern] ||
+                (!VDP_TEXT_MODE && v->colourDirty[colour]))
             {
-                /*  This pixel of the sprite is not visible */
-                continue;
+                vdpTileDraw (cx, cy, ch);
+                rowDirty = true;
             }
+        }
 
-            if (vdpSpriteCoinc[x+i][y])
-                vdp.st |= VDP_SPRITE_COINC;
+        if (rowDirty)
+            memset (&lineDirty[cy << 3], true, 8);
+    }
 
-            vdpSpriteCoinc[x+i][y] = true;
+    if (v->allDirty && VDP_TEXT_MODE)
+        for (int y = 0; y < VDP_YSIZE; y++)
+            memset (&v->tiles[y][240], VDP_BG_COLOUR, VDP_XSIZE - 240);
 
-            vdpPlot (x + i, y, col);
-        }
+    memset (v->nameDirty, 0, sizeof v->nameDirty);
+    memset (v->patternDirty, 0, sizeof v->patternDirty);
+    memset (v->colourDirty, 0, sizeof v->colourDirty);
+    v->allDirty = false;
+}
 
-        data <<= 1;
-    }
+/*  A sprite that is on screen in this frame */
+typedef struct
+{
+    int x;
+    int y;
+    int pattern;
+    int colour;
 }
+vdpSprite;
 
-static void vdpDrawByteMagnified (int data, int x, int y, int col, int sprite)
+/*  Read the sprite attribute table up to the end marker.  Returns the number
+ *  of sprites, which are in priority order.
+ */
+static int vdpSpritesEvaluate (vdpSprite *sprites)
 {
+    int attr = VDP_SPRITEATTR_TAB;
     int i;
 
-    for (i = 0; i < 8; i++)
+    for (i = 0; i < 32; i++)
     {
-        if (data & 0x80)
+        uint8_t *a = &machine->vdp.ram[attr + i*4];
+        vdpSprite *s = &sprites[i];
+
+        if (a[0] == 0xD0)
         {
-            if (x+i*2 < 0 || y < 0 || 
-                x+i*2 >= VDP_XSIZE-1 || 
-                y >= VDP_YSIZE)
-            {
-                /*  This pixel of the sprite is not visible */
-                continue;
-            }
+            mprintf (LVL_VDP, "Sprite %d switched off\n", i);
+            break;
+        }
 
-            if (vdpSpriteCoinc[x+i*2][y] || vdpSpriteCoinc[x+i*2+1][y])
-                vdp.st |= VDP_SPRITE_COINC;
+        /*  A sprite is drawn on the line after its y position.  Positions
+         *  near the end of the range are above the top of the screen.
+         */
+        s->y = a[0] + 1;
 
-            vdpSpriteCoinc[x+i*2][y] = true;
-            vdpSpriteCoinc[x+i*2+1][y] = true;
+        if (s->y > 0xE0)
+            s->y -= 256;
 
-            vdpPlot (x+i*2, y, col);
-            vdpPlot (x+i*2+1, y, col);
-        }
+        s->x = a[1];
+        s->colour = a[3] & 0x0F;
 
-        data <<= 1;
-    }
-}
+        if (a[3] & 0x80)
+            s->x -= 32;
 
-static void vdpDrawSprites8x8 (int x, int y, int p, int c, int sprite)
-{
-    int i;
+        /*  16x16 sprites are made of 4 consecutive 8x8 patterns */
+        s->pattern = (a[2] & (VDP_SPRITESIZE ? 0xFC : 0xFF)) * 8 + VDP_SPRITEPAT_TAB;
 
-    mprintf (LVL_VDP, "Draw sprite pat 8x8 0x%x at %d,%d\n", p, x, y);
-    for (i = 0; i < 8; i++)
-    {
-        if (maxSpritesPerLine (y+i, sprite))
-            continue;
+        mprintf (LVL_VDP, "Draw sprite %d @ %d,%d pat=%d, colour=%d\n", i,
+                 s->x, s->y, s->pattern, a[3]);
 
-        vdpDrawByte (vdp.ram[p+i], x, y + i, c & 0x0F, sprite);
+        statusSpriteUpdate (i, s->x, s->y, s->pattern, a[3]);
     }
+
+    return i;
 }
 
-static void vdpDrawSprites16x16 (int x, int y, int p, int c, int sprite)
+/*  Double each bit of a byte for a magnified sprite */
+static int vdpSpriteMagnify (int data)
 {
-    int i, col;
+    data = (data | (data << 4)) & 0x0F0F;
+    data = (data | (data << 2)) & 0x3333;
+    data = (data | (data << 1)) & 0x5555;
 
-    mprintf (LVL_VDP, "Draw sprite pat 16x16 0x%x at %d,%d\n", p, x, y);
-
-    for (i = 0; i < 16; i++)
-    {
-        if (maxSpritesPerLine (y+i, sprite))
-            continue;
-
-        for (col = 0; col < 16; col += 8)
-        {
-            vdpDrawByte (vdp.ram[p+i+col*2], x + col, y + i, c & 0x0F, sprite);
-        }
-    }
+    return data | (data << 1);
 }
 
-static void vdpDrawSprites8x8Mag (int x, int y, int p, int c, int sprite)
+/*  Draw the sprites on line y over the tiles.  Each sprite's pattern for the
+ *  line is clipped to the screen and tested against a bit mask of the pixels
+ *  covered by earlier sprites, which have priority.  The visible pixels are
+ *  drawn 8 at a time using the expanded pattern as a mask, so the line must
+ *  have room for 7 pixels past its right edge.  If line is NULL only the
+ *  sprite status is updated.
+ */
+static void vdpSpriteLine (int y, uint8_t *line, vdpSprite *sprites, int count)
 {
-    int i;
+    /*  Pixels covered by sprites so far, leftmost in the most significant bit
+     *  of the first word.  The extra word is for the part of a sprite's
+     *  window past the right edge, which is always clear.
+     */
+    uint64_t covered[VDP_XSIZE / 64 + 1];
+    int size = VDP_SPRITESIZE ? 16 : 8;
+    int mag = VDP_SPRITEMAG ? 1 : 0;
+    int width = size << mag;
+    int onLine = 0;
 
-    mprintf (LVL_VDP, "Draw sprite 8x8 mag pat 0x%x at %d,%d\n", p, x, y);
+    memset (covered, 0, sizeof covered);
 
-    for (i = 0; i < 8; i++)
+    for (int i = 0; i < count; i++)
     {
-        if (maxSpritesPerLine (y+i*2, sprite))
-            continue;
-
-        vdpDrawByteMagnified (vdp.ram[p+i], x, y + i*2, c & 0x0F, sprite);
+        vdpSprite *s = &sprites[i];
+        int row = y - s->y;
 
-        if (maxSpritesPerLine (y+i*2+1, sprite))
+        if (row < 0 || row >= width)
             continue;
 
-        vdpDrawByteMagnified (vdp.ram[p+i], x, y + i*2+1, c & 0x0F, sprite);
-    }
-}
+        if (++onLine == 5)
+        {
+            if (!(machine->vdp.st & VDP_SPRITE_LINE))
+            {
+                mprintf (LVL_VDP, "sprite %d is 5th on line %d\n", i, y);
+                machine->vdp.st = (machine->vdp.st & 0xe0) | VDP_SPRITE_LINE | i;
+            }
 
-static void vdpDrawSprites16x16Mag (int x, int y, int p, int c, int sprite)
-{
-    int i, col;
+            break;
+        }
 
-    mprintf (LVL_VDP, "Draw sprite 16x16 mag pat 0x%x at %d,%d\n", p, x, y);
+        row >>= mag;
 
-    for (i = 0; i < 16; i++)
-    {
-        for (col = 0; col < 16; col += 8)
+        /*  The pixels of the sprite on this line, leftmost in the most
+         *  significant bit */
+        uint32_t data = 0;
+
+        for (int col = 0; col < size; col += 8)
         {
-            if (maxSpritesPerLine (y+i*2, sprite))
-                continue;
+            int byte = machine->vdp.ram[s->pattern + row + col * 2];
+
+            if (mag)
+                data |= (uint32_t) vdpSpriteMagnify (byte) << (16 - col * 2);
+            else
+                data |= (uint32_t) byte << (24 - col);
+        }
 
-            vdpDrawByteMagnified (vdp.ram[p+i+col*2], x + col, y + i*2, c & 0x0F, sprite);
+        int x = s->x;
 
-            if (maxSpritesPerLine (y+i*2+1, sprite))
+        /*  Remove the pixels that are not visible */
+        if (x < 0)
+        {
+            if (-x >= width)
                 continue;
 
-            vdpDrawByteMagnified (vdp.ram[p+i+col*2], x + col, y + i*2+1, c & 0x0F, sprite);
+            data <<= -x;
+            x = 0;
         }
-    }
-}
-
-static void vdpDrawSprites (void)
-{
-    int size;
-    int i;
-    int x, y, p, c;
-    int attr = VDP_SPRITEATTR_TAB;
-    int entrySize = 8;
 
-    vdp.st &= ~VDP_SPRITE_COINC;
-    memset (vdpSpriteCoinc, 0, VDP_XSIZE * VDP_YSIZE * sizeof (bool));
+        if (VDP_XSIZE - x < 32)
+            data &= ~(0xFFFFFFFF >> (VDP_XSIZE - x));
 
-    size = (VDP_SPRITESIZE ? 1 : 0);
-    size |= (VDP_SPRITEMAG ? 2 : 0);
+        /*  Sprites coincide if any of their pixels overlap, whether they are
+         *  transparent or not.  Only pixels not covered by an earlier sprite
+         *  are visible.
+         */
+        int word = x >> 6;
+        int shift = x & 63;
+        uint64_t window = covered[word] << shift;
+        uint64_t pattern = (uint64_t) data << 32;
 
-    for (i = 0; i < VDP_YSIZE; i++)
-        vdpSpritesPerLine[i] = 0;
+        if (shift)
+            window |= covered[word + 1] >> (64 - shift);
 
-    for (i = 0; i < 32; i++)
-    {
-        y = vdp.ram[attr + i*4] + 1;
-        x = vdp.ram[attr + i*4 + 1];
-        p = vdp.ram[attr + i*4 + 2] * entrySize + VDP_SPRITEPAT_TAB;
-        c = vdp.ram[attr + i*4 + 3];
-
-        if (y == 0xD1)
-        {
-            mprintf (LVL_VDP, "Sprite %d switched off\n", y);
-            return;
-        }
+        uint32_t under = window >> 32;
 
-        if (c & 0x80)
-            x -= 32;
+        if (data & under)
+            machine->vdp.st |= VDP_SPRITE_COINC;
 
-        mprintf (LVL_VDP, "Draw sprite %d @ %d,%d pat=%d, colour=%d\n", i, x, y, p, c);
+        covered[word] |= pattern >> shift;
 
-        statusSpriteUpdate (i, x, y, p, c);
+        if (shift)
+            covered[word + 1] |= pattern << (64 - shift);
 
-        #if 0
-        /*  Transparent sprites don't get drawn */
-        if (c == 0)
+        /*  Colour 0 is transparent */
+        if (!line || !s->colour)
             continue;
-        #endif
 
-        switch (size)
+        uint64_t colour = s->colour * EXPAND_BYTES;
+
+        for (uint32_t visible = data & ~under; visible; visible <<= 8, x += 8)
         {
-        case 0: vdpDrawSprites8x8 (x, y, p, c, i); break;
-        case 1: vdpDrawSprites16x16 (x, y, p, c, i); break;
-        case 2: vdpDrawSprites8x8Mag (x, y, p, c, i); break;
-        case 3: vdpDrawSprites16x16Mag (x, y, p, c, i); break;
+            uint64_t mask = expandMask[visible >> 24];
+            uint64_t pixels;
+
+            memcpy (&pixels, &line[x], 8);
+            pixels = (pixels & ~mask) | (colour & mask);
+            memcpy (&line[x], &pixels, 8);
         }
     }
 }
 
-static void vdpUpdateMode (void)
+/*  Find the sprites on screen and the lines they are on, clearing the
+ *  coincidence flag ready for the lines to be drawn.  Returns the number of
+ *  sprites.
+ */
+static int vdpSpritesFind (vdpSprite *sprites, bool *spriteLine)
 {
-    /*  In text mode, the rightmost 16 pixels are set to the background colour
-     */
-    if (VDP_TEXT_MODE)
-    {
-        for (int x = VDP_XSIZE - 16; x < VDP_XSIZE; x++)
-        {
-            for (int y = 0; y < VDP_YSIZE; y++)
-            {
-                vdpPlot (x, y, 0);
-            }
-        }
+    int height = (VDP_SPRITESIZE ? 16 : 8) << (VDP_SPRITEMAG ? 1 : 0);
+    int count;
 
-        vdpSpritesEnabled = false;
-    }
-    else
-        vdpSpritesEnabled = true;
+    memset (spriteLine, 0, VDP_YSIZE * sizeof spriteLine[0]);
+    machine->vdp.st &= ~VDP_SPRITE_COINC;
+    count = vdpSpritesEvaluate (sprites);
+
+    for (int i = 0; i < count; i++)
+        for (int y = sprites[i].y; y < sprites[i].y + height; y++)
+            if (y >= 0 && y < VDP_YSIZE)
+                spriteLine[y] = true;
+
+    return count;
 }
 
+/*  Update the sprite status for a frame where nothing has changed on screen.
+ *  The status flags are cleared when they are read so they must be set
+ *  again on every frame.
+ */
+static void vdpSpriteStatus (void)
+{
+    vdpSprite sprites[32];
+    bool spriteLine[VDP_YSIZE];
+
+    if (!VDP_SCRN_ENABLE || VDP_TEXT_MODE || VDP_MULTI_MODE)
+        return;
+
+    int count = vdpSpritesFind (sprites, spriteLine);
+
+    for (int y = 0; y < VDP_YSIZE; y++)
+        if (spriteLine[y])
+            vdpSpriteLine (y, NULL, sprites, count);
+}
+
+/*  Draw the parts of the display that have changed.  Lines are drawn again if
+ *  any of their tiles have changed or if they have sprites on them, in this
+ *  frame or the last so that moved sprites are erased.  Sprite status is
+ *  updated on every frame whether or not anything is drawn.
+ */
 void vdpRefresh (void)
 {
-    int sc;
+    VdpState *v = &machine->vdp;
 
     if (VDP_INT_ENABLE)
     {
@@ -663,20 +761,20 @@ void vdpRefresh (void)
          */
         mprintf (LVL_VDP, "IRQ_VDP lowered\n");
         cruBitInput (0, IRQ_VDP, 0);
-        vdp.st |= VDP_VERT_RETRACE;
+        v->st |= VDP_VERT_RETRACE;
     }
 
-    if (!vdpRefreshNeeded || !vdpInitialised)
+    if (!v->graphics)
         return;
 
-    vdpRefreshNeeded = false;
-
-    if (vdpModeChanged)
+    if (!v->dirty)
     {
-        vdpUpdateMode ();
-        vdpModeChanged = false;
+        vdpSpriteStatus ();
+        return;
     }
 
+    v->dirty = false;
+
     if (VDP_MULTI_MODE)
     {
         printf ("mode=%s\n",
@@ -684,18 +782,57 @@ void vdpRefresh (void)
         halt ("unsupported VDP mode");
     }
 
-    for (sc = 0; sc < (VDP_TEXT_MODE ? 0x3C0 : 0x300); sc++)
+    /*  A blanked display only shows the background colour.  Everything is
+     *  drawn again when it is unblanked as that is a register change.
+     */
+    if (!VDP_SCRN_ENABLE)
     {
-        if (VDP_TEXT_MODE)
-            vdpDrawChar (sc % 40, sc / 40, 6, vdp.ram[VDP_SCRN_IMGTAB + sc]);
-        else
-            vdpDrawChar (sc % 32, sc / 32, 8, vdp.ram[VDP_SCRN_IMGTAB + sc]);
+        uint8_t line[VDP_XSIZE];
+
+        memset (line, VDP_BG_COLOUR, VDP_XSIZE);
+
+        for (int y = 0; y < VDP_YSIZE; y++)
+            vdpLineOutput (y, line);
+
+        memset (v->spriteLine, 0, sizeof v->spriteLine);
+        statusPaneDisplay ();
+        vdpScreenUpdate();
+        return;
     }
 
-    if (vdpSpritesEnabled)
-        vdpDrawSprites ();
+    bool lineDirty[VDP_YSIZE];
+
+    memset (lineDirty, 0, sizeof lineDirty);
+    vdpTilesUpdate (lineDirty);
+
+    /*  There are no sprites in text mode */
+    vdpSprite sprites[32];
+    int spriteCount = 0;
+    bool spriteLine[VDP_YSIZE];
+
+    if (VDP_TEXT_MODE)
+        memset (spriteLine, 0, sizeof spriteLine);
+    else
+        spriteCount = vdpSpritesFind (sprites, spriteLine);
+
+    for (int y = 0; y < VDP_YSIZE; y++)
+    {
+        /*  Room for sprites drawn 8 pixels at a time past the right edge */
+        uint8_t line[VDP_XSIZE + 8];
+
+        if (!lineDirty[y] && !spriteLine[y] && !v->spriteLine[y])
+            continue;
+
+        memcpy (line, v->tiles[y], VDP_XSIZE);
+
+        if (spriteLine[y])
+            vdpSpriteLine (y, line, sprites, spriteCount);
+
+        vdpLineOutput (y, line);
+    }
+
+    memcpy (v->spriteLine, spriteLine, sizeof spriteLine);
 
     statusPaneDisplay ();
     vdpScreenUpdate();
 }
-
@@ -27,9 +27,29 @@
 
 int vdpReadStatus (void);
 int vdpReadRegister (int reg);
+uint8_t vdpData (int addr);
 uint16_t vdpRead (uint8_t *ptr, uint16_t addr, int size);
 void vdpWrite (uint8_t *ptr, uint16_t addr, uint16_t data, int size);
-void vdpInitGraphics (bool statusPane, int scale);
+/*  A display shows the screen, VDP_XSIZE x VDP_YSIZE pixels, scaled up by
+ *  scale and, if paneXSize is not 0, the status pane to the right of it
+ *  unscaled.  open is called once when video is enabled and show each time
+ *  a frame has been drawn.  Pixels are 4 bytes of r, g, b and unused, top row
+ *  first.  pane is NULL if there is no status pane.  Either may be NULL.
+ */
+typedef struct
+{
+    const char *name;
+    void (*open) (int scale, int paneXSize, int paneYSize);
+    void (*show) (const uint8_t *screen, const uint8_t *pane);
+}
+vdpDisplay;
+
+extern vdpDisplay vdpDisplayGl;
+extern vdpDisplay vdpDisplayMemory;
+
+void vdpDisplayRegister (vdpDisplay *display);
+bool vdpInitGraphics (const char *display, bool statusPane, int scale);
+bool vdpFrameSave (const char *file);
 void vdpRefresh (void);
 void vdpPlotRaw (int x, int y, int colour);
 
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ *  Shows the VDP framebuffer in an OpenGL window.  The screen is copied at its
+ *  native resolution into a texture through a pixel buffer object, so the
+ *  driver can transfer it asynchronously, and scaled up to the window by
+ *  drawing it as a textured quad.  The status pane, if any, is drawn the same
+ *  way but unscaled.
+ */
+
+#include <string.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/glut.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "types.h"
+#include "vdp.h"
+#include "machine.h"
+
+static GLuint screenTexture;
+static GLuint paneTexture;
+static GLuint pixelBuffer;
+static int screenXSize;
+static int windowXSize;
+static int windowYSize;
+static int paneXSize;
+static int paneYSize;
+
+static GLuint glTextureCreate (int xSize, int ySize)
+{
+    GLuint texture;
+
+    glGenTextures (1, &texture);
+    glBindTexture (GL_TEXTURE_2D, texture);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, xSize, ySize, 0, GL_RGBA,
+                  GL_UNSIGNED_BYTE, NULL);
+
+    return texture;
+}
+
+/*  Copy pixels into a texture through the pixel buffer object.  The buffer is
+ *  orphaned first so that the copy does not wait for the previous upload.
+ */
+static void glTextureUpload (GLuint texture, const uint8_t *pixels, int xSize, int ySize)
+{
+    int size = xSize * ySize * 4;
+
+    glBindBuffer (GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    glBufferData (GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+    void *buffer = glMapBuffer (GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+    if (buffer)
+    {
+        memcpy (buffer, pixels, size);
+        glUnmapBuffer (GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture (GL_TEXTURE_2D, texture);
+        glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, xSize, ySize, GL_RGBA,
+                         GL_UNSIGNED_BYTE, 0);
+    }
+
+    glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/*  Draw a texture into a rectangle of the window, top row first */
+static void glTextureDraw (GLuint texture, int x, int xSize, int ySize)
+{
+    glBindTexture (GL_TEXTURE_2D, texture);
+    glBegin (GL_QUADS);
+    glTexCoord2f (0, 0); glVertex2i (x, 0);
+    glTexCoord2f (1, 0); glVertex2i (x + xSize, 0);
+    glTexCoord2f (1, 1); glVertex2i (x + xSize, ySize);
+    glTexCoord2f (0, 1); glVertex2i (x, ySize);
+    glEnd ();
+}
+
+static void glOpen (int scale, int paneX, int paneY)
+{
+    int argc=1;
+    char *argv[] = { (char*)"foo" };
+
+    screenXSize = VDP_XSIZE * scale;
+    windowXSize = screenXSize + paneX;
+    windowYSize = VDP_YSIZE * scale;
+    paneXSize = paneX;
+    paneYSize = paneY;
+
+    glutInit(&argc, argv);
+    glutInitWindowPosition(10,10);
+    glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
+    glutInitWindowSize(windowXSize, windowYSize);
+    glutCreateWindow("TI-99 emulator v" VERSION);
+
+    glViewport (0, 0, windowXSize, windowYSize);
+    glMatrixMode (GL_PROJECTION);
+    glLoadIdentity ();
+    glOrtho (0, windowXSize, windowYSize, 0, -1, 1);
+    glMatrixMode (GL_MODELVIEW);
+    glLoadIdentity ();
+    glEnable (GL_TEXTURE_2D);
+
+    glGenBuffers (1, &pixelBuffer);
+    screenTexture = glTextureCreate (VDP_XSIZE, VDP_YSIZE);
+
+    if (paneXSize)
+        paneTexture = glTextureCreate (paneXSize, paneYSize);
+}
+
+static void glShow (const uint8_t *screen, const uint8_t *pane)
+{
+    glTextureUpload (screenTexture, screen, VDP_XSIZE, VDP_YSIZE);
+    glTextureDraw (screenTexture, 0, screenXSize, windowYSize);
+
+    if (pane)
+    {
+        glTextureUpload (paneTexture, pane, paneXSize, paneYSize);
+        glTextureDraw (paneTexture, screenXSize, paneXSize, paneYSize);
+    }
+
+    glutSwapBuffers();
+}
+
+vdpDisplay vdpDisplayGl = { "gl", glOpen, glShow };
@@ -53,7 +53,9 @@ void watchAdd (uint16_t addr)
     }
 
     w.addr[w.count] = addr;
+    w.last[w.count] = memReadW (addr);
     w.count++;
+    memWatchAdd (addr);
 }
 
 void watchList (void)
@@ -90,11 +92,16 @@ void watchRemove (uint16_t addr)
     for (; i < w.count - 1; i++)
     {
         w.addr[i] = w.addr[i+1];
+        w.last[i] = w.last[i+1];
     }
 
     w.count--;
+    memWatchRemove (addr);
 }
 
+/*  Show any watched locations that have changed.  Only needs to be called
+ *  after the machine watch hit flag has been set by a write to a watched location.
+ */
 void watchShow (void)
 {
     int         i;
@@ -113,3 +120,7 @@ void watchShow (void)
     }
 }
 
+int watchCount (void)
+{
+    return w.count;
+}
@@ -29,6 +29,7 @@ void watchAdd (uint16_t addr);
 void watchList (void);
 void watchRemove (uint16_t addr);
 void watchShow (void);
+int watchCount (void);
 
 #endif
 
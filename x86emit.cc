@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <string.h>
+
+#include "x86emit.h"
+
+X86Emitter::X86Emitter ()
+{
+    _code = nullptr;
+    _size = 0;
+    _pos = 0;
+    _overflow = false;
+}
+
+X86Emitter::~X86Emitter ()
+{
+    if (_code)
+        munmap (_code, _size);
+}
+
+bool X86Emitter::init (size_t size)
+{
+    void *p = mmap (NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    _code = (uint8_t*) p;
+    _size = size;
+    reset ();
+
+    return true;
+}
+
+void X86Emitter::_byte (uint8_t b)
+{
+    if (_pos >= _size)
+    {
+        _overflow = true;
+        return;
+    }
+
+    _code[_pos++] = b;
+}
+
+void X86Emitter::_word (uint16_t w)
+{
+    _byte (w & 0xff);
+    _byte (w >> 8);
+}
+
+void X86Emitter::_dword (uint32_t d)
+{
+    _word (d & 0xffff);
+    _word (d >> 16);
+}
+
+/*  Emit the operand size and REX prefixes.  Byte access to SPL, BPL, SIL and
+ *  DIL needs a REX prefix, even an empty one, to avoid selecting AH-BH.
+ */
+void X86Emitter::_prefix (int size, int reg, int rm, bool mem)
+{
+    uint8_t rex = 0x40;
+
+    if (size == 2)
+        _byte (0x66);
+
+    if (size == 8)
+        rex |= 0x08;
+
+    if (reg >= 8)
+        rex |= 0x04;
+
+    if (rm >= 8)
+        rex |= 0x01;
+
+    if (rex != 0x40 ||
+        (size == 1 && (reg >= 4 || (!mem && rm >= 4))))
+    {
+        _byte (rex);
+    }
+}
+
+void X86Emitter::_op (int size, uint8_t op8, uint8_t op, int reg, int rm)
+{
+    _prefix (size, reg, rm, false);
+    _byte (size == 1 ? op8 : op);
+    _byte (0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X86Emitter::_opMem (int size, uint8_t op8, uint8_t op, int reg, int base, int disp)
+{
+    _prefix (size, reg, base, true);
+    _byte (size == 1 ? op8 : op);
+    _mem (reg, base, disp);
+}
+
+void X86Emitter::_mem (int reg, int base, int disp)
+{
+    int mod = (disp >= -128 && disp < 128) ? 0x40 : 0x80;
+
+    _byte (mod | ((reg & 7) << 3) | (base & 7));
+
+    /*  RSP and R12 as a base need a SIB byte */
+    if ((base & 7) == X86_RSP)
+        _byte (0x24);
+
+    if (mod == 0x40)
+        _byte (disp);
+    else
+        _dword (disp);
+}
+
+void X86Emitter::movImm (int reg, uint32_t imm)
+{
+    if (reg >= 8)
+        _byte (0x41);
+
+    _byte (0xB8 + (reg & 7));
+    _dword (imm);
+}
+
+void X86Emitter::movImm64 (int reg, uint64_t imm)
+{
+    _byte (reg >= 8 ? 0x49 : 0x48);
+    _byte (0xB8 + (reg & 7));
+    _dword (imm & 0xffffffff);
+    _dword (imm >> 32);
+}
+
+void X86Emitter::mov (int size, int dst, int src)
+{
+    _op (size, 0x88, 0x89, src, dst);
+}
+
+/*  Loads of bytes and words are zero extended to 32 bits */
+void X86Emitter::load (int size, int dst, int base, int disp)
+{
+    if (size <= 2)
+    {
+        _prefix (4, dst, base, true);
+        _byte (0x0F);
+        _byte (size == 1 ? 0xB6 : 0xB7);
+        _mem (dst, base, disp);
+        return;
+    }
+
+    _opMem (size, 0x8A, 0x8B, dst, base, disp);
+}
+
+void X86Emitter::store (int size, int base, int disp, int src)
+{
+    _opMem (size, 0x88, 0x89, src, base, disp);
+}
+
+/*  Zero extend the low byte or word of src into the 32 bit dst */
+void X86Emitter::movzx (int size, int dst, int src)
+{
+    _prefix (4, dst, src, false);
+
+    if (size == 1 && dst < 8 && src < 8 && src >= 4)
+        _byte (0x40);
+
+    _byte (0x0F);
+    _byte (size == 1 ? 0xB6 : 0xB7);
+    _byte (0xC0 | ((dst & 7) << 3) | (src & 7));
+}
+
+void X86Emitter::alu (int op, int size, int dst, int src)
+{
+    _op (size, op * 8, op * 8 + 1, src, dst);
+}
+
+void X86Emitter::aluImm (int op, int size, int dst, uint32_t imm)
+{
+    _op (size, 0x80, 0x81, op, dst);
+
+    if (size == 1)
+        _byte (imm);
+    else if (size == 2)
+        _word (imm);
+    else
+        _dword (imm);
+}
+
+void X86Emitter::test (int size, int a, int b)
+{
+    _op (size, 0x84, 0x85, b, a);
+}
+
+void X86Emitter::testImm (int size, int reg, uint32_t imm)
+{
+    _op (size, 0xF6, 0xF7, 0, reg);
+
+    if (size == 1)
+        _byte (imm);
+    else if (size == 2)
+        _word (imm);
+    else
+        _dword (imm);
+}
+
+void X86Emitter::shift (int op, int size, int reg, int count)
+{
+    _op (size, 0xC0, 0xC1, op, reg);
+    _byte (count);
+}
+
+void X86Emitter::neg (int size, int reg)
+{
+    _op (size, 0xF6, 0xF7, 3, reg);
+}
+
+void X86Emitter::notReg (int size, int reg)
+{
+    _op (size, 0xF6, 0xF7, 2, reg);
+}
+
+void X86Emitter::setcc (int cc, int reg)
+{
+    if (reg >= 8)
+        _byte (0x41);
+    else if (reg >= 4)
+        _byte (0x40);
+
+    _byte (0x0F);
+    _byte (0x90 + cc);
+    _byte (0xC0 | (reg & 7));
+}
+
+void X86Emitter::push (int reg)
+{
+    if (reg >= 8)
+        _byte (0x41);
+
+    _byte (0x50 + (reg & 7));
+}
+
+void X86Emitter::pop (int reg)
+{
+    if (reg >= 8)
+        _byte (0x41);
+
+    _byte (0x58 + (reg & 7));
+}
+
+void X86Emitter::call (const void *fn)
+{
+    movImm64 (X86_RAX, (uint64_t) fn);
+    _byte (0xFF);
+    _byte (0xD0);
+}
+
+void X86Emitter::ret ()
+{
+    _byte (0xC3);
+}
+
+/*  Branches are always emitted with a 32 bit displacement.  The returned
+ *  label is later passed to bind() to point the branch at the current
+ *  position.
+ */
+int X86Emitter::jcc (int cc)
+{
+    _byte (0x0F);
+    _byte (0x80 + cc);
+    _dword (0);
+
+    return _pos - 4;
+}
+
+int X86Emitter::jmp ()
+{
+    _byte (0xE9);
+    _dword (0);
+
+    return _pos - 4;
+}
+
+void X86Emitter::bind (int label)
+{
+    if (_overflow)
+        return;
+
+    int32_t rel = _pos - (label + 4);
+    memcpy (_code + label, &rel, 4);
+}
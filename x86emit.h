@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2004-2024 Mark Burkley.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __X86EMIT_H
+#define __X86EMIT_H
+
+#include "types.h"
+
+/*  Minimal x86-64 instruction emitter used by the TMS9900 recompiler.  Only
+ *  the handful of encodings the recompiler needs are provided.  Registers
+ *  are numbered as in the hardware encoding, operand sizes are in bytes.
+ */
+
+enum
+{
+    X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+    X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15
+};
+
+/*  ALU operations, numbered as the /digit of the 0x81 immediate group */
+enum
+{
+    X86_ADD = 0, X86_OR = 1, X86_AND = 4, X86_SUB = 5, X86_XOR = 6, X86_CMP = 7
+};
+
+/*  Shift operations, numbered as the /digit of the 0xC1 group */
+enum
+{
+    X86_ROL = 0, X86_ROR = 1, X86_SHL = 4, X86_SHR = 5, X86_SAR = 7
+};
+
+/*  Condition codes for Jcc and SETcc */
+enum
+{
+    X86_CC_O = 0x0, X86_CC_NO = 0x1, X86_CC_B = 0x2, X86_CC_AE = 0x3,
+    X86_CC_E = 0x4, X86_CC_NE = 0x5, X86_CC_BE = 0x6, X86_CC_A = 0x7,
+    X86_CC_S = 0x8, X86_CC_NS = 0x9, X86_CC_P = 0xA, X86_CC_NP = 0xB,
+    X86_CC_L = 0xC, X86_CC_GE = 0xD, X86_CC_LE = 0xE, X86_CC_G = 0xF
+};
+
+class X86Emitter
+{
+public:
+    X86Emitter ();
+    ~X86Emitter ();
+    bool init (size_t size);
+    void reset () { _pos = 0; _overflow = false; }
+    uint8_t *current () { return _code + _pos; }
+    size_t space () { return _size - _pos; }
+    bool overflow () { return _overflow; }
+
+    void movImm (int reg, uint32_t imm);
+    void movImm64 (int reg, uint64_t imm);
+    void mov (int size, int dst, int src);
+    void load (int size, int dst, int base, int disp);
+    void store (int size, int base, int disp, int src);
+    void movzx (int size, int dst, int src);
+    void alu (int op, int size, int dst, int src);
+    void aluImm (int op, int size, int dst, uint32_t imm);
+    void test (int size, int a, int b);
+    void testImm (int size, int reg, uint32_t imm);
+    void shift (int op, int size, int reg, int count);
+    void neg (int size, int reg);
+    void notReg (int size, int reg);
+    void setcc (int cc, int reg);
+    void push (int reg);
+    void pop (int reg);
+    void call (const void *fn);
+    void ret ();
+    int jcc (int cc);
+    int jmp ();
+    void bind (int label);
+
+private:
+    void _byte (uint8_t b);
+    void _word (uint16_t w);
+    void _dword (uint32_t d);
+    void _prefix (int size, int reg, int rm, bool mem);
+    void _op (int size, uint8_t op8, uint8_t op, int reg, int rm);
+    void _opMem (int size, uint8_t op8, uint8_t op, int reg, int base, int disp);
+    void _mem (int reg, int base, int disp);
+
+    uint8_t *_code;
+    size_t _size;
+    size_t _pos;
+    bool _overflow;
+};
+
+#endif